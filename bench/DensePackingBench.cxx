@@ -0,0 +1,327 @@
+// Kernel microbenchmarks for DensePacking.
+//
+// Builds synthetic mono- or polydisperse packings in a cubic box and times
+// every step kernel in isolation, reporting particles/s and an estimate of
+// the memory traffic (bytes/s) each kernel has to move.
+//
+// Usage:
+//   DensePackingBench [--n 100000,1000000] [--density 0.55] [--poly 1.0]
+//                     [--reps 20] [--seed 12345] [--csv bench.csv]
+//                     [--steps 0] [--sort 0]
+//
+// --poly is the max/min radius ratio (1.0 = monodisperse). --sort 1 puts the
+// particles in Morton order (simulation.spatial_sort) before timing.
+//
+// With --steps S > 0 the benchmark instead runs S full steps of the module
+// pipeline per N and writes the module timers to timers_T<threads>_N<N>.csv
+// (same layout as timers.csv). scripts/scaling_harness.py drives this mode
+// over a thread-count x N matrix.
+#include <Kokkos_Core.hpp>
+#include "Data.h"
+#include "ContactSearch.h"
+#include "Forces.h"
+#include "Integrator.h"
+#include "RadiusScaler.h"
+#include "TiledStep.h"
+#include "Timer.h"
+#include "TimersLog.h"
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct BenchSettings
+{
+  std::vector<int> counts = {100000, 1000000};
+  double density = 0.55;
+  double poly = 1.0;
+  int reps = 20;
+  unsigned long seed = 12345;
+  std::string csv = "bench.csv";
+  int steps = 0;
+  bool sort = false;
+};
+
+struct BenchResult
+{
+  std::string kernel;
+  int N;
+  double avgTime;
+  double bytes;
+};
+
+static std::vector<int> ParseCounts(const std::string &text)
+{
+  std::vector<int> counts;
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      counts.push_back((int)std::stod(item));
+  return counts;
+}
+
+static BenchSettings ParseArgs(int argc, char *argv[])
+{
+  BenchSettings s;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg.rfind("--kokkos", 0) == 0)
+      continue;
+    if (i + 1 >= argc)
+    {
+      std::cerr << "DensePackingBench: missing value for " << arg << "\n";
+      exit(1);
+    }
+    std::string value = argv[++i];
+    if (arg == "--n")
+      s.counts = ParseCounts(value);
+    else if (arg == "--density")
+      s.density = std::stod(value);
+    else if (arg == "--poly")
+      s.poly = std::stod(value);
+    else if (arg == "--reps")
+      s.reps = std::stoi(value);
+    else if (arg == "--seed")
+      s.seed = std::stoul(value);
+    else if (arg == "--csv")
+      s.csv = value;
+    else if (arg == "--steps")
+      s.steps = std::stoi(value);
+    else if (arg == "--sort")
+      s.sort = std::stoi(value) != 0;
+    else
+    {
+      std::cerr << "DensePackingBench: unknown option " << arg << "\n";
+      exit(1);
+    }
+  }
+  return s;
+}
+
+// Random (overlapping) placement in a cube sized so that the total sphere
+// volume gives the requested packing fraction. Radii are uniform in
+// [1, poly]. Overlaps are fine here: we only need realistic neighbour counts.
+static void GeneratePacking(Data &data, int N, const BenchSettings &s)
+{
+  std::mt19937_64 rng(s.seed);
+  std::uniform_real_distribution<double> radiusDist(1.0, std::max(1.0, s.poly));
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  data.allocateParticles(N);
+  auto POSITION_host = Kokkos::create_mirror_view(data.POSITION);
+  auto RADIUS_host = Kokkos::create_mirror_view(data.RADIUS);
+
+  double volume = 0;
+  double min_radius = std::numeric_limits<double>::max();
+  double max_radius = std::numeric_limits<double>::lowest();
+  for (int i = 0; i < N; ++i)
+  {
+    double r = s.poly > 1.0 ? radiusDist(rng) : 1.0;
+    RADIUS_host(i) = r;
+    volume += 4.0 / 3.0 * Constants::PI * r * r * r;
+    min_radius = std::min(min_radius, r);
+    max_radius = std::max(max_radius, r);
+  }
+  const double L = std::cbrt(volume / s.density);
+  for (int i = 0; i < N; ++i)
+    POSITION_host(i) = Vec3(unit(rng) * L, unit(rng) * L, unit(rng) * L);
+
+  data.WALL_MIN = Vec3(0, 0, 0);
+  data.WALL_MAX = Vec3(L, L, L);
+  data.simConstants.relaxation_coefficient = 0.1;
+  data.simConstants.relaxation_coefficient_scale = 1.0;
+  data.simConstants.overlap_limit = 1E12;
+  data.simConstants.radius_scale_delta = 1E-4;
+  data.simConstants.maxOverlap = 0;
+
+  Kokkos::deep_copy(data.POSITION, POSITION_host);
+  Kokkos::deep_copy(data.RADIUS, RADIUS_host);
+  Kokkos::deep_copy(data.OLD_RADIUS, RADIUS_host);
+  data.allocateNeighbours(min_radius, max_radius);
+  if (s.sort)
+    data.sortParticles();
+}
+
+// Runs `setup` untimed and `kernel` timed, `reps` times, and returns the
+// average kernel time in seconds.
+static double TimeKernel(int reps, const std::function<void()> &setup, const std::function<void()> &kernel)
+{
+  Timer timer;
+  setup();
+  kernel(); // warm-up
+  for (int r = 0; r < reps; ++r)
+  {
+    setup();
+    Kokkos::fence();
+    timer.Start();
+    kernel();
+    Kokkos::fence();
+    timer.Stop();
+  }
+  timer.CalculateAVG();
+  return timer.avgTime;
+}
+
+static std::vector<BenchResult> RunBenchmarks(int N, const BenchSettings &s)
+{
+  Data data;
+  GeneratePacking(data, N, s);
+
+  ContactSearch contactSearch(&data);
+  Forces forces(&data);
+  Integrator integrator(&data);
+  RadiusScaler radiusScaler(&data);
+  TiledStep tiledStep(&data);
+  contactSearch.Initialization();
+  forces.Initialization();
+  integrator.Initialization();
+  radiusScaler.Initialization();
+  tiledStep.Initialization();
+
+  auto nothing = [] {};
+  auto reset = [&] { contactSearch.ResetTables(); };
+  auto hashed = [&] { contactSearch.ResetTables(); contactSearch.CalculateHash(); };
+  auto sorted = [&] { hashed(); contactSearch.SortByCell(); };
+  auto bounded = [&] { sorted(); contactSearch.FindCellBounds(); };
+
+  std::vector<BenchResult> results;
+  const double n = N;
+
+  // Contact search stages. Each stage is timed on input prepared by the
+  // previous stages, so the sort never sees already-sorted keys.
+  results.push_back({"CALCULATE_HASH", N, TimeKernel(s.reps, reset, [&] { contactSearch.CalculateHash(); }),
+                     n * (sizeof(Vec3) + 2 * sizeof(index_t))});
+  results.push_back({"SORT", N, TimeKernel(s.reps, hashed, [&] { contactSearch.SortByCell(); }),
+                     n * 4 * sizeof(index_t)});
+  results.push_back({"START_END", N, TimeKernel(s.reps, sorted, [&] { contactSearch.FindCellBounds(); }),
+                     n * 4 * sizeof(index_t)});
+  double tNeighbours = TimeKernel(s.reps, bounded, [&] { contactSearch.FindNeighbours(); });
+
+  long nnz = 0;
+  auto &NN_COUNT = data.NN_COUNT;
+  Kokkos::parallel_reduce("BENCH_NN_SUM", N, KOKKOS_LAMBDA(const int idx, long &sum) { sum += NN_COUNT(idx); }, nnz);
+  std::cout << "N " << N << " average neighbours " << nnz / n << "\n";
+
+  results.push_back({"FIND_NEIGHBOURS", N, tNeighbours,
+                     n * (sizeof(Vec3) + sizeof(double) + sizeof(int)) + nnz * (sizeof(index_t) + sizeof(neighbour_t) + sizeof(Vec3) + sizeof(double))});
+
+  // The neighbour list from the last run stays valid for the remaining kernels.
+  results.push_back({"FORCES", N, TimeKernel(s.reps, nothing, [&] { forces.RunKernels(); }),
+                     n * (2 * sizeof(int) + sizeof(Vec3) + sizeof(double) + sizeof(double) + sizeof(Vec3)) + nnz * (sizeof(neighbour_t) + sizeof(Vec3) + sizeof(double))});
+
+  // Integration moves particles; restore them before each rep so every run
+  // integrates the same state.
+  Kokkos::View<Vec3 *> POSITION_backup("POSITION_backup", N);
+  Kokkos::deep_copy(POSITION_backup, data.POSITION);
+  results.push_back({"INTEGRATION", N, TimeKernel(s.reps, [&] { Kokkos::deep_copy(data.POSITION, POSITION_backup); }, [&] { integrator.RunKernels(); }),
+                     n * (sizeof(int) + 3 * sizeof(Vec3) + sizeof(double))});
+
+  // FORCES and INTEGRATION fused per cache-sized tile. The same state is
+  // restored before each rep; the kernel copies its buffer back to POSITION.
+  results.push_back({"TILED_STEP", N, TimeKernel(s.reps, [&] { Kokkos::deep_copy(data.POSITION, POSITION_backup); }, [&] { tiledStep.RunKernels(); }),
+                     n * (2 * sizeof(int) + 5 * sizeof(Vec3) + 2 * sizeof(double)) + nnz * (sizeof(neighbour_t) + sizeof(Vec3) + sizeof(double))});
+  std::cout << "N " << N << " tiles of " << tiledStep.TileSize() << ", halo " << 100.0 * tiledStep.HaloFraction() << "% of neighbour references\n";
+
+#ifndef DENSEPACKING_LAZY_RADIUS
+  // With DENSEPACKING_LAZY_RADIUS the kernels scale the radii on read and
+  // there is no radius pass to time.
+  results.push_back({"RadiusScaler", N, TimeKernel(s.reps, nothing, [&] { radiusScaler.ScaleRadii(1E-4); }),
+                     n * (sizeof(int) + 2 * sizeof(double))});
+#endif
+  return results;
+}
+
+// Runs the per-step module pipeline (without Reader/Writer/Time) for a fixed
+// number of steps, logging module timers every step.
+static void RunSteps(int N, const BenchSettings &s)
+{
+  Data data;
+  GeneratePacking(data, N, s);
+
+  std::vector<AModule *> modules;
+  modules.push_back(new RadiusScaler(&data));
+  modules.push_back(new ContactSearch(&data));
+  modules.push_back(new Forces(&data));
+  modules.push_back(new Integrator(&data));
+  for (int i = 0; i < modules.size(); ++i)
+  {
+    modules[i]->Initialization();
+  }
+
+  std::stringstream filename;
+  filename << "timers_T" << Kokkos::DefaultExecutionSpace().concurrency() << "_N" << N << ".csv";
+  TimersLog timersLog(filename.str(), modules);
+
+  double total = 0;
+  for (int step = 0; step < s.steps; ++step)
+  {
+    for (int i = 0; i < modules.size(); ++i)
+    {
+      modules[i]->RunProcessing();
+    }
+    data.cstep++;
+    total += timersLog.Record(data).back();
+  }
+  std::cout << "N " << N << " steps " << s.steps << " total " << total << " s, "
+            << std::scientific << (double)N * s.steps / total << " particle-steps/s" << std::defaultfloat
+            << " -> " << filename.str() << "\n";
+
+  for (int i = 0; i < modules.size(); ++i)
+  {
+    delete modules[i];
+  }
+}
+
+// Kernel mode: one table (and CSV block) per N.
+static void RunKernelTable(const BenchSettings &s)
+{
+  std::ofstream csv(s.csv);
+  csv << "KERNEL;N;DENSITY;POLY;REPS;AVG_TIME;PARTICLES_PER_S;BYTES_PER_S\n";
+
+  const int w = 18;
+  for (int N : s.counts)
+  {
+    auto results = RunBenchmarks(N, s);
+    std::cout << std::left << std::setw(w) << "KERNEL" << std::setw(w) << "N" << std::setw(w) << "AVG_TIME"
+              << std::setw(w) << "PARTICLES/S" << std::setw(w) << "GB/S" << "\n";
+    for (const auto &r : results)
+    {
+      double pps = r.avgTime > 0 ? r.N / r.avgTime : 0;
+      double bps = r.avgTime > 0 ? r.bytes / r.avgTime : 0;
+      std::cout << std::left << std::setw(w) << r.kernel << std::setw(w) << r.N << std::scientific << std::setprecision(4)
+                << std::setw(w) << r.avgTime << std::setw(w) << pps << std::setw(w) << bps * 1E-9
+                << std::defaultfloat << "\n";
+      csv << r.kernel << ";" << r.N << ";" << s.density << ";" << s.poly << ";" << s.reps << ";"
+          << r.avgTime << ";" << pps << ";" << bps << "\n";
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  Kokkos::initialize(argc, argv);
+  {
+    BenchSettings s = ParseArgs(argc, argv);
+    std::cout << "DensePackingBench " << PROJECT_VERSION << " concurrency "
+              << Kokkos::DefaultExecutionSpace().concurrency() << "\n";
+    std::cout << "density " << s.density << " poly " << s.poly << " reps " << s.reps << " seed " << s.seed << "\n";
+
+    if (s.steps > 0)
+    {
+      for (int N : s.counts)
+        RunSteps(N, s);
+    }
+    else
+    {
+      RunKernelTable(s);
+    }
+  }
+  Kokkos::finalize();
+  return 0;
+}
@@ -0,0 +1,256 @@
+// Python module "densepacking": runs the DensePacking pipeline in-process
+// and exposes the particle Views as NumPy arrays.
+//
+//   import densepacking
+//   sim = densepacking.Simulation("config.yaml")   # or a dict with the same layout
+//   sim.step(100)                                   # False once the run has finished
+//   sim.position                                    # (N, 3) float64, shares memory with POSITION
+//   sim.neighbours[i, :sim.nn_count[i]]             # neighbour IDs of particle i
+//
+// Arrays share memory with the Views when these are host accessible (Serial
+// and OpenMP builds, CUDA with UVM); on device backends they are host copies
+// taken when the attribute is read. Writes to shared arrays go straight into
+// the simulation. An array keeps its Simulation alive; it stays valid until
+// the Simulation is released (release(), or interpreter exit).
+//
+// Single process only: the module is built without MPI. Config errors that
+// the executable treats as fatal (exit(1)) end the Python process as well.
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <Kokkos_Core.hpp>
+#include "Simulation.h"
+#include "YamlAPI.h"
+#include <fstream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace py = pybind11;
+
+static_assert(sizeof(Vec3) == 3 * sizeof(double), "Vec3 is exposed as three packed doubles");
+
+class PySimulation;
+
+// Views must be gone before Kokkos::finalize, which runs at interpreter exit
+// while Python may still hold Simulation objects.
+static std::set<PySimulation *> live;
+
+class PySimulation
+{
+public:
+  explicit PySimulation(const YAML::Node &config)
+  {
+    simulation.reset(new Simulation(config));
+    if (!simulation->Setup())
+    {
+      Release();
+      throw std::runtime_error("densepacking: the initial configuration could not be set up (see stderr)");
+    }
+    live.insert(this);
+  }
+  ~PySimulation()
+  {
+    Release();
+    live.erase(this);
+  }
+
+  void Release() { simulation.reset(); }
+
+  Simulation &Get()
+  {
+    if (!simulation)
+      throw std::runtime_error("densepacking: this Simulation has been released");
+    return *simulation;
+  }
+
+private:
+  std::unique_ptr<Simulation> simulation;
+};
+
+// dict / list / scalar -> YAML node with the config.yaml layout.
+static YAML::Node ToYaml(const py::handle &value)
+{
+  YAML::Node node;
+  if (py::isinstance<py::dict>(value))
+  {
+    for (auto item : py::reinterpret_borrow<py::dict>(value))
+      node[py::str(item.first).cast<std::string>()] = ToYaml(item.second);
+  }
+  else if (py::isinstance<py::list>(value) || py::isinstance<py::tuple>(value))
+  {
+    for (auto item : py::reinterpret_borrow<py::sequence>(value))
+      node.push_back(ToYaml(item));
+  }
+  else if (py::isinstance<py::bool_>(value))
+    node = value.cast<bool>();
+  else if (py::isinstance<py::int_>(value))
+    node = value.cast<long long>();
+  else if (py::isinstance<py::float_>(value))
+    node = value.cast<double>();
+  else if (py::isinstance<py::str>(value))
+    node = value.cast<std::string>();
+  else if (!value.is_none())
+    throw py::type_error("densepacking: unsupported config value " + py::repr(value).cast<std::string>());
+  return node;
+}
+
+static YAML::Node LoadConfig(const py::object &config)
+{
+  if (py::isinstance<py::dict>(config))
+    return ToYaml(config);
+  const std::string filename = py::str(config).cast<std::string>();
+  if (!std::ifstream(filename).good())
+    throw std::runtime_error("densepacking: cannot open config file " + filename);
+  return YamlAPI::LoadConfig(filename);
+}
+
+// NumPy view of `view` with the given shape and byte strides. `owner` keeps
+// the Simulation alive for as long as the array exists.
+template <class T, class ViewType>
+static py::array Wrap(const py::object &owner, const ViewType &view, const std::vector<py::ssize_t> &shape, const std::vector<py::ssize_t> &strides)
+{
+  if (Kokkos::SpaceAccessibility<Kokkos::HostSpace, typename ViewType::memory_space>::accessible)
+    return py::array_t<T>(shape, strides, reinterpret_cast<T *>(view.data()), owner);
+  typedef typename ViewType::HostMirror Mirror;
+  Mirror *mirror = new Mirror(Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), view));
+  py::capsule keep(mirror, [](void *p) { delete reinterpret_cast<Mirror *>(p); });
+  return py::array_t<T>(shape, strides, reinterpret_cast<T *>(mirror->data()), keep);
+}
+
+template <class ViewType>
+static py::array WrapVec3(const py::object &owner, const ViewType &view, index_t N)
+{
+  return Wrap<double>(owner, view, {N, 3}, {(py::ssize_t)sizeof(Vec3), (py::ssize_t)sizeof(double)});
+}
+
+template <class T, class ViewType>
+static py::array Wrap1D(const py::object &owner, const ViewType &view, index_t N)
+{
+  return Wrap<T>(owner, view, {N}, {(py::ssize_t)sizeof(T)});
+}
+
+static Data &DataOf(const py::object &self) { return self.cast<PySimulation &>().Get().data; }
+
+PYBIND11_MODULE(densepacking, m)
+{
+  m.doc() = "DensePacking particle packing simulation with zero-copy NumPy access to the particle state";
+
+  if (!Kokkos::is_initialized())
+    Kokkos::initialize();
+  py::module_::import("atexit").attr("register")(py::cpp_function([]() {
+    for (PySimulation *simulation : live)
+      simulation->Release();
+    if (Kokkos::is_initialized() && !Kokkos::is_finalized())
+      Kokkos::finalize();
+  }));
+
+  py::class_<PySimulation>(m, "Simulation")
+      .def(py::init([](const py::object &config) { return new PySimulation(LoadConfig(config)); }), py::arg("config") = "config.yaml",
+           "Sets up a simulation from a config.yaml path or a dict with the same layout: generates or reads the initial packing and "
+           "initializes the module pipeline.")
+      .def(
+          "step",
+          [](PySimulation &self, int count) {
+            Simulation &simulation = self.Get();
+            py::gil_scoped_release release;
+            for (int i = 0; i < count && simulation.data.COMPUTE; ++i)
+              simulation.Step();
+            return simulation.data.COMPUTE;
+          },
+          py::arg("count") = 1, "Runs up to `count` steps; returns False once the run has finished.")
+      .def(
+          "run",
+          [](PySimulation &self) {
+            Simulation &simulation = self.Get();
+            py::gil_scoped_release release;
+            unsigned long steps = 0;
+            while (simulation.data.COMPUTE)
+            {
+              simulation.Step();
+              steps++;
+            }
+            return steps;
+          },
+          "Steps until the run has finished; returns the number of steps taken.")
+      .def("release", &PySimulation::Release, "Frees the simulation; arrays obtained from it become invalid.")
+      .def_property_readonly("running", [](PySimulation &self) { return self.Get().data.COMPUTE; })
+      .def_property_readonly("current_step", [](PySimulation &self) { return self.Get().data.cstep; })
+      .def_property_readonly("total_steps", [](PySimulation &self) { return self.Get().data.total_steps; })
+      .def_property_readonly("particle_count", [](PySimulation &self) { return (long long)self.Get().data.PARTICLE_COUNT; })
+      .def_property_readonly("nn_max", [](PySimulation &self) { return self.Get().data.simConstants.NN_MAX; })
+      .def_property_readonly("current_max_overlap", [](PySimulation &self) { return self.Get().data.simConstants.maxOverlap; })
+      .def_property_readonly("module_names", [](PySimulation &self) {
+        std::vector<std::string> names;
+        for (AModule *module : self.Get().modules)
+          names.push_back(module->getModuleName());
+        return names;
+      })
+      .def_property_readonly("position", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return WrapVec3(self, data.POSITION, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("velocity", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return WrapVec3(self, data.VELOCITY, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("radius", [](const py::object &self) {
+        Data &data = DataOf(self);
+#ifdef DENSEPACKING_LAZY_RADIUS
+        // Only the base radii are stored; the scaled ones are a copy.
+        const index_t N = data.PARTICLE_COUNT;
+        const RadiusField RADII = data.Radii();
+        Kokkos::View<double *> SCALED("RADIUS", N);
+        Kokkos::parallel_for("PYTHON_RADIUS", N, KOKKOS_LAMBDA(const index_t idx) { SCALED(idx) = RADII(idx); });
+        typedef Kokkos::View<double *> Scaled;
+        py::capsule keep(new Scaled(SCALED), [](void *p) { delete reinterpret_cast<Scaled *>(p); });
+        return Wrap1D<double>(keep, SCALED, N);
+#else
+        return Wrap1D<double>(self, data.RADIUS, data.PARTICLE_COUNT);
+#endif
+      })
+      .def_property_readonly("old_radius", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return Wrap1D<double>(self, data.OLD_RADIUS, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("max_overlap", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return Wrap1D<double>(self, data.MAX_OVERLAP, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("fix", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return Wrap1D<int>(self, data.FIX, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("nn_count", [](const py::object &self) {
+        Data &data = DataOf(self);
+        return Wrap1D<int>(self, data.NN_COUNT, data.PARTICLE_COUNT);
+      })
+      .def_property_readonly("neighbours", [](const py::object &self) {
+        Data &data = DataOf(self);
+        const int NN_MAX = data.simConstants.NN_MAX;
+#ifdef DENSEPACKING_NEIGHBOUR16
+        // Compressed lists are decoded into a copy.
+        const index_t N = data.OWNED_COUNT;
+        const NeighbourList NEIGHBOURS = data.Neighbours();
+        auto &NN_COUNT = data.NN_COUNT;
+        Kokkos::View<index_t *> DECODED("NEIGHBOURS", (size_t)N * NN_MAX);
+        Kokkos::parallel_for("PYTHON_NEIGHBOURS", N, KOKKOS_LAMBDA(const index_t idx) {
+          for (int k = 0; k < NN_COUNT(idx); ++k)
+            DECODED(NeighbourSlot(idx, NN_MAX, k)) = NEIGHBOURS(idx, k); });
+        typedef Kokkos::View<index_t *> Decoded;
+        py::capsule keep(new Decoded(DECODED), [](void *p) { delete reinterpret_cast<Decoded *>(p); });
+        return Wrap<index_t>(keep, DECODED, {N, NN_MAX}, {(py::ssize_t)(NN_MAX * sizeof(index_t)), (py::ssize_t)sizeof(index_t)});
+#else
+        return Wrap<neighbour_t>(self, data.NN_IDS, {data.PARTICLE_COUNT, NN_MAX},
+                                 {(py::ssize_t)(NN_MAX * sizeof(neighbour_t)), (py::ssize_t)sizeof(neighbour_t)});
+#endif
+      })
+      .def_property_readonly("image", [](const py::object &self) {
+        Data &data = DataOf(self);
+        const index_t N = data.IMAGE.extent(0) > 0 ? data.PARTICLE_COUNT : 0;
+        return Wrap<int>(self, data.IMAGE, {N, 3},
+                         {(py::ssize_t)(data.IMAGE.stride(0) * sizeof(int)), (py::ssize_t)(data.IMAGE.stride(1) * sizeof(int))});
+      });
+}
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Convert a particle input (.vtk/.vtp with a RADIUS point array and optional
+VELOCITY and FIX arrays) to the native raw format read by DensePacking
+without VTK (see src/RawParticles.h).
+
+Usage:
+    python ConvertToRaw.py packInput.vtk packInput.dpraw
+"""
+
+import argparse
+import struct
+
+import numpy as np
+
+MAGIC = b"DPRAW001"
+RAW_HAS_VELOCITY = 1
+RAW_HAS_FIX = 2
+
+
+def write_raw(filename, position, radius, velocity=None, fix=None):
+    position = np.ascontiguousarray(position, dtype="<f8").reshape(-1, 3)
+    radius = np.ascontiguousarray(radius, dtype="<f8").reshape(-1)
+    count = len(radius)
+    if len(position) != count:
+        raise ValueError("position and radius lengths differ")
+    flags = 0
+    if velocity is not None:
+        flags |= RAW_HAS_VELOCITY
+    if fix is not None:
+        flags |= RAW_HAS_FIX
+    with open(filename, "wb") as f:
+        f.write(MAGIC + struct.pack("<QII", count, flags, 0))
+        f.write(position.tobytes())
+        f.write(radius.tobytes())
+        if velocity is not None:
+            f.write(np.ascontiguousarray(velocity, dtype="<f8").reshape(count, 3).tobytes())
+        if fix is not None:
+            f.write(np.ascontiguousarray(fix, dtype="<i4").reshape(count).tobytes())
+
+
+def read_vtk(filename):
+    import vtk
+    from vtk.util.numpy_support import vtk_to_numpy
+
+    if filename.endswith(".vtp"):
+        reader = vtk.vtkXMLPolyDataReader()
+    else:
+        reader = vtk.vtkPolyDataReader()
+    reader.SetFileName(filename)
+    reader.Update()
+    poly = reader.GetOutput()
+    point_data = poly.GetPointData()
+
+    def array(name):
+        a = point_data.GetArray(name)
+        return vtk_to_numpy(a) if a is not None else None
+
+    radius = array("RADIUS")
+    if radius is None:
+        raise SystemExit(f"{filename}: missing RADIUS point array")
+    return vtk_to_numpy(poly.GetPoints().GetData()), radius, array("VELOCITY"), array("FIX")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help=".vtk or .vtp particle file")
+    parser.add_argument("output", help="output .dpraw file")
+    args = parser.parse_args()
+
+    position, radius, velocity, fix = read_vtk(args.input)
+    write_raw(args.output, position, radius, velocity, fix)
+    print(f"Wrote {len(radius)} particles to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""
+Read frames from a DensePacking time series (data/PARTICLES.dpts, written
+with output.series; see src/TimeSeries.h). Lists the frames, or exports one
+frame to .vtp with RADIUS, FIX and MAX_OVERLAP point arrays.
+
+Usage:
+    python ReadSeries.py data/PARTICLES.dpts
+    python ReadSeries.py data/PARTICLES.dpts --frame -1 --vtp last.vtp
+"""
+
+import argparse
+import struct
+
+import numpy as np
+
+MAGIC = b"DPTS0001"
+INDEX_MAGIC = b"DPTSIDX1"
+SERIES_DELTA = 1
+HEADER = struct.Struct("<8sQQII")
+FRAME_HEADER = struct.Struct("<QII")
+TRAILER = struct.Struct("<QQ8s")
+INDEX_DTYPE = np.dtype([("step", "<u8"), ("offset", "<u8"), ("keyframe_offset", "<u8")])
+
+
+class Series:
+    def __init__(self, filename):
+        self.file = open(filename, "rb")
+        magic, self.count, fixed, self.flags, self.keyframe_interval = HEADER.unpack(self.file.read(HEADER.size))
+        if magic != MAGIC:
+            raise SystemExit(f"{filename}: not a DensePacking time series")
+        self.fix = np.fromfile(self.file, "<i4", self.count)
+        self.fixed_position = np.fromfile(self.file, "<f8", 3 * fixed).reshape(-1, 3)
+        self.fixed_radius = np.fromfile(self.file, "<f8", fixed)
+        self.fixed_ids = np.nonzero(self.fix > 0)[0]
+        self.free_ids = np.nonzero(self.fix <= 0)[0]
+
+        self.file.seek(-TRAILER.size, 2)
+        index_offset, frames, magic = TRAILER.unpack(self.file.read(TRAILER.size))
+        if magic != INDEX_MAGIC:
+            raise SystemExit(f"{filename}: missing frame index")
+        self.file.seek(index_offset)
+        self.index = np.fromfile(self.file, INDEX_DTYPE, frames)
+
+    def __len__(self):
+        return len(self.index)
+
+    def _block(self, offset, dtype):
+        free = len(self.free_ids)
+        self.file.seek(offset + FRAME_HEADER.size)
+        position = np.fromfile(self.file, dtype, 3 * free).reshape(-1, 3).astype("f8")
+        radius = np.fromfile(self.file, dtype, free).astype("f8")
+        return position, radius
+
+    def frame(self, k):
+        """Returns (step, position, radius, max_overlap) of frame k."""
+        entry = self.index[k]
+        position, radius = self._block(int(entry["keyframe_offset"]), "<f8")
+        if entry["offset"] != entry["keyframe_offset"]:
+            delta_position, delta_radius = self._block(int(entry["offset"]), "<f4")
+            position += delta_position
+            radius += delta_radius
+        max_overlap = np.fromfile(self.file, "<f8", self.count)
+
+        all_position = np.empty((self.count, 3))
+        all_radius = np.empty(self.count)
+        all_position[self.fixed_ids] = self.fixed_position
+        all_radius[self.fixed_ids] = self.fixed_radius
+        all_position[self.free_ids] = position
+        all_radius[self.free_ids] = radius
+        return int(entry["step"]), all_position, all_radius, max_overlap
+
+
+def write_vtp(filename, position, radius, fix, max_overlap):
+    import vtk
+    from vtk.util.numpy_support import numpy_to_vtk
+
+    def array(name, values):
+        a = numpy_to_vtk(np.ascontiguousarray(values), deep=True)
+        a.SetName(name)
+        return a
+
+    points = vtk.vtkPoints()
+    points.SetData(numpy_to_vtk(np.ascontiguousarray(position), deep=True))
+    poly = vtk.vtkPolyData()
+    poly.SetPoints(points)
+    poly.GetPointData().SetScalars(array("RADIUS", radius))
+    poly.GetPointData().AddArray(array("FIX", fix))
+    poly.GetPointData().AddArray(array("MAX_OVERLAP", max_overlap))
+    writer = vtk.vtkXMLPolyDataWriter()
+    writer.SetFileName(filename)
+    writer.SetInputData(poly)
+    writer.Write()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("series", help=".dpts time series")
+    parser.add_argument("--frame", type=int, help="frame to export (negative counts from the end)")
+    parser.add_argument("--vtp", help="output .vtp for --frame")
+    args = parser.parse_args()
+
+    series = Series(args.series)
+    if args.frame is None:
+        delta = "delta" if series.flags & SERIES_DELTA else "full"
+        print(f"{series.count} particles, {len(series)} frames ({delta}, keyframe every {series.keyframe_interval})")
+        for k, entry in enumerate(series.index):
+            print(f"{k:6d}  step {int(entry['step'])}")
+        return
+    step, position, radius, max_overlap = series.frame(args.frame)
+    if args.vtp:
+        write_vtp(args.vtp, position, radius, series.fix, max_overlap)
+        print(f"Wrote step {step} to {args.vtp}")
+
+
+if __name__ == "__main__":
+    main()
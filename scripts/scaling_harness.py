@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Strong/weak scaling harness for DensePacking.
+
+Runs `DensePackingBench --steps S` for every thread count x particle count in
+the matrix (one process per thread count, since Kokkos fixes the thread pool
+at initialization), reads the per-step module timers it writes in the same
+layout as `timers.csv`, and emits a machine-readable scaling report.
+
+Strong scaling compares every N of the matrix against the smallest thread
+count. Weak scaling runs a separate series with N = N_per_thread x threads for
+every `--weak-n` entry, so each thread count has the same work per thread.
+
+If a baseline report is given, every (threads, N) cell is compared against it
+and cells whose total time grew by more than `--threshold` are flagged; the
+script then exits with status 1.
+
+Usage example:
+    python scaling_harness.py --bench ./build/DensePackingBench \
+        --threads 1,2,4,8,16,32,64 --n 1e6,1e7,1e8 --weak-n 1e5,1e6 --steps 50 \
+        --report scaling.json --baseline scaling_baseline.json --threshold 0.10
+
+Use `--update-baseline` to store the new report as the baseline.
+"""
+import argparse
+import csv
+import json
+import os
+import shutil
+import subprocess
+import sys
+
+
+def parse_list(text, cast):
+    return [cast(float(v)) for v in text.split(',') if v.strip()]
+
+
+def read_timers_csv(path):
+    """Sum every module column of a timers CSV. Returns (modules, steps)."""
+    with open(path, newline='') as f:
+        rows = list(csv.reader(f, delimiter=';'))
+    header, data = rows[0], rows[1:]
+    # STEP;OVERLAP;RADIUS_SCALE_DELTA;RELAXATION_COEFFICIENT;<modules...>;Total
+    names = header[4:]
+    sums = {name: 0.0 for name in names}
+    for row in data:
+        for name, value in zip(names, row[4:]):
+            sums[name] += float(value)
+    return sums, len(data)
+
+
+def run_matrix(args, workdir):
+    """Runs the matrix and the weak series. Returns {(threads, N): cell}."""
+    cells = {}
+    for threads in args.threads:
+        sizes = sorted(set(args.n) | set(n * threads for n in args.weak_n))
+        env = dict(os.environ)
+        env['OMP_NUM_THREADS'] = str(threads)
+        env.setdefault('OMP_PROC_BIND', 'spread')
+        env.setdefault('OMP_PLACES', 'threads')
+        cmd = [os.path.abspath(args.bench), '--kokkos-num-threads=%d' % threads,
+               '--n', ','.join(str(n) for n in sizes), '--steps', str(args.steps),
+               '--density', str(args.density), '--poly', str(args.poly), '--seed', str(args.seed)]
+        print('Running:', ' '.join(cmd), flush=True)
+        with open(os.path.join(workdir, 'bench_T%d.log' % threads), 'w') as log:
+            subprocess.run(cmd, cwd=workdir, env=env, stdout=log, stderr=subprocess.STDOUT, check=True)
+        for n in sizes:
+            timers, steps = read_timers_csv(os.path.join(workdir, 'timers_T%d_N%d.csv' % (threads, n)))
+            total = timers.pop('Total')
+            cells[(threads, n)] = {
+                'threads': threads,
+                'N': n,
+                'steps': steps,
+                'total_time': total,
+                'time_per_step': total / max(steps, 1),
+                'particle_steps_per_s': n * steps / total if total > 0 else 0.0,
+                'modules': timers,
+            }
+    return cells
+
+
+def strong_series(cells, args):
+    """Matrix cells; strong scaling is relative to the smallest thread count."""
+    t_min = min(args.threads)
+    results = [dict(cells[(t, n)]) for t in args.threads for n in args.n]
+    for r in results:
+        ref = cells[(t_min, r['N'])]
+        if r['total_time'] > 0:
+            r['strong_speedup'] = ref['total_time'] / r['total_time']
+            r['strong_efficiency'] = r['strong_speedup'] * t_min / r['threads']
+    return results
+
+
+def weak_series(cells, args):
+    """N = N_per_thread x threads; ideal weak scaling keeps the time per step."""
+    t_min = min(args.threads)
+    results = []
+    for n_per_thread in args.weak_n:
+        ref = cells[(t_min, n_per_thread * t_min)]
+        for t in args.threads:
+            r = dict(cells[(t, n_per_thread * t)])
+            r['N_per_thread'] = n_per_thread
+            if r['time_per_step'] > 0:
+                r['weak_efficiency'] = ref['time_per_step'] / r['time_per_step']
+            results.append(r)
+    return results
+
+
+def compare(results, baseline, threshold):
+    base = {(r['threads'], r['N']): r for r in baseline['results'] + baseline.get('weak', [])}
+    regressions = []
+    flagged = set()
+    for r in results:
+        key = (r['threads'], r['N'])
+        b = base.get(key)
+        if not b or b['time_per_step'] <= 0:
+            continue
+        change = r['time_per_step'] / b['time_per_step'] - 1.0
+        r['baseline_change'] = change
+        # Cells in both series are flagged once.
+        if change > threshold and key not in flagged:
+            flagged.add(key)
+            regressions.append(r)
+    return regressions
+
+
+def print_table(results, title, key, efficiency):
+    fmt = '{:>8} {:>12} {:>14} {:>16} {:>10} {:>10}'
+    print(title)
+    print(fmt.format('THREADS', 'N', 'TIME/STEP', 'PART-STEPS/S', efficiency.upper(), 'VS_BASE'))
+    for r in sorted(results, key=lambda r: (r[key], r['threads'])):
+        opt = lambda k, f, scale=1.0: (f % (scale * r[k])) if k in r else '-'
+        print(fmt.format(r['threads'], r['N'], '%.4e' % r['time_per_step'], '%.4e' % r['particle_steps_per_s'],
+                         opt(efficiency + '_efficiency', '%.2f'), opt('baseline_change', '%+.1f%%', 100.0)))
+
+
+def parse_args(argv):
+    p = argparse.ArgumentParser(description='Run a thread x N scaling matrix with DensePackingBench')
+    p.add_argument('--bench', required=True, help='path to the DensePackingBench executable')
+    p.add_argument('--threads', default='1,2,4,8,16,32,64', help='comma-separated thread counts')
+    p.add_argument('--n', default='1e6,1e7,1e8', help='comma-separated particle counts')
+    p.add_argument('--weak-n', default='1e5', help='comma-separated particles per thread for the weak series (empty: none)')
+    p.add_argument('--steps', type=int, default=50, help='steps per run')
+    p.add_argument('--density', type=float, default=0.55)
+    p.add_argument('--poly', type=float, default=1.0)
+    p.add_argument('--seed', type=int, default=12345)
+    p.add_argument('--workdir', default='scaling_runs', help='directory for logs and timers CSVs')
+    p.add_argument('--report', default='scaling.json', help='output report (JSON)')
+    p.add_argument('--baseline', default=None, help='baseline report to compare against')
+    p.add_argument('--threshold', type=float, default=0.10, help='relative slowdown flagged as a regression')
+    p.add_argument('--update-baseline', action='store_true', help='copy the new report over --baseline')
+    args = p.parse_args(argv)
+    args.threads = parse_list(args.threads, int)
+    args.n = parse_list(args.n, int)
+    args.weak_n = parse_list(args.weak_n, int)
+    return args
+
+
+def main(argv):
+    args = parse_args(argv)
+    os.makedirs(args.workdir, exist_ok=True)
+    cells = run_matrix(args, args.workdir)
+    results = strong_series(cells, args)
+    weak = weak_series(cells, args)
+
+    regressions = []
+    if args.baseline and os.path.exists(args.baseline) and not args.update_baseline:
+        with open(args.baseline) as f:
+            regressions = compare(results + weak, json.load(f), args.threshold)
+
+    report = {
+        'steps': args.steps,
+        'density': args.density,
+        'poly': args.poly,
+        'seed': args.seed,
+        'threshold': args.threshold,
+        'results': results,
+        'weak': weak,
+        'regressions': [{'threads': r['threads'], 'N': r['N'], 'change': r['baseline_change']} for r in regressions],
+    }
+    with open(args.report, 'w') as f:
+        json.dump(report, f, indent=2)
+    print_table(results, 'Strong scaling', 'N', 'strong')
+    if weak:
+        print_table(weak, 'Weak scaling', 'N_per_thread', 'weak')
+    print('Saved', args.report)
+
+    if args.update_baseline and args.baseline:
+        shutil.copyfile(args.report, args.baseline)
+        print('Baseline updated:', args.baseline)
+
+    if regressions:
+        for r in regressions:
+            print('REGRESSION threads=%d N=%d time/step %+.1f%%' % (r['threads'], r['N'], 100 * r['baseline_change']),
+                  file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -1,4 +1,5 @@
 #include "AModule.h"
+#include "Counters.h"
 
 AModule::AModule(Data *data)
 {
@@ -9,8 +10,11 @@ void AModule::RunProcessing()
 {
   // std::cout<<"RunProcessing Start "<<this->getModuleName()<<"\n";
   moduleTimer.Start();
+  if (Counters::Enabled())
+    Counters::Begin(getModuleName());
   this->Processing();
   Kokkos::fence();
+  Counters::End();
   moduleTimer.Stop();
   // std::cout<<"RunProcessing Stop "<<this->getModuleName()<<"\n";
 }
@@ -8,6 +8,7 @@ class AModule
 {
 public:
   AModule(Data *data);
+  virtual ~AModule() = default;
   virtual void Initialization() = 0;
   void RunProcessing();
   virtual std::string getModuleName() = 0;
@@ -0,0 +1,372 @@
+#include "Analysis.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include <algorithm>
+#include <cmath>
+
+Analysis::Analysis(Data *data) : AModule(data) {}
+std::string Analysis::getModuleName() { return "Analysis"; };
+
+void Analysis::Initialization()
+{
+  auto config = data->yaml.config["analysis"];
+  if (!config["every"] || config["every"].as<int>() <= 0)
+  {
+    std::cerr << "Analysis::Initialization: analysis.every must be a positive step count.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  if (data->ENSEMBLE)
+  {
+    std::cerr << "Analysis::Initialization: the analysis cannot be combined with ensemble mode.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  every = config["every"].as<int>();
+  rdf_bins = config["rdf_bins"] ? config["rdf_bins"].as<int>() : 100;
+  rdf_max = config["rdf_max"] ? config["rdf_max"].as<double>() : 3.0;
+  contact_tolerance = config["contact_tolerance"] ? config["contact_tolerance"].as<double>() : 0.0;
+  profile_axis = config["profile_axis"] ? config["profile_axis"].as<int>() : 2;
+  profile_bins = config["profile_bins"] ? config["profile_bins"].as<int>() : 50;
+  if (rdf_bins < 1 || rdf_max <= 0 || profile_axis < 0 || profile_axis > 2 || profile_bins < 1)
+  {
+    std::cerr << "Analysis::Initialization: invalid rdf_bins, rdf_max, profile_axis or profile_bins.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  RDF_HIST = Kokkos::View<double *>("RDF_HIST", rdf_bins);
+  PROFILE = Kokkos::View<double *[3]>("PROFILE", profile_bins);
+}
+
+// The cylinder only bounds the packing when x and y have walls and it is
+// narrower than the wall box.
+double Analysis::CrossSection() const
+{
+  const Vec3 extent = data->WALL_MAX - data->WALL_MIN;
+  const double box = extent.x * extent.y;
+  const double R = data->cylinder_radius;
+  const bool cylinder = !data->PERIODIC.periodic[0] && !data->PERIODIC.periodic[1] && Constants::PI * R * R < box;
+  return cylinder ? Constants::PI * R * R : box;
+}
+
+double Analysis::ContainerVolume() const
+{
+  return CrossSection() * (data->WALL_MAX.z - data->WALL_MIN.z);
+}
+
+// Area of the container cut at `centre` across profile_axis; slices across
+// the cylinder axis use the chord at the slice centre.
+double Analysis::SliceArea(double centre) const
+{
+  const Vec3 extent = data->WALL_MAX - data->WALL_MIN;
+  if (profile_axis == 2)
+    return CrossSection();
+  if (CrossSection() < extent.x * extent.y)
+  {
+    const double R = data->cylinder_radius;
+    return 2.0 * std::sqrt(std::max(R * R - centre * centre, 0.0)) * extent.z;
+  }
+  return extent.x * extent.y * extent.z / extent[profile_axis];
+}
+
+void Analysis::Processing()
+{
+  if (data->cstep % every != 0)
+    return;
+  const index_t N = data->OWNED_COUNT;
+  const RadiusField RADIUS = data->Radii();
+  auto &FIX = data->FIX;
+
+  double totals[3] = {0, 0, 0}; // free particles, radius sum, solid volume
+  Kokkos::parallel_reduce("ANALYSIS_COUNT", N, KOKKOS_LAMBDA(const index_t i, double &sum) {
+    if (FIX(i) == 0)
+      sum += 1.0; }, totals[0]);
+  Kokkos::parallel_reduce("ANALYSIS_RADIUS", N, KOKKOS_LAMBDA(const index_t i, double &sum) {
+    if (FIX(i) == 0)
+      sum += RADIUS(i); }, totals[1]);
+  Kokkos::parallel_reduce("ANALYSIS_VOLUME", N, KOKKOS_LAMBDA(const index_t i, double &sum) {
+    if (FIX(i) == 0)
+      sum += 4.0 / 3.0 * Constants::PI * RADIUS(i) * RADIUS(i) * RADIUS(i); }, totals[2]);
+  double max_radius = 0;
+  Kokkos::parallel_reduce("ANALYSIS_MAX_RADIUS", N, KOKKOS_LAMBDA(const index_t i, double &value) {
+    if (RADIUS(i) > value)
+      value = RADIUS(i); }, Kokkos::Max<double>(max_radius));
+  Parallel::AllreduceSum(totals, 3);
+  max_radius = Parallel::AllreduceMax(max_radius);
+  if (totals[0] == 0)
+    return;
+
+  const double volume = ContainerVolume();
+  const double mean_radius = totals[1] / totals[0];
+  double cutoff = rdf_max * 2.0 * mean_radius;
+  // Minimum-image pairs are unique only up to half a periodic length, and
+  // other ranks' particles are only visible within the ghost layer.
+  for (int axis = 0; axis < 3; ++axis)
+    if (data->PERIODIC.periodic[axis])
+      cutoff = std::min(cutoff, 0.5 * data->PERIODIC.length[axis]);
+  if (Parallel::Size() > 1)
+    cutoff = std::min(cutoff, 2.0 * max_radius);
+
+  RadialDistribution(cutoff);
+  Coordination();
+  Profile();
+
+  if (!Parallel::IsRoot())
+    return;
+  OpenFiles();
+  const unsigned long step = data->cstep;
+  const double dr = cutoff / rdf_bins;
+  const double density = totals[0] / volume;
+  auto rdf_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), RDF_HIST);
+  auto coord_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), COORD_HIST);
+  auto profile_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), PROFILE);
+
+  summary << step << "," << (long)totals[0] << "," << totals[2] / volume << "," << coordination_sum / totals[0] << ","
+          << mean_radius << "," << data->simConstants.maxOverlap << "\n";
+  for (int k = 0; k < rdf_bins; ++k)
+  {
+    const double r0 = k * dr, r1 = (k + 1) * dr;
+    const double shell = 4.0 / 3.0 * Constants::PI * (r1 * r1 * r1 - r0 * r0 * r0);
+    const double g = rdf_references > 0 ? rdf_host(k) / (rdf_references * density * shell) : 0.0;
+    rdf << step << "," << 0.5 * (r0 + r1) << "," << g << "\n";
+  }
+  for (int z = 0; z < coordination_bins; ++z)
+    coordination << step << "," << z << "," << (long)coord_host(z) << "\n";
+  const double lo = data->WALL_MIN[profile_axis];
+  const double dz = (data->WALL_MAX[profile_axis] - lo) / profile_bins;
+  for (int b = 0; b < profile_bins; ++b)
+  {
+    const double count = profile_host(b, 0);
+    const double centre = lo + (b + 0.5) * dz;
+    const double area = SliceArea(centre);
+    profile << step << "," << centre << "," << (long)count << "," << (count > 0 ? profile_host(b, 1) / count : 0.0) << ","
+            << (area > 0 ? profile_host(b, 2) / (area * dz) : 0.0) << "\n";
+  }
+  summary.flush();
+  rdf.flush();
+  coordination.flush();
+  profile.flush();
+}
+
+// Counting sort of all local particles (owned and ghosts) into a uniform
+// grid over the wall box whose cells are at least `cell_size` wide.
+void Analysis::BuildGrid(double cell_size)
+{
+  const index_t N = data->PARTICLE_COUNT;
+  const Vec3 extent = data->WALL_MAX - data->WALL_MIN;
+  long cells = 1;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    cells = 1;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      GRID_CELLS[axis] = std::max(1, (int)std::floor(extent[axis] / cell_size));
+      cells *= GRID_CELLS[axis];
+    }
+    // Keep the grid no larger than a few cells per particle.
+    const long limit = 4L * N + 64;
+    if (cells <= limit)
+      break;
+    cell_size *= std::cbrt((double)cells / limit) * 1.01;
+  }
+  for (int axis = 0; axis < 3; ++axis)
+    GRID_INV[axis] = GRID_CELLS[axis] / extent[axis];
+
+  Kokkos::realloc(GRID_CELL, N);
+  Kokkos::realloc(GRID_START, cells + 1);
+  Kokkos::realloc(GRID_PARTICLES, N);
+  Memory::Record("Analysis", "GRID_CELL", GRID_CELL);
+  Memory::Record("Analysis", "GRID_START", GRID_START);
+  Memory::Record("Analysis", "GRID_PARTICLES", GRID_PARTICLES);
+  auto &POSITION = data->POSITION;
+  auto &GRID_CELL = this->GRID_CELL;
+  auto &GRID_START = this->GRID_START;
+  auto &GRID_PARTICLES = this->GRID_PARTICLES;
+  const Vec3 LO = data->WALL_MIN;
+  const Vec3 INV = GRID_INV;
+  const int NX = GRID_CELLS[0], NY = GRID_CELLS[1], NZ = GRID_CELLS[2];
+
+  Kokkos::deep_copy(GRID_START, 0);
+  Kokkos::parallel_for("ANALYSIS_GRID_CELL", N, KOKKOS_LAMBDA(const index_t i) {
+    const Vec3 p = POSITION(i);
+    const int cx = Kokkos::min(Kokkos::max((int)Kokkos::floor((p.x - LO.x) * INV.x), 0), NX - 1);
+    const int cy = Kokkos::min(Kokkos::max((int)Kokkos::floor((p.y - LO.y) * INV.y), 0), NY - 1);
+    const int cz = Kokkos::min(Kokkos::max((int)Kokkos::floor((p.z - LO.z) * INV.z), 0), NZ - 1);
+    const int c = (cz * NY + cy) * NX + cx;
+    GRID_CELL(i) = c;
+    Kokkos::atomic_add(&GRID_START(c), (index_t)1); });
+  Kokkos::parallel_scan("ANALYSIS_GRID_START", cells + 1, KOKKOS_LAMBDA(const int c, index_t &offset, const bool final) {
+    const index_t count = GRID_START(c);
+    if (final)
+      GRID_START(c) = offset;
+    offset += count; });
+  Kokkos::View<index_t *> CURSOR("ANALYSIS_GRID_CURSOR", cells);
+  Kokkos::deep_copy(CURSOR, Kokkos::subview(GRID_START, std::make_pair(0L, cells)));
+  Kokkos::parallel_for("ANALYSIS_GRID_FILL", N, KOKKOS_LAMBDA(const index_t i) {
+    GRID_PARTICLES(Kokkos::atomic_fetch_add(&CURSOR(GRID_CELL(i)), (index_t)1)) = i; });
+}
+
+// Pair distances from free reference particles at least `cutoff` away from
+// every wall to all free particles, histogrammed into RDF_HIST.
+void Analysis::RadialDistribution(double cutoff)
+{
+  BuildGrid(cutoff);
+  const index_t N = data->OWNED_COUNT;
+  const int BINS = rdf_bins;
+  const double CUTOFF = cutoff;
+  const PeriodicBox BOX = data->PERIODIC;
+  const Vec3 LO = data->WALL_MIN;
+  const Vec3 HI = data->WALL_MAX;
+  const double R_CYLINDER = data->cylinder_radius;
+  const bool CYLINDER = CrossSection() < (HI.x - LO.x) * (HI.y - LO.y);
+  const Vec3 INV = GRID_INV;
+  const int NX = GRID_CELLS[0], NY = GRID_CELLS[1], NZ = GRID_CELLS[2];
+  auto &POSITION = data->POSITION;
+  auto &FIX = data->FIX;
+  auto &GRID_START = this->GRID_START;
+  auto &GRID_PARTICLES = this->GRID_PARTICLES;
+  auto &RDF_HIST = this->RDF_HIST;
+
+  Kokkos::deep_copy(RDF_HIST, 0.0);
+  double references = 0;
+  Kokkos::parallel_reduce("ANALYSIS_RDF", N, KOKKOS_LAMBDA(const index_t i, double &count) {
+    if (FIX(i) != 0)
+      return;
+    const Vec3 p = POSITION(i);
+    for (int axis = 0; axis < 3; ++axis)
+      if (!BOX.periodic[axis] && (p[axis] - LO[axis] < CUTOFF || HI[axis] - p[axis] < CUTOFF))
+        return;
+    if (CYLINDER && R_CYLINDER - Kokkos::sqrt(p.x * p.x + p.y * p.y) < CUTOFF)
+      return;
+    count += 1.0;
+
+    const int n[3] = {NX, NY, NZ};
+    int c[3];
+    for (int axis = 0; axis < 3; ++axis)
+      c[axis] = Kokkos::min(Kokkos::max((int)Kokkos::floor((p[axis] - LO[axis]) * INV[axis]), 0), n[axis] - 1);
+    // Neighbouring cells, deduplicated when a periodic axis has fewer than three.
+    int cells[27];
+    int cell_count = 0;
+    for (int dz = -1; dz <= 1; ++dz)
+      for (int dy = -1; dy <= 1; ++dy)
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+          int q[3] = {c[0] + dx, c[1] + dy, c[2] + dz};
+          bool inside = true;
+          for (int axis = 0; axis < 3; ++axis)
+          {
+            if (BOX.periodic[axis])
+              q[axis] = (q[axis] % n[axis] + n[axis]) % n[axis];
+            else if (q[axis] < 0 || q[axis] >= n[axis])
+              inside = false;
+          }
+          if (!inside)
+            continue;
+          const int cell = (q[2] * NY + q[1]) * NX + q[0];
+          bool seen = false;
+          for (int h = 0; h < cell_count; ++h)
+            seen = seen || cells[h] == cell;
+          if (!seen)
+            cells[cell_count++] = cell;
+        }
+    for (int h = 0; h < cell_count; ++h)
+      for (index_t k = GRID_START(cells[h]); k < GRID_START(cells[h] + 1); ++k)
+      {
+        const index_t j = GRID_PARTICLES(k);
+        if (j == i || FIX(j) != 0)
+          continue;
+        const double d = BOX.MinimumImage(POSITION(j) - p).length();
+        if (d < CUTOFF)
+          Kokkos::atomic_add(&RDF_HIST(Kokkos::min((int)(d / CUTOFF * BINS), BINS - 1)), 1.0);
+      } }, references);
+
+  rdf_references = references;
+  Parallel::AllreduceSum(&rdf_references, 1);
+  auto host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), RDF_HIST);
+  Parallel::AllreduceSum(host.data(), rdf_bins);
+  Kokkos::deep_copy(RDF_HIST, host);
+}
+
+// Contacts within contact_tolerance of touching, counted from the
+// ContactSearch lists (which include walls' FIX particles and ghosts).
+void Analysis::Coordination()
+{
+  const index_t N = data->OWNED_COUNT;
+  const int NN_MAX = data->simConstants.NN_MAX;
+  coordination_bins = NN_MAX + 1;
+  Kokkos::realloc(COORD_HIST, coordination_bins);
+  const int BINS = coordination_bins;
+  const double TOLERANCE = contact_tolerance;
+  const PeriodicBox BOX = data->PERIODIC;
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+  auto &FIX = data->FIX;
+  auto &NN_COUNT = data->NN_COUNT;
+  const NeighbourList NEIGHBOURS = data->Neighbours();
+  auto &COORD_HIST = this->COORD_HIST;
+
+  coordination_sum = 0;
+  Kokkos::parallel_reduce("ANALYSIS_COORDINATION", N, KOKKOS_LAMBDA(const index_t i, double &sum) {
+    if (FIX(i) != 0)
+      return;
+    const Vec3 P1 = POSITION(i);
+    const double R1 = RADIUS(i);
+    int z = 0;
+    for (int k = 0; k < NN_COUNT(i); ++k)
+    {
+      const index_t j = NEIGHBOURS(i, k);
+      if (R1 + RADIUS(j) - BOX.MinimumImage(POSITION(j) - P1).length() > -TOLERANCE)
+        z++;
+    }
+    sum += z;
+    Kokkos::atomic_add(&COORD_HIST(Kokkos::min(z, BINS - 1)), 1.0); }, coordination_sum);
+
+  Parallel::AllreduceSum(&coordination_sum, 1);
+  auto host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), COORD_HIST);
+  Parallel::AllreduceSum(host.data(), coordination_bins);
+  Kokkos::deep_copy(COORD_HIST, host);
+}
+
+// Particle count, radius sum and solid volume of the free particles per
+// slice along profile_axis.
+void Analysis::Profile()
+{
+  const index_t N = data->OWNED_COUNT;
+  const int AXIS = profile_axis;
+  const int BINS = profile_bins;
+  const double LO = data->WALL_MIN[profile_axis];
+  const double INV = profile_bins / (data->WALL_MAX[profile_axis] - LO);
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+  auto &FIX = data->FIX;
+  auto &PROFILE = this->PROFILE;
+
+  Kokkos::deep_copy(PROFILE, 0.0);
+  Kokkos::parallel_for("ANALYSIS_PROFILE", N, KOKKOS_LAMBDA(const index_t i) {
+    if (FIX(i) != 0)
+      return;
+    const double r = RADIUS(i);
+    const int b = Kokkos::min(Kokkos::max((int)Kokkos::floor((POSITION(i)[AXIS] - LO) * INV), 0), BINS - 1);
+    Kokkos::atomic_add(&PROFILE(b, 0), 1.0);
+    Kokkos::atomic_add(&PROFILE(b, 1), r);
+    Kokkos::atomic_add(&PROFILE(b, 2), 4.0 / 3.0 * Constants::PI * r * r * r); });
+
+  auto host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), PROFILE);
+  Parallel::AllreduceSum(host.data(), 3 * profile_bins);
+  Kokkos::deep_copy(PROFILE, host);
+}
+
+void Analysis::OpenFiles()
+{
+  if (summary.is_open())
+    return;
+  // Opened on the first analysis step, after Writer has recreated data/.
+  summary.open("data/ANALYSIS_SUMMARY.csv");
+  rdf.open("data/ANALYSIS_RDF.csv");
+  coordination.open("data/ANALYSIS_COORDINATION.csv");
+  profile.open("data/ANALYSIS_PROFILE.csv");
+  summary << "step,particles,packing_fraction,mean_coordination,mean_radius,max_overlap\n";
+  rdf << "step,r,g\n";
+  coordination << "step,z,particles\n";
+  profile << "step,position,particles,mean_radius,solid_fraction\n";
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "AModule.h"
+#include <fstream>
+#include <vector>
+
+// In-situ statistics of the free (FIX == 0) particles every analysis.every
+// steps: packing fraction, radial distribution function, coordination
+// number histogram from the ContactSearch lists and a size-segregation
+// profile along one axis. Rank 0 appends them to data/ANALYSIS_*.csv.
+class Analysis : public AModule
+{
+public:
+  Analysis(Data *data);
+  virtual void Initialization();
+  virtual std::string getModuleName();
+
+protected:
+  virtual void Processing();
+
+private:
+  double ContainerVolume() const;
+  double CrossSection() const;
+  double SliceArea(double centre) const;
+  void BuildGrid(double cell_size);
+  void RadialDistribution(double cutoff);
+  void Coordination();
+  void Profile();
+  void OpenFiles();
+
+  int every = 0;
+  int rdf_bins = 100;
+  double rdf_max = 3.0; // in mean particle diameters
+  double contact_tolerance = 0.0;
+  int profile_axis = 2;
+  int profile_bins = 50;
+  int coordination_bins = 0;
+
+  // Uniform cell grid over the wall box for the RDF pair search.
+  int GRID_CELLS[3] = {1, 1, 1};
+  Vec3 GRID_INV;
+  Kokkos::View<int *> GRID_CELL;
+  Kokkos::View<index_t *> GRID_START;
+  Kokkos::View<index_t *> GRID_PARTICLES;
+
+  Kokkos::View<double *> RDF_HIST;
+  Kokkos::View<double *> COORD_HIST;
+  Kokkos::View<double *[3]> PROFILE; // count, radius sum, volume sum
+  double rdf_references = 0;
+  double coordination_sum = 0;
+
+  std::ofstream summary;
+  std::ofstream rdf;
+  std::ofstream coordination;
+  std::ofstream profile;
+};
@@ -0,0 +1,200 @@
+#include "CatalystAdaptor.h"
+#include "Parallel.h"
+#include "Memory.h"
+#ifdef DENSEPACKING_USE_CATALYST
+#include <catalyst.hpp>
+#endif
+
+CatalystAdaptor::CatalystAdaptor(Data *data) : AModule(data) {}
+
+CatalystAdaptor::~CatalystAdaptor()
+{
+#ifdef DENSEPACKING_USE_CATALYST
+  if (initialized)
+  {
+    conduit_cpp::Node node;
+    catalyst_finalize(conduit_cpp::c_node(&node));
+  }
+#endif
+}
+
+std::string CatalystAdaptor::getModuleName() { return "Catalyst"; };
+
+void CatalystAdaptor::Initialization()
+{
+#ifndef DENSEPACKING_USE_CATALYST
+  if (Parallel::IsRoot())
+    std::cerr << "CatalystAdaptor::Initialization: built without DENSEPACKING_ENABLE_CATALYST, the catalyst section is ignored.\n";
+#else
+  auto config = data->yaml.config["catalyst"];
+  if (!config["every"] || config["every"].as<int>() <= 0)
+  {
+    std::cerr << "CatalystAdaptor::Initialization: catalyst.every must be a positive step count.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  if (!config["scripts"] || !config["scripts"].IsSequence() || config["scripts"].size() == 0)
+  {
+    std::cerr << "CatalystAdaptor::Initialization: catalyst.scripts must list at least one pipeline script.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  every = config["every"].as<int>();
+  contact_tolerance = config["contact_tolerance"] ? config["contact_tolerance"].as<double>() : 0.0;
+  for (const auto &script : config["scripts"])
+    scripts.push_back(script.as<std::string>());
+
+  conduit_cpp::Node node;
+  for (size_t i = 0; i < scripts.size(); ++i)
+    node["catalyst/scripts/script" + std::to_string(i)].set_string(scripts[i]);
+  // Otherwise libcatalyst takes them from CATALYST_IMPLEMENTATION_NAME and
+  // CATALYST_IMPLEMENTATION_PATHS.
+  if (config["implementation"])
+  {
+    const std::string implementation = config["implementation"].as<std::string>();
+    node["catalyst_load/implementation"].set_string(implementation);
+    if (config["search_path"])
+      node["catalyst_load/search_paths/" + implementation].set_string(config["search_path"].as<std::string>());
+  }
+  const catalyst_status status = catalyst_initialize(conduit_cpp::c_node(&node));
+  if (status != catalyst_status_ok)
+  {
+    std::cerr << "CatalystAdaptor::Initialization: catalyst_initialize failed with status " << (int)status << ".\n";
+    data->COMPUTE = false;
+    return;
+  }
+  initialized = true;
+#endif
+}
+
+void CatalystAdaptor::Processing()
+{
+  if (!initialized || data->cstep % every != 0)
+    return;
+  const index_t N = data->OWNED_COUNT;
+  // Owned particles keep their slots until the next reallocation.
+  if ((index_t)COORDINATION.extent(0) < N)
+  {
+    COORDINATION = Kokkos::View<int *>();
+    COORDINATION = Kokkos::View<int *>("CATALYST_COORDINATION", data->POSITION.extent(0));
+    Memory::Record("Catalyst", "COORDINATION", COORDINATION);
+    CONNECTIVITY = Kokkos::View<index_t *>();
+    CONNECTIVITY = Kokkos::View<index_t *>("CATALYST_CONNECTIVITY", data->POSITION.extent(0));
+    Memory::Record("Catalyst", "CONNECTIVITY", CONNECTIVITY);
+    auto &IDS = this->CONNECTIVITY;
+    Kokkos::parallel_for("CATALYST_CONNECTIVITY", IDS.extent(0), KOKKOS_LAMBDA(const index_t idx) { IDS(idx) = idx; });
+  }
+#ifdef DENSEPACKING_LAZY_RADIUS
+  if ((index_t)SCALED_RADIUS.extent(0) < N)
+  {
+    SCALED_RADIUS = Kokkos::View<double *>();
+    SCALED_RADIUS = Kokkos::View<double *>("CATALYST_RADIUS", data->POSITION.extent(0));
+    Memory::Record("Catalyst", "RADIUS", SCALED_RADIUS);
+  }
+  const RadiusField RADII = data->Radii();
+  auto &SCALED = this->SCALED_RADIUS;
+  Kokkos::parallel_for("CATALYST_RADIUS", N, KOKKOS_LAMBDA(const index_t idx) { SCALED(idx) = RADII(idx); });
+#endif
+  Coordination();
+  Execute();
+}
+
+// Contacts of every free particle from the ContactSearch lists, the same
+// count as Analysis' coordination histogram; FIX particles get 0.
+void CatalystAdaptor::Coordination()
+{
+  const index_t N = data->OWNED_COUNT;
+  const double TOLERANCE = contact_tolerance;
+  const PeriodicBox BOX = data->PERIODIC;
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+  auto &FIX = data->FIX;
+  auto &NN_COUNT = data->NN_COUNT;
+  const NeighbourList NEIGHBOURS = data->Neighbours();
+  auto &Z = this->COORDINATION;
+
+  Kokkos::parallel_for("CATALYST_COORDINATION", N, KOKKOS_LAMBDA(const index_t i) {
+    int z = 0;
+    if (FIX(i) == 0)
+    {
+      const Vec3 P1 = POSITION(i);
+      const double R1 = RADIUS(i);
+      for (int k = 0; k < NN_COUNT(i); ++k)
+      {
+        const index_t j = NEIGHBOURS(i, k);
+        if (R1 + RADIUS(j) - BOX.MinimumImage(POSITION(j) - P1).length() > -TOLERANCE)
+          z++;
+      }
+    }
+    Z(i) = z; });
+}
+
+void CatalystAdaptor::Execute()
+{
+#ifdef DENSEPACKING_USE_CATALYST
+  const index_t N = data->OWNED_COUNT;
+  // Host backends: the mirrors are the Views themselves.
+  auto POSITION = Kokkos::create_mirror_view(data->POSITION);
+#ifdef DENSEPACKING_LAZY_RADIUS
+  auto RADIUS = Kokkos::create_mirror_view(SCALED_RADIUS);
+  Kokkos::deep_copy(RADIUS, SCALED_RADIUS);
+#else
+  auto RADIUS = Kokkos::create_mirror_view(data->RADIUS);
+  Kokkos::deep_copy(RADIUS, data->RADIUS);
+#endif
+  auto MAX_OVERLAP = Kokkos::create_mirror_view(data->MAX_OVERLAP);
+  auto FIX = Kokkos::create_mirror_view(data->FIX);
+  auto Z = Kokkos::create_mirror_view(COORDINATION);
+  auto IDS = Kokkos::create_mirror_view(CONNECTIVITY);
+  Kokkos::deep_copy(POSITION, data->POSITION);
+  Kokkos::deep_copy(MAX_OVERLAP, data->MAX_OVERLAP);
+  Kokkos::deep_copy(FIX, data->FIX);
+  Kokkos::deep_copy(Z, COORDINATION);
+  Kokkos::deep_copy(IDS, CONNECTIVITY);
+
+  conduit_cpp::Node exec;
+  exec["catalyst/state/timestep"].set((conduit_int64)data->cstep);
+  exec["catalyst/state/time"].set((double)data->cstep);
+  auto channel = exec["catalyst/channels/grid"];
+  channel["type"].set_string("mesh");
+  auto mesh = channel["data"];
+
+  // Vec3 is three packed doubles: strided views into POSITION.
+  double *xyz = &POSITION.data()->x;
+  mesh["coordsets/coords/type"].set_string("explicit");
+  mesh["coordsets/coords/values/x"].set_external(xyz, N, 0, sizeof(Vec3));
+  mesh["coordsets/coords/values/y"].set_external(xyz, N, sizeof(double), sizeof(Vec3));
+  mesh["coordsets/coords/values/z"].set_external(xyz, N, 2 * sizeof(double), sizeof(Vec3));
+  mesh["topologies/mesh/type"].set_string("unstructured");
+  mesh["topologies/mesh/coordset"].set_string("coords");
+  mesh["topologies/mesh/elements/shape"].set_string("point");
+  mesh["topologies/mesh/elements/connectivity"].set_external(IDS.data(), N);
+
+  auto fields = mesh["fields"];
+  const auto vertex_field = [&](const std::string &name) {
+    auto field = fields[name];
+    field["association"].set_string("vertex");
+    field["topology"].set_string("mesh");
+    field["volume_dependent"].set_string("false");
+    return field["values"];
+  };
+  vertex_field("RADIUS").set_external(RADIUS.data(), N);
+  vertex_field("MAX_OVERLAP").set_external(MAX_OVERLAP.data(), N);
+  vertex_field("FIX").set_external(FIX.data(), N);
+  vertex_field("COORDINATION").set_external(Z.data(), N);
+  Kokkos::View<int *>::HostMirror SYSTEM_ID;
+  if (data->ENSEMBLE)
+  {
+    SYSTEM_ID = Kokkos::create_mirror_view(data->SYSTEM_ID);
+    Kokkos::deep_copy(SYSTEM_ID, data->SYSTEM_ID);
+    vertex_field("SYSTEM_ID").set_external(SYSTEM_ID.data(), N);
+  }
+
+  const catalyst_status status = catalyst_execute(conduit_cpp::c_node(&exec));
+  if (status != catalyst_status_ok)
+  {
+    std::cerr << "CatalystAdaptor::Execute: catalyst_execute failed with status " << (int)status << ".\n";
+    data->COMPUTE = false;
+  }
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "AModule.h"
+#include <string>
+#include <vector>
+
+// In-situ visualization through ParaView Catalyst 2 (config.yaml
+// "catalyst"). Every catalyst.every steps the owned particles are handed to
+// the Catalyst pipeline scripts as a Conduit Mesh Blueprint point mesh on the
+// channel "grid": coordinates from POSITION and the vertex fields RADIUS,
+// MAX_OVERLAP, FIX, COORDINATION (contacts per free particle, as in Analysis)
+// and, in ensemble mode, SYSTEM_ID. On host backends the arrays are passed
+// by pointer without a copy; on devices they go through host mirrors.
+// Without DENSEPACKING_ENABLE_CATALYST the section is ignored.
+class CatalystAdaptor : public AModule
+{
+public:
+  CatalystAdaptor(Data *data);
+  ~CatalystAdaptor();
+  virtual void Initialization();
+  virtual std::string getModuleName();
+
+protected:
+  virtual void Processing();
+
+private:
+  void Coordination();
+  void Execute();
+
+  int every = 0;
+  double contact_tolerance = 0.0;
+  bool initialized = false;
+  std::vector<std::string> scripts;
+  Kokkos::View<int *> COORDINATION;
+  Kokkos::View<index_t *> CONNECTIVITY;
+#ifdef DENSEPACKING_LAZY_RADIUS
+  Kokkos::View<double *> SCALED_RADIUS;
+#endif
+};
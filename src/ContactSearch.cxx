@@ -1,7 +1,12 @@
 #include "ContactSearch.h"
+#include "Tuning.h"
 #include <Kokkos_Sort.hpp>
+#include "Parallel.h"
+#include "Memory.h"
 
-KOKKOS_INLINE_FUNCTION int GetHash(const int x, const int y, const int z, const int HASH_TABLE_SIZE)
+// `system` keeps the cells of ensemble systems apart; system 0 hashes as
+// the plain cell.
+KOKKOS_INLINE_FUNCTION index_t GetHash(const int x, const int y, const int z, const index_t HASH_TABLE_SIZE, const int system = 0)
 {
   // Simple 3D integer hash that handles negative coordinates robustly.
   // Use 64-bit unsigned mixing with large primes to avoid bit-twiddling
@@ -13,8 +18,24 @@ KOKKOS_INLINE_FUNCTION int GetHash(const int x, const int y, const int z, const
   unsigned long code = ux * 73856093u;
   code ^= uy * 19349663u;
   code ^= uz * 83492791u;
+  code ^= (unsigned long)(uint32_t)system * 50331653u;
 
-  return (int)(code % (unsigned long)HASH_TABLE_SIZE);
+  return (index_t)(code % (unsigned long)HASH_TABLE_SIZE);
+}
+
+// Wraps a cell coordinate on a periodic axis split into `cells` cells;
+// cells == 0 marks a non-periodic axis.
+KOKKOS_INLINE_FUNCTION int WrapCell(int c, const int cells)
+{
+  if (cells == 0)
+    return c;
+  c %= cells;
+  return c < 0 ? c + cells : c;
+}
+
+KOKKOS_INLINE_FUNCTION int GetCell(const double x, const double origin, const double inv_cell_size, const int cells)
+{
+  return WrapCell((int)floor((x - origin) * inv_cell_size), cells);
 }
 
 ContactSearch::ContactSearch(Data *data) : AModule(data) {}
@@ -23,30 +44,48 @@ std::string ContactSearch::getModuleName() { return "ContactSearch"; };
 
 void ContactSearch::Initialization()
 {
-  // Find min and max RADIUS
-  double min_radius = std::numeric_limits<double>::max();
+  // Find max RADIUS
   double max_radius = std::numeric_limits<double>::lowest();
-  int N = data->PARTICLE_COUNT;
-  auto RADIUS = Kokkos::create_mirror_view(data->RADIUS);
-  Kokkos::deep_copy(RADIUS, data->RADIUS);
-
-  for (int i = 0; i < N; ++i)
-  {
-    double r = RADIUS(i);
-    if (r < min_radius)
-      min_radius = r;
-    if (r > max_radius)
-      max_radius = r;
-  }
+  index_t N = data->PARTICLE_COUNT;
+  const RadiusField RADIUS = data->Radii();
+  Kokkos::parallel_reduce("CONTACT_MAX_RADIUS", N, KOKKOS_LAMBDA(const index_t i, double &local) {
+    if (RADIUS(i) > local)
+      local = RADIUS(i); }, Kokkos::Max<double>(max_radius));
+  // All ranks must hash on the same grid.
+  max_radius = Parallel::AllreduceMax(max_radius);
 
   CELL_SIZE1 = 2.0 * max_radius * SKIN1;
   INV_CELL_SIZE1 = 1.0 / CELL_SIZE1;
+
+  // Periodic axes get a whole number of cells (at least CELL_SIZE1 wide)
+  // measured from the box origin, so that cell indices wrap exactly.
+  const auto &PERIODIC = data->PERIODIC;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    CELL_ORIGIN1[axis] = 0.0;
+    CELL_INV1[axis] = INV_CELL_SIZE1;
+    CELL_WRAP1[axis] = 0;
+    if (!PERIODIC.periodic[axis])
+      continue;
+    const int cells = (int)floor(PERIODIC.length[axis] * INV_CELL_SIZE1);
+    if (cells < 3)
+    {
+      std::cerr << "ContactSearch::Initialization: periodic box length " << PERIODIC.length[axis] << " along axis " << axis
+                << " must be at least three cells (" << 3.0 * CELL_SIZE1 << ").\n";
+      data->COMPUTE = false;
+      return;
+    }
+    CELL_ORIGIN1[axis] = PERIODIC.origin[axis];
+    CELL_INV1[axis] = cells / PERIODIC.length[axis];
+    CELL_WRAP1[axis] = cells;
+  }
   HASH_TABLE1 = data->PARTICLE_COUNT * 2;
 
-  this->CELL_ID1 = Kokkos::View<int *>("CELL_ID", data->PARTICLE_COUNT);
-  this->PARTICLE_ID1 = Kokkos::View<int *>("CELL_ID", data->PARTICLE_COUNT);
-  this->STARTAS1 = Kokkos::View<int *>("CELL_ID", HASH_TABLE1);
-  this->ENDAS1 = Kokkos::View<int *>("CELL_ID", HASH_TABLE1);
+  this->CELL_ID1 = Kokkos::View<index_t *>("CELL_ID", data->PARTICLE_COUNT);
+  this->PARTICLE_ID1 = Kokkos::View<index_t *>("PARTICLE_ID", data->PARTICLE_COUNT);
+  this->STARTAS1 = Kokkos::View<index_t *>("STARTAS", HASH_TABLE1);
+  this->ENDAS1 = Kokkos::View<index_t *>("ENDAS", HASH_TABLE1);
+  RecordMemory();
 
   Kokkos::deep_copy(this->CELL_ID1, 0);
   Kokkos::deep_copy(this->PARTICLE_ID1, 0);
@@ -54,6 +93,14 @@ void ContactSearch::Initialization()
   Kokkos::deep_copy(this->ENDAS1, -1);
 }
 
+void ContactSearch::RecordMemory() const
+{
+  Memory::Record("ContactSearch", "CELL_ID", this->CELL_ID1);
+  Memory::Record("ContactSearch", "PARTICLE_ID", this->PARTICLE_ID1);
+  Memory::Record("ContactSearch", "STARTAS", this->STARTAS1);
+  Memory::Record("ContactSearch", "ENDAS", this->ENDAS1);
+}
+
 void ContactSearch::Processing()
 {
   RunKernels();
@@ -62,41 +109,70 @@ void ContactSearch::RunKernels()
 {
   if (!data->CONTACT_SEARCH)
     return;
-  Kokkos::DefaultExecutionSpace space;
+  ResetTables();
+  CalculateHash();
+  SortByCell();
+  FindCellBounds();
+  FindNeighbours();
+}
+
+void ContactSearch::ResetTables()
+{
+  // Ghost particles can push PARTICLE_COUNT past the initial allocation.
+  if ((index_t)this->CELL_ID1.extent(0) < data->PARTICLE_COUNT)
+  {
+    Kokkos::realloc(this->CELL_ID1, data->POSITION.extent(0));
+    Kokkos::realloc(this->PARTICLE_ID1, data->POSITION.extent(0));
+    RecordMemory();
+  }
   Kokkos::deep_copy(data->NN_COUNT, 0);
   Kokkos::deep_copy(this->STARTAS1, 0);
   Kokkos::deep_copy(this->ENDAS1, -1);
+}
+
+void ContactSearch::CalculateHash()
+{
   auto &POSITION = data->POSITION;
-  auto &RADIUS = data->RADIUS;
-  auto &NN_COUNT = data->NN_COUNT;
-  auto &NN_IDS = data->NN_IDS;
-  int N = data->PARTICLE_COUNT;
-  int NN_MAX = data->simConstants.NN_MAX;
-  auto WALL_MAX = data->WALL_MAX;
-  auto WALL_MIN = data->WALL_MIN;
-  auto INV_CELL_SIZE = this->INV_CELL_SIZE1;
+  index_t N = data->PARTICLE_COUNT;
+  const Vec3 ORIGIN = this->CELL_ORIGIN1;
+  const Vec3 INV_CELL_SIZE = this->CELL_INV1;
+  const int WX = this->CELL_WRAP1[0], WY = this->CELL_WRAP1[1], WZ = this->CELL_WRAP1[2];
   auto HASH_TABLE = this->HASH_TABLE1;
-  auto SKIN = this->SKIN1;
-  auto &STARTAS = this->STARTAS1;
-  auto &ENDAS = this->ENDAS1;
   auto &PARTICLE_ID = this->PARTICLE_ID1;
   auto &CELL_ID = this->CELL_ID1;
+  const bool ENSEMBLE = data->ENSEMBLE;
+  auto &SYSTEM_ID = data->SYSTEM_ID;
 
-  Kokkos::parallel_for("CALCULATE_HASH", N, KOKKOS_LAMBDA(const int idx) {
-         Vec3 pos = POSITION(idx);
-         pos.x=floor(pos.x*INV_CELL_SIZE);
-         pos.y=floor(pos.y*INV_CELL_SIZE);
-         pos.z=floor(pos.z*INV_CELL_SIZE);
-        CELL_ID(idx) = GetHash((int)pos.x, (int)pos.y, (int)pos.z,HASH_TABLE);
+  Tuning::For("CALCULATE_HASH", 0, N, KOKKOS_LAMBDA(const index_t idx) {
+        Vec3 pos = POSITION(idx);
+        int CX = GetCell(pos.x, ORIGIN.x, INV_CELL_SIZE.x, WX);
+        int CY = GetCell(pos.y, ORIGIN.y, INV_CELL_SIZE.y, WY);
+        int CZ = GetCell(pos.z, ORIGIN.z, INV_CELL_SIZE.z, WZ);
+        CELL_ID(idx) = GetHash(CX, CY, CZ, HASH_TABLE, ENSEMBLE ? SYSTEM_ID(idx) : 0);
         PARTICLE_ID(idx) = idx; });
+}
 
+void ContactSearch::SortByCell()
+{
+  Kokkos::DefaultExecutionSpace space;
+  const auto range = std::make_pair((index_t)0, data->PARTICLE_COUNT);
+  auto CELL_ID = Kokkos::subview(this->CELL_ID1, range);
+  auto PARTICLE_ID = Kokkos::subview(this->PARTICLE_ID1, range);
   Kokkos::Experimental::sort_by_key(space, CELL_ID, PARTICLE_ID);
+}
 
-  Kokkos::parallel_for("START_END", N, KOKKOS_LAMBDA(const int idx) {
+void ContactSearch::FindCellBounds()
+{
+  index_t N = data->PARTICLE_COUNT;
+  auto &STARTAS = this->STARTAS1;
+  auto &ENDAS = this->ENDAS1;
+  auto &CELL_ID = this->CELL_ID1;
+
+  Tuning::For("START_END", 0, N, KOKKOS_LAMBDA(const index_t idx) {
         if(idx!=0)
         {
-      int bb = CELL_ID(idx - 1);
-      int cc = CELL_ID(idx);
+      index_t bb = CELL_ID(idx - 1);
+      index_t cc = CELL_ID(idx);
       if (bb != cc) {
         ENDAS(bb) = idx;
         STARTAS(cc) = idx;
@@ -105,21 +181,63 @@ void ContactSearch::RunKernels()
         ENDAS(cc) = idx + 1;
       }
         } });
+}
+
+void ContactSearch::FindNeighbours(index_t first)
+{
+  // Particles below first keep their FAR rows, so rows are handed out from
+  // the current count. Compressed lists that ran out of FAR rows are
+  // searched again from the same count.
+  int far_used = 0;
+  if (first > 0 && data->NN_FAR_USED.data())
+    Kokkos::deep_copy(far_used, data->NN_FAR_USED);
+  do
+  {
+    if (data->NN_FAR_USED.data())
+      Kokkos::deep_copy(data->NN_FAR_USED, far_used);
+    SearchNeighbours(first);
+  } while (data->growNeighbourRows());
+}
 
-  Kokkos::parallel_for("FIND_NEIGHBOURS", N, KOKKOS_LAMBDA(const int idx) {
+void ContactSearch::SearchNeighbours(index_t first)
+{
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+  auto &NN_COUNT = data->NN_COUNT;
+  // Neighbour lists are only needed for owned particles, not ghosts.
+  index_t N = data->OWNED_COUNT;
+  int NN_MAX = data->simConstants.NN_MAX;
+  const Vec3 ORIGIN = this->CELL_ORIGIN1;
+  const Vec3 INV_CELL_SIZE = this->CELL_INV1;
+  const int WX = this->CELL_WRAP1[0], WY = this->CELL_WRAP1[1], WZ = this->CELL_WRAP1[2];
+  const PeriodicBox BOX = data->PERIODIC;
+  auto HASH_TABLE = this->HASH_TABLE1;
+  auto SKIN = this->SKIN1;
+  auto &STARTAS = this->STARTAS1;
+  auto &ENDAS = this->ENDAS1;
+  auto &PARTICLE_ID = this->PARTICLE_ID1;
+  // Ensemble systems hash into separate cells; only hash collisions can
+  // still bring in another system's particles.
+  const bool ENSEMBLE = data->ENSEMBLE;
+  auto &SYSTEM_ID = data->SYSTEM_ID;
+
+  const NeighbourList NEIGHBOURS = data->Neighbours();
+
+  Tuning::For("FIND_NEIGHBOURS", first, N, KOKKOS_LAMBDA(const index_t idx) {
     Vec3 POINT = POSITION(idx);
     double radius = RADIUS(idx);
-    int CX = (int)floor(POINT.x * INV_CELL_SIZE);
-    int CY = (int)floor(POINT.y * INV_CELL_SIZE);
-    int CZ = (int)floor(POINT.z * INV_CELL_SIZE);
+    const int system = ENSEMBLE ? SYSTEM_ID(idx) : 0;
+    int CX = GetCell(POINT.x, ORIGIN.x, INV_CELL_SIZE.x, WX);
+    int CY = GetCell(POINT.y, ORIGIN.y, INV_CELL_SIZE.y, WY);
+    int CZ = GetCell(POINT.z, ORIGIN.z, INV_CELL_SIZE.z, WZ);
 
-    int cell_IDS[27];
+    index_t cell_IDS[27];
     int c_id = 0;
     for (int i = CX - 1; i <= CX + 1; i++)
       for (int j = CY - 1; j <= CY + 1; j++)
         for (int k = CZ - 1; k <= CZ + 1; k++)
         {
-          int hash = GetHash(i, j, k, HASH_TABLE);
+          index_t hash = GetHash(WrapCell(i, WX), WrapCell(j, WY), WrapCell(k, WZ), HASH_TABLE, system);
           int yra = 0;
           for (int h = 0; h < c_id; h++)
           {
@@ -133,33 +251,40 @@ void ContactSearch::RunKernels()
           }
         }
     int count = 0;
+    int row = -1;
     for (int i = 0; i < c_id; i++)
     {
-      int hash = cell_IDS[i];
-      int startas = STARTAS(hash);
-      int endas = ENDAS(hash);
-      for (int h = startas; h < endas; h++)
+      index_t hash = cell_IDS[i];
+      index_t startas = STARTAS(hash);
+      index_t endas = ENDAS(hash);
+      for (index_t h = startas; h < endas; h++)
       {
-        int pid = PARTICLE_ID(h);
+        index_t pid = PARTICLE_ID(h);
         if(pid==idx)continue;
+        if (ENSEMBLE && SYSTEM_ID(pid) != system)
+          continue;
         // if (pid <= idx)
         //   continue;
 
         Vec3 P2 = POSITION(pid);
         double R2 = RADIUS(pid);
 
-        Vec3 diff = P2 - POINT;
+        Vec3 diff = BOX.MinimumImage(P2 - POINT);
         double ilgis = radius * SKIN + R2 - diff.length();
         if (ilgis > -1.0E-8)
         {
 
-          NN_IDS(idx * NN_MAX + count) = pid;
-          count++;
           if (count >= NN_MAX)
+          {
             printf("INCREASE NN_MAX VALUE !!! NN_MAX %d COUNT %d\n", NN_MAX,
                    count);
+            break;
+          }
+          NEIGHBOURS.Store(idx, count, pid, row);
+          count++;
         }
       }
     }
+    NEIGHBOURS.Finish(idx, row);
     NN_COUNT(idx) = count; });
 }
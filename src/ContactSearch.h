@@ -9,17 +9,34 @@ public:
   virtual std::string getModuleName();
   void RunKernels();
 
+  // Individual stages of RunKernels, exposed so they can be timed in isolation.
+  void ResetTables();
+  void CalculateHash();
+  void SortByCell();
+  void FindCellBounds();
+  // Builds the lists of particles [first, OWNED_COUNT).
+  void FindNeighbours(index_t first = 0);
+
 protected:
   virtual void Processing();
 
 private:
-  Kokkos::View<int *> CELL_ID1;
-  Kokkos::View<int *> PARTICLE_ID1;
-  Kokkos::View<int *> STARTAS1;
-  Kokkos::View<int *> ENDAS1;
+  void RecordMemory() const;
+  // One pass of FindNeighbours.
+  void SearchNeighbours(index_t first);
+
+  Kokkos::View<index_t *> CELL_ID1;
+  Kokkos::View<index_t *> PARTICLE_ID1;
+  Kokkos::View<index_t *> STARTAS1;
+  Kokkos::View<index_t *> ENDAS1;
 
   double CELL_SIZE1;
   double INV_CELL_SIZE1;
-  int HASH_TABLE1;
+  index_t HASH_TABLE1;
+  // Per-axis cell grid: periodic axes start at the box origin and wrap
+  // after CELL_WRAP1 cells; non-periodic axes have CELL_WRAP1 == 0.
+  Vec3 CELL_ORIGIN1;
+  Vec3 CELL_INV1;
+  int CELL_WRAP1[3] = {0, 0, 0};
   double SKIN1 = 1.1;
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,374 @@
+#include "Counters.h"
+#include "Data.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  enum Event
+  {
+    CYCLES = 0,
+    INSTRUCTIONS = 1,
+    LLC_MISSES = 2,
+    EVENTS = 3
+  };
+  const char *EVENT_NAMES[EVENTS] = {"CYCLES", "INSTRUCTIONS", "LLC_MISSES"};
+  const double LINE_BYTES = 64.0;
+
+  struct Counts
+  {
+    double values[EVENTS] = {0.0, 0.0, 0.0};
+    double bytes = 0.0;
+    double seconds = 0.0;
+    long calls = 0;
+
+    void Add(const Counts &other)
+    {
+      for (int e = 0; e < EVENTS; ++e)
+        values[e] += other.values[e];
+      bytes += other.bytes;
+      seconds += other.seconds;
+      calls += other.calls;
+    }
+  };
+
+  struct Frame
+  {
+    std::string region;
+    Counts start;
+  };
+
+  bool enabled = false;
+  bool kernels = false;
+  bool imc = false;
+  std::vector<int> leaders; // one event group per host thread
+  std::vector<int> fds;     // every open descriptor, leaders included
+  std::vector<int> imc_fds;
+  std::vector<Frame> stack;
+  std::map<std::string, Counts> interval, total;
+  std::string file;
+  unsigned long last_step = 0;
+  const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+  int Open(perf_event_attr &attr, pid_t pid, int cpu, int group)
+  {
+    const int fd = syscall(SYS_perf_event_open, &attr, pid, cpu, group, 0);
+    if (fd >= 0)
+      fds.push_back(fd);
+    return fd;
+  }
+
+  // Cycles, instructions and LLC misses of thread `tid` as one group, so the
+  // three are always scheduled (and multiplexed) together.
+  bool OpenThread(pid_t tid)
+  {
+    const uint64_t CONFIGS[EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+    int leader = -1;
+    for (int e = 0; e < EVENTS; ++e)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = CONFIGS[e];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      const int fd = Open(attr, tid, -1, leader);
+      if (fd < 0)
+        return false;
+      if (e == 0)
+        leader = fd;
+    }
+    leaders.push_back(leader);
+    return true;
+  }
+
+  std::vector<std::string> List(const std::string &directory)
+  {
+    std::vector<std::string> names;
+    if (DIR *dir = opendir(directory.c_str()))
+    {
+      while (dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.')
+          names.push_back(entry->d_name);
+      closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+  }
+
+  std::string ReadLine(const std::string &filename)
+  {
+    std::string line;
+    std::ifstream in(filename);
+    std::getline(in, line);
+    return line;
+  }
+
+  // "event=0x04,umask=0x03" -> perf config of an Intel uncore event.
+  uint64_t UncoreConfig(const std::string &spec)
+  {
+    uint64_t config = 0;
+    std::stringstream terms(spec);
+    std::string term;
+    while (std::getline(terms, term, ','))
+    {
+      const size_t eq = term.find('=');
+      if (eq == std::string::npos)
+        continue;
+      const uint64_t value = std::stoull(term.substr(eq + 1), nullptr, 0);
+      if (term.compare(0, eq, "event") == 0)
+        config |= value;
+      else if (term.compare(0, eq, "umask") == 0)
+        config |= value << 8;
+    }
+    return config;
+  }
+
+  // CAS read and write counts of every memory controller, each opened on
+  // the CPUs its cpumask names (one per socket). Needs perf_event_paranoid
+  // <= 0 or CAP_PERFMON; all or nothing.
+  bool OpenMemoryControllers()
+  {
+    const std::string root = "/sys/bus/event_source/devices/";
+    std::vector<int> opened;
+    for (const std::string &device : List(root))
+    {
+      if (device.compare(0, 10, "uncore_imc") != 0)
+        continue;
+      const std::string type = ReadLine(root + device + "/type");
+      std::stringstream cpumask(ReadLine(root + device + "/cpumask"));
+      std::vector<int> cpus;
+      std::string cpu;
+      while (std::getline(cpumask, cpu, ','))
+        if (!cpu.empty())
+          cpus.push_back(std::stoi(cpu));
+      for (const char *event : {"cas_count_read", "cas_count_write"})
+      {
+        const std::string spec = ReadLine(root + device + "/events/" + event);
+        if (type.empty() || spec.empty())
+          return false;
+        for (int c : cpus)
+        {
+          perf_event_attr attr;
+          std::memset(&attr, 0, sizeof(attr));
+          attr.size = sizeof(attr);
+          attr.type = std::stoul(type);
+          attr.config = UncoreConfig(spec);
+          const int fd = Open(attr, -1, c, -1);
+          if (fd < 0)
+            return false;
+          opened.push_back(fd);
+        }
+      }
+    }
+    imc_fds = opened;
+    return !imc_fds.empty();
+  }
+#endif
+
+  void Close()
+  {
+#ifdef __linux__
+    for (int fd : fds)
+      close(fd);
+#endif
+    fds.clear();
+    leaders.clear();
+    imc_fds.clear();
+  }
+
+  // Running totals of all threads, scaled up where the kernel had to
+  // multiplex the groups.
+  Counts Snapshot()
+  {
+    Counts counts;
+#ifdef __linux__
+    for (int leader : leaders)
+    {
+      uint64_t buffer[3 + EVENTS];
+      if (read(leader, buffer, sizeof(buffer)) != (ssize_t)sizeof(buffer) || buffer[2] == 0)
+        continue;
+      const double scale = (double)buffer[1] / (double)buffer[2];
+      for (int e = 0; e < EVENTS; ++e)
+        counts.values[e] += buffer[3 + e] * scale;
+    }
+    for (int fd : imc_fds)
+    {
+      uint64_t value = 0;
+      if (read(fd, &value, sizeof(value)) == (ssize_t)sizeof(value))
+        counts.bytes += value * LINE_BYTES;
+    }
+#endif
+    if (!imc)
+      counts.bytes = counts.values[LLC_MISSES] * LINE_BYTES;
+    counts.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+    return counts;
+  }
+
+  void BeginKernel(const char *name, const uint32_t, uint64_t *) { Counters::Begin(name); }
+  void EndKernel(uint64_t) { Counters::End(); }
+
+  void SetKernelCallbacks(bool on)
+  {
+    using namespace Kokkos::Tools::Experimental;
+    set_begin_parallel_for_callback(on ? BeginKernel : nullptr);
+    set_end_parallel_for_callback(on ? EndKernel : nullptr);
+    set_begin_parallel_reduce_callback(on ? BeginKernel : nullptr);
+    set_end_parallel_reduce_callback(on ? EndKernel : nullptr);
+    set_begin_parallel_scan_callback(on ? BeginKernel : nullptr);
+    set_end_parallel_scan_callback(on ? EndKernel : nullptr);
+  }
+
+  double Ratio(double a, double b) { return b > 0.0 ? a / b : 0.0; }
+}
+
+namespace Counters
+{
+  void Initialize(const YAML::Node &config)
+  {
+    Finalize();
+    if (!config || (config["enabled"] && !config["enabled"].as<bool>()))
+      return;
+    const bool root = Parallel::IsRoot();
+#ifdef __linux__
+    // Host threads exist once Kokkos is initialized; one group per thread.
+    bool ok = true;
+    for (const std::string &task : List("/proc/self/task"))
+      ok = ok && OpenThread(std::stoi(task));
+    if (!ok || leaders.empty())
+    {
+      if (root)
+        std::cerr << "Counters::Initialize: perf_event_open failed (" << std::strerror(errno)
+                  << "); the CPU (or VM) must expose hardware counters and /proc/sys/kernel/perf_event_paranoid allow them. Counters disabled.\n";
+      Close();
+      return;
+    }
+    imc = OpenMemoryControllers();
+#else
+    if (root)
+      std::cerr << "Counters::Initialize: hardware counters need Linux perf_event_open. Counters disabled.\n";
+    return;
+#endif
+    enabled = true;
+
+    // Kernel regions use the Kokkos Tools callbacks, which a loaded tool
+    // (KOKKOS_TOOLS_LIBS) already owns.
+    kernels = !(config["kernels"] && !config["kernels"].as<bool>()) && !Kokkos::Tools::profileLibraryLoaded();
+    if (kernels)
+      SetKernelCallbacks(true);
+
+    file = config["file"] ? config["file"].as<std::string>() : "counters.csv";
+    if (Parallel::Size() > 1)
+      file = file.substr(0, file.rfind('.')) + "_" + std::to_string(Parallel::Rank()) + ".csv";
+    std::ofstream out(file);
+    out << "STEP;REGION;CALLS;SECONDS";
+    for (const char *name : EVENT_NAMES)
+      out << ";" << name;
+    out << ";BYTES;IPC;BYTES_PER_PARTICLE_STEP;GB_PER_S\n";
+
+    if (root)
+      std::cout << "[Counters] " << leaders.size() << " threads, memory traffic "
+                << (imc ? "from uncore_imc (whole socket)" : "estimated as 64 B per LLC miss")
+                << (kernels ? ", module and kernel regions" : ", module regions") << " -> " << file << "\n";
+  }
+
+  void Finalize()
+  {
+    if (kernels)
+      SetKernelCallbacks(false);
+    Close();
+    enabled = false;
+    kernels = false;
+    imc = false;
+    stack.clear();
+    interval.clear();
+    total.clear();
+    last_step = 0;
+  }
+
+  bool Enabled() { return enabled; }
+
+  void Begin(const std::string &region)
+  {
+    if (!enabled)
+      return;
+    stack.push_back(Frame{region, Snapshot()});
+  }
+
+  void End()
+  {
+    if (!enabled || stack.empty())
+      return;
+    const Counts now = Snapshot();
+    const Frame &frame = stack.back();
+    Counts delta;
+    for (int e = 0; e < EVENTS; ++e)
+      delta.values[e] = now.values[e] - frame.start.values[e];
+    delta.bytes = now.bytes - frame.start.bytes;
+    delta.seconds = now.seconds - frame.start.seconds;
+    delta.calls = 1;
+    interval[frame.region].Add(delta);
+    total[frame.region].Add(delta);
+    stack.pop_back();
+  }
+
+  void Record(const Data &data)
+  {
+    if (!enabled)
+      return;
+    const double steps = data.cstep - last_step;
+    const double particles = data.OWNED_COUNT;
+    last_step = data.cstep;
+    std::ofstream out(file, std::ios_base::app);
+    for (const auto &entry : interval)
+    {
+      const Counts &c = entry.second;
+      out << data.cstep << ";" << entry.first << ";" << c.calls << ";" << c.seconds;
+      for (int e = 0; e < EVENTS; ++e)
+        out << ";" << (uint64_t)c.values[e];
+      out << ";" << (uint64_t)c.bytes << ";" << Ratio(c.values[INSTRUCTIONS], c.values[CYCLES]) << ";"
+          << Ratio(c.bytes, particles * steps) << ";" << Ratio(c.bytes, c.seconds) * 1e-9 << "\n";
+    }
+    interval.clear();
+  }
+
+  void Report(std::ostream &out, const Data &data)
+  {
+    if (!enabled || total.empty())
+      return;
+    std::vector<std::pair<std::string, Counts>> regions(total.begin(), total.end());
+    std::sort(regions.begin(), regions.end(), [](const auto &a, const auto &b) { return a.second.seconds > b.second.seconds; });
+    const double particle_steps = (double)data.OWNED_COUNT * data.cstep;
+    out << "[Counters] totals over " << data.cstep << " steps (bytes " << (imc ? "from uncore_imc" : "estimated from LLC misses") << "):\n";
+    out << "  " << std::left << std::setw(24) << "REGION" << std::right << std::setw(10) << "SECONDS" << std::setw(8) << "IPC"
+        << std::setw(12) << "LLC_MPKI" << std::setw(14) << "B/PART/STEP" << std::setw(10) << "GB/S" << "\n";
+    for (const auto &entry : regions)
+    {
+      const Counts &c = entry.second;
+      out << "  " << std::left << std::setw(24) << entry.first.substr(0, 23) << std::right << std::fixed << std::setprecision(3)
+          << std::setw(10) << c.seconds << std::setprecision(2) << std::setw(8) << Ratio(c.values[INSTRUCTIONS], c.values[CYCLES])
+          << std::setw(12) << 1000.0 * Ratio(c.values[LLC_MISSES], c.values[INSTRUCTIONS]) << std::setprecision(1) << std::setw(14)
+          << Ratio(c.bytes, particle_steps) << std::setprecision(2) << std::setw(10) << Ratio(c.bytes, c.seconds) * 1e-9 << "\n";
+    }
+  }
+}
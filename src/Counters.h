@@ -0,0 +1,33 @@
+#pragma once
+#include <yaml-cpp/yaml.h>
+#include <ostream>
+#include <string>
+
+class Data;
+
+// Hardware performance counters (config.yaml "counters") through Linux
+// perf_event_open: cycles, instructions and last-level cache misses of every
+// host thread of the process, and the memory traffic of the integrated
+// memory controllers (uncore_imc) where the kernel exposes them, otherwise
+// estimated as one 64-byte line per LLC miss. Counts are taken per region:
+// every module (AModule::RunProcessing) and, through the Kokkos Tools
+// callbacks, every kernel launch. Regions are inclusive, so a module's counts
+// contain those of its kernels. On GPU backends only the host side is
+// counted. Without the section, or when the counters cannot be opened, every
+// call is a no-op.
+namespace Counters
+{
+  void Initialize(const YAML::Node &config);
+  void Finalize();
+  bool Enabled();
+
+  void Begin(const std::string &region);
+  void End();
+
+  // Appends the regions counted since the previous call to counters.csv
+  // (counters_<rank>.csv with more than one MPI rank), with IPC and bytes
+  // per particle per step derived from the counts.
+  void Record(const Data &data);
+  // Totals over the whole run, one line per region.
+  void Report(std::ostream &out, const Data &data);
+}
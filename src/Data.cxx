@@ -1,4 +1,8 @@
 #include "Data.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "Placement.h"
+#include <Kokkos_Sort.hpp>
 
 void Data::initialize()
 {
@@ -22,12 +26,423 @@ void Data::initialize()
 
     // DT will be computed analytically after reading particle radii (in Reader)
 
+    // Optional periodic axes, e.g. "periodic: [1, 1, 0]". Walls on those
+    // axes are ignored and the wall box becomes the periodic cell.
+    auto periodic = yaml.config["constrains"]["periodic"];
+    if (periodic && periodic.IsSequence() && periodic.size() == 3)
+    {
+        this->PERIODIC.origin = this->WALL_MIN;
+        this->PERIODIC.length = this->WALL_MAX - this->WALL_MIN;
+        for (int axis = 0; axis < 3; ++axis)
+            this->PERIODIC.periodic[axis] = periodic[axis].as<int>() != 0;
+        auto unwrap = yaml.config["constrains"]["periodic_unwrap"];
+        this->UNWRAP_OUTPUT = unwrap && unwrap.as<bool>();
+        std::cout << "Periodic axes: " << this->PERIODIC.periodic[0] << " " << this->PERIODIC.periodic[1] << " "
+                  << this->PERIODIC.periodic[2] << (this->UNWRAP_OUTPUT ? " (unwrapped output)" : "") << "\n";
+    }
 
-    
+    // Slab decomposition over MPI ranks along the longest non-periodic box
+    // axis (the halo exchange does not wrap around).
+    if (Parallel::Size() > 1)
+    {
+        Vec3 extent = this->WALL_MAX - this->WALL_MIN;
+        this->DOMAIN_AXIS = -1;
+        for (int axis = 0; axis < 3; ++axis)
+            if (!this->PERIODIC.periodic[axis] && (this->DOMAIN_AXIS < 0 || extent[axis] > extent[this->DOMAIN_AXIS]))
+                this->DOMAIN_AXIS = axis;
+        if (this->DOMAIN_AXIS < 0)
+        {
+            std::cerr << "MPI domain decomposition needs at least one non-periodic axis.\n";
+            exit(1);
+        }
+        const double width = extent[this->DOMAIN_AXIS] / Parallel::Size();
+        const int rank = Parallel::Rank();
+        if (rank > 0)
+            this->DOMAIN_LO = this->WALL_MIN[this->DOMAIN_AXIS] + rank * width;
+        if (rank < Parallel::Size() - 1)
+            this->DOMAIN_HI = this->WALL_MIN[this->DOMAIN_AXIS] + (rank + 1) * width;
+        std::cout << "Rank " << rank << " owns slab [" << this->DOMAIN_LO << ", " << this->DOMAIN_HI
+                  << ") along axis " << this->DOMAIN_AXIS << "\n";
+    }
 
-    
-    
+    // Optional ensemble: every entry is an independent system; keys that are
+    // not given fall back to the global values read above.
+    auto ensemble = yaml.config["ensemble"];
+    if (ensemble && ensemble.IsSequence() && ensemble.size() > 0)
+    {
+        this->ENSEMBLE = true;
+        const std::string default_input = yaml.ReadString("simulation", "input");
+        for (size_t i = 0; i < ensemble.size(); ++i)
+        {
+            auto entry = ensemble[i];
+            auto readDouble = [&](const char *key, double fallback)
+            { return entry[key] ? entry[key].as<double>() : fallback; };
+            auto readVec3 = [&](const char *key, const Vec3 &fallback)
+            {
+                if (!entry[key])
+                    return fallback;
+                auto v = entry[key].as<std::vector<double>>();
+                return Vec3(v[0], v[1], v[2]);
+            };
 
-    
+            SystemState system;
+            system.input = entry["input"] ? entry["input"].as<std::string>() : default_input;
+            system.WALL_MIN = readVec3("walls_min", this->WALL_MIN);
+            system.WALL_MAX = readVec3("walls_max", this->WALL_MAX);
+            system.cylinder_radius = readDouble("cylinder_radius", this->cylinder_radius);
+            system.simConstants = this->simConstants;
+            system.simConstants.radius_scale_delta = readDouble("radius_scale_delta", this->simConstants.radius_scale_delta);
+            system.simConstants.overlap_limit = readDouble("overlap_limit", this->simConstants.overlap_limit);
+            system.simConstants.relaxation_coefficient = readDouble("relaxation_coefficient", this->simConstants.relaxation_coefficient);
+            system.simConstants.relaxation_coefficient_scale = readDouble("relaxation_coefficient_scale", this->simConstants.relaxation_coefficient_scale);
+            system.simConstants.initial_scale = readDouble("initial_scale", this->simConstants.initial_scale);
+            system.simConstants.maxOverlap = 0;
+            this->systems.push_back(system);
+        }
+        std::cout << "Ensemble mode: " << this->systems.size() << " systems\n";
+        if (Parallel::Size() > 1)
+        {
+            std::cerr << "Ensemble mode cannot be combined with MPI domain decomposition.\n";
+            exit(1);
+        }
+        if (this->PERIODIC.any())
+        {
+            std::cerr << "Ensemble mode cannot be combined with periodic boundaries.\n";
+            exit(1);
+        }
+    }
+}
 
-}
\ No newline at end of file
+#ifdef DENSEPACKING_NEIGHBOUR16
+// Compressed lists keep absolute IDs only in NN_FAR.
+typedef index_t absolute_neighbour_t;
+
+// Initial NN_FAR rows: with Morton-sorted particles well under one list in
+// a thousand needs escaping; unsorted inputs grow the rows on demand.
+static size_t initialFarRows(index_t count)
+{
+    return (size_t)count / 64 + 64;
+}
+#else
+typedef neighbour_t absolute_neighbour_t;
+#endif
+
+// The NN_IDS slots of `capacity` particles must be addressable with index_t
+// and every particle index must fit in an (absolute) neighbour ID.
+static bool indexRangeFits(size_t capacity, int nn_max)
+{
+    if (capacity * nn_max <= (size_t)std::numeric_limits<index_t>::max() &&
+        capacity <= (size_t)std::numeric_limits<absolute_neighbour_t>::max())
+        return true;
+    std::cerr << capacity << " particles with NN_MAX " << nn_max << " overflow the " << 8 * sizeof(index_t)
+              << "-bit particle index (" << 8 * sizeof(absolute_neighbour_t) << "-bit neighbour IDs); rebuild with -DDENSEPACKING_INDEX64=ON"
+              << (sizeof(absolute_neighbour_t) < sizeof(index_t) ? " -DDENSEPACKING_NEIGHBOUR64=ON" : "") << ".\n";
+    return false;
+}
+
+void Data::allocateParticles(index_t count)
+{
+    this->PARTICLE_COUNT = count;
+    this->OWNED_COUNT = count;
+    this->POSITION = Placement::Allocate<Kokkos::View<Vec3 *>>("POSITION", count);
+    this->OLD_RADIUS = Placement::Allocate<Kokkos::View<double *>>("OLD_RADIUS", count);
+#ifdef DENSEPACKING_LAZY_RADIUS
+    this->RADIUS = this->OLD_RADIUS;
+#else
+    this->RADIUS = Placement::Allocate<Kokkos::View<double *>>("RADIUS", count);
+#endif
+    this->VELOCITY = Placement::Allocate<Kokkos::View<Vec3 *>>("VELOCITY", count);
+    this->NN_COUNT = Placement::Allocate<Kokkos::View<int *>>("NN_COUNT", count);
+    this->FIX = Placement::Allocate<Kokkos::View<int *>>("FIX", count);
+    this->MAX_OVERLAP = Placement::Allocate<Kokkos::View<double *>>("MAX_OVERLAP", count);
+    this->IMAGE = Placement::Allocate<Kokkos::View<int *[3]>>("IMAGE", this->PERIODIC.any() ? count : 0);
+
+    // A single zeroing pass is the first touch of every particle array.
+    auto &POSITION = this->POSITION;
+    auto &RADIUS = this->RADIUS;
+    auto &OLD_RADIUS = this->OLD_RADIUS;
+    auto &VELOCITY = this->VELOCITY;
+    auto &NN_COUNT = this->NN_COUNT;
+    auto &FIX = this->FIX;
+    auto &MAX_OVERLAP = this->MAX_OVERLAP;
+    auto &IMAGE = this->IMAGE;
+    const bool periodic = this->PERIODIC.any();
+    Kokkos::parallel_for("DATA_FIRST_TOUCH", Placement::Policy(0, count), KOKKOS_LAMBDA(const index_t idx) {
+        POSITION(idx) = Vec3{0.0, 0.0, 0.0};
+        RADIUS(idx) = 0;
+        OLD_RADIUS(idx) = 0;
+        VELOCITY(idx) = Vec3{0.0, 0.0, 0.0};
+        NN_COUNT(idx) = 0;
+        FIX(idx) = 0;
+        MAX_OVERLAP(idx) = 0;
+        if (periodic)
+            for (int axis = 0; axis < 3; ++axis)
+                IMAGE(idx, axis) = 0; });
+    recordMemory();
+}
+
+void Data::allocateNeighbours(double min_radius, double max_radius)
+{
+    this->min_radius = min_radius;
+    this->simConstants.NN_MAX = neighbourCapacity(min_radius, max_radius);
+
+    std::cout << "NN max " << this->simConstants.NN_MAX << "\n";
+    if (!indexRangeFits(this->POSITION.extent(0), this->simConstants.NN_MAX))
+    {
+        this->COMPUTE = false;
+        return;
+    }
+
+    const int NN_MAX = this->simConstants.NN_MAX;
+    this->NN_IDS = Placement::Allocate<Kokkos::View<neighbour_t *>>("NN_IDS", (size_t)this->PARTICLE_COUNT * NN_MAX);
+    // Each particle's slots are first touched by the thread that searches it.
+    auto &NN_IDS = this->NN_IDS;
+    Kokkos::parallel_for("NN_FIRST_TOUCH", Placement::Policy(0, this->PARTICLE_COUNT), KOKKOS_LAMBDA(const index_t idx) {
+        for (int k = 0; k < NN_MAX; ++k)
+            NN_IDS(NeighbourSlot(idx, NN_MAX, k)) = 0; });
+#ifdef DENSEPACKING_NEIGHBOUR16
+    // growNeighbourRows adds FAR rows when a search needs more.
+    this->NN_ROW = Kokkos::View<int *>("NN_ROW", this->PARTICLE_COUNT);
+    Kokkos::deep_copy(this->NN_ROW, -1);
+    this->NN_FAR = Kokkos::View<index_t *>("NN_FAR", initialFarRows(this->PARTICLE_COUNT) * NN_MAX);
+    this->NN_FAR_USED = Kokkos::View<int>("NN_FAR_USED");
+#endif
+    recordMemory();
+}
+
+int Data::neighbourCapacity(double min_radius, double max_radius)
+{
+    const int capacity = (int)(4.0 * 0.74 * (min_radius + max_radius * 1.1) * (min_radius + max_radius * 1.1) / (min_radius * min_radius)) + 1;
+    return capacity * 2;
+}
+
+void Data::reserveParticles(index_t count)
+{
+    if (count <= (index_t)this->POSITION.extent(0))
+        return;
+    const index_t capacity = (index_t)(count * 1.2) + 64;
+    // Called mid-run by Domain, where there is no way back.
+    if (!indexRangeFits(capacity, this->simConstants.NN_MAX))
+        exit(1);
+    Placement::Grow(this->POSITION, capacity);
+    Placement::Grow(this->OLD_RADIUS, capacity);
+#ifdef DENSEPACKING_LAZY_RADIUS
+    this->RADIUS = this->OLD_RADIUS;
+#else
+    Placement::Grow(this->RADIUS, capacity);
+#endif
+    Placement::Grow(this->VELOCITY, capacity);
+    Placement::Grow(this->NN_COUNT, capacity);
+    Placement::Grow(this->FIX, capacity);
+    Placement::Grow(this->MAX_OVERLAP, capacity);
+    if (this->PERIODIC.any())
+        Placement::Grow(this->IMAGE, capacity);
+    Placement::Grow(this->NN_IDS, capacity, this->simConstants.NN_MAX);
+#ifdef DENSEPACKING_NEIGHBOUR16
+    Placement::Grow(this->NN_ROW, capacity);
+#endif
+    recordMemory();
+}
+
+NeighbourList Data::Neighbours() const
+{
+    NeighbourList list;
+    list.IDS = this->NN_IDS;
+    list.ROW = this->NN_ROW;
+    list.FAR = this->NN_FAR;
+    list.FAR_USED = this->NN_FAR_USED;
+    list.NN_MAX = this->simConstants.NN_MAX;
+    list.FAR_ROWS = this->simConstants.NN_MAX > 0 ? (int)(this->NN_FAR.extent(0) / this->simConstants.NN_MAX) : 0;
+    return list;
+}
+
+RadiusField Data::Radii() const
+{
+    RadiusField radii;
+#ifdef DENSEPACKING_LAZY_RADIUS
+    radii.BASE = this->OLD_RADIUS;
+    radii.FIX = this->FIX;
+    radii.SYSTEM_ID = this->SYSTEM_ID;
+    radii.SYSTEM_SCALE = this->SYSTEM_SCALE;
+    radii.SCALE = this->simConstants.radius_scale_delta_current;
+    radii.ENSEMBLE = this->ENSEMBLE;
+#else
+    radii.RADIUS = this->RADIUS;
+#endif
+    return radii;
+}
+
+bool Data::growNeighbourRows()
+{
+#ifdef DENSEPACKING_NEIGHBOUR16
+    int used = 0;
+    Kokkos::deep_copy(used, this->NN_FAR_USED);
+    const int NN_MAX = this->simConstants.NN_MAX;
+    if ((size_t)used * NN_MAX <= this->NN_FAR.extent(0))
+        return false;
+    // A search from first > 0 keeps the rows of the particles below first.
+    Kokkos::resize(this->NN_FAR, (size_t)((index_t)(used * 1.2) + 64) * NN_MAX);
+    recordMemory();
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Spreads the low 21 bits of v two bits apart (one Morton axis).
+KOKKOS_INLINE_FUNCTION uint64_t spreadBits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+// view(i) = view(ORDER(i)) for the first `count` entries, in the first-touch
+// partition of a fresh allocation.
+template <class ViewType>
+static void permute(ViewType &view, const Kokkos::View<index_t *> &ORDER, index_t count)
+{
+    ViewType old = view;
+    ViewType sorted = Placement::Allocate<ViewType>(old.label(), old.extent(0));
+    Kokkos::parallel_for("DATA_PERMUTE", Placement::Policy(0, old.extent(0)), KOKKOS_LAMBDA(const index_t idx) {
+        sorted(idx) = old(idx < count ? ORDER(idx) : idx); });
+    view = sorted;
+}
+
+static void permute(Kokkos::View<int *[3]> &view, const Kokkos::View<index_t *> &ORDER, index_t count)
+{
+    Kokkos::View<int *[3]> old = view;
+    Kokkos::View<int *[3]> sorted(Kokkos::view_alloc(Kokkos::WithoutInitializing, old.label()), old.extent(0));
+    Kokkos::parallel_for("DATA_PERMUTE_IMAGE", Placement::Policy(0, old.extent(0)), KOKKOS_LAMBDA(const index_t idx) {
+        const index_t from = idx < count ? ORDER(idx) : idx;
+        for (int axis = 0; axis < 3; ++axis)
+            sorted(idx, axis) = old(from, axis); });
+    view = sorted;
+}
+
+void Data::sortParticles()
+{
+    const index_t N = this->OWNED_COUNT;
+    if (N < 2)
+        return;
+    auto &POSITION = this->POSITION;
+
+    // Morton keys on a 2^21 grid over the bounding box of the particles.
+    Vec3 lo, hi;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        Kokkos::parallel_reduce("DATA_SORT_MIN", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+            if (POSITION(idx)[axis] < local)
+                local = POSITION(idx)[axis]; }, Kokkos::Min<double>(lo[axis]));
+        Kokkos::parallel_reduce("DATA_SORT_MAX", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+            if (POSITION(idx)[axis] > local)
+                local = POSITION(idx)[axis]; }, Kokkos::Max<double>(hi[axis]));
+    }
+    Vec3 scale;
+    for (int axis = 0; axis < 3; ++axis)
+        scale[axis] = hi[axis] > lo[axis] ? 2097151.0 / (hi[axis] - lo[axis]) : 0.0;
+
+    Kokkos::View<uint64_t *> KEY(Kokkos::view_alloc(Kokkos::WithoutInitializing, "SORT_KEY"), N);
+    Kokkos::View<index_t *> ORDER(Kokkos::view_alloc(Kokkos::WithoutInitializing, "SORT_ORDER"), N);
+    Kokkos::parallel_for("DATA_SORT_KEY", N, KOKKOS_LAMBDA(const index_t idx) {
+        const Vec3 p = POSITION(idx);
+        KEY(idx) = spreadBits((uint64_t)((p.x - lo.x) * scale.x)) | spreadBits((uint64_t)((p.y - lo.y) * scale.y)) << 1 |
+                   spreadBits((uint64_t)((p.z - lo.z) * scale.z)) << 2;
+        ORDER(idx) = idx; });
+
+    // Ensemble systems keep their [offset, offset + count) ranges.
+    std::vector<std::pair<index_t, index_t>> ranges;
+    if (this->ENSEMBLE)
+        for (const auto &system : this->systems)
+            ranges.push_back(std::make_pair(system.offset, system.offset + system.count));
+    else
+        ranges.push_back(std::make_pair((index_t)0, N));
+    Kokkos::DefaultExecutionSpace space;
+    for (const auto &range : ranges)
+        Kokkos::Experimental::sort_by_key(space, Kokkos::subview(KEY, range), Kokkos::subview(ORDER, range));
+
+    permute(this->POSITION, ORDER, N);
+    permute(this->OLD_RADIUS, ORDER, N);
+#ifdef DENSEPACKING_LAZY_RADIUS
+    this->RADIUS = this->OLD_RADIUS;
+#else
+    permute(this->RADIUS, ORDER, N);
+#endif
+    permute(this->VELOCITY, ORDER, N);
+    permute(this->FIX, ORDER, N);
+    permute(this->MAX_OVERLAP, ORDER, N);
+    if (this->PERIODIC.any())
+        permute(this->IMAGE, ORDER, N);
+    Kokkos::deep_copy(this->NN_COUNT, 0);
+#ifdef DENSEPACKING_NEIGHBOUR16
+    // Rows grown for the unsorted order (e.g. by the Generator) are released.
+    if (this->NN_FAR.extent(0) > 0)
+    {
+        this->NN_FAR = Kokkos::View<index_t *>();
+        this->NN_FAR = Kokkos::View<index_t *>("NN_FAR", initialFarRows(N) * this->simConstants.NN_MAX);
+    }
+#endif
+    recordMemory();
+}
+
+void Data::recordMemory() const
+{
+    Memory::Record("Data", "POSITION", this->POSITION);
+#ifndef DENSEPACKING_LAZY_RADIUS
+    Memory::Record("Data", "RADIUS", this->RADIUS);
+#endif
+    Memory::Record("Data", "MAX_OVERLAP", this->MAX_OVERLAP);
+    Memory::Record("Data", "OLD_RADIUS", this->OLD_RADIUS);
+    Memory::Record("Data", "NN_COUNT", this->NN_COUNT);
+    Memory::Record("Data", "NN_IDS", this->NN_IDS);
+    Memory::Record("Data", "NN_ROW", this->NN_ROW);
+    Memory::Record("Data", "NN_FAR", this->NN_FAR);
+    Memory::Record("Data", "VELOCITY", this->VELOCITY);
+    Memory::Record("Data", "FIX", this->FIX);
+    Memory::Record("Data", "IMAGE", this->IMAGE);
+    Memory::Record("Data", "SYSTEM_ID", this->SYSTEM_ID);
+}
+
+void Data::uploadSystems()
+{
+    const int count = (int)this->systems.size();
+    if ((int)this->SYSTEM_SCALE.extent(0) != count)
+    {
+        this->SYSTEM_OFFSET = Kokkos::View<index_t *>("SYSTEM_OFFSET", count + 1);
+        this->SYSTEM_WALL_MIN = Kokkos::View<Vec3 *>("SYSTEM_WALL_MIN", count);
+        this->SYSTEM_WALL_MAX = Kokkos::View<Vec3 *>("SYSTEM_WALL_MAX", count);
+        this->SYSTEM_CYLINDER_RADIUS = Kokkos::View<double *>("SYSTEM_CYLINDER_RADIUS", count);
+        this->SYSTEM_RELAXATION = Kokkos::View<double *>("SYSTEM_RELAXATION", count);
+        this->SYSTEM_SCALE = Kokkos::View<double *>("SYSTEM_SCALE", count);
+        this->SYSTEM_MAX_OVERLAP = Kokkos::View<double *>("SYSTEM_MAX_OVERLAP", count);
+    }
+
+    auto OFFSET_host = Kokkos::create_mirror_view(this->SYSTEM_OFFSET);
+    auto WALL_MIN_host = Kokkos::create_mirror_view(this->SYSTEM_WALL_MIN);
+    auto WALL_MAX_host = Kokkos::create_mirror_view(this->SYSTEM_WALL_MAX);
+    auto CYLINDER_RADIUS_host = Kokkos::create_mirror_view(this->SYSTEM_CYLINDER_RADIUS);
+    auto RELAXATION_host = Kokkos::create_mirror_view(this->SYSTEM_RELAXATION);
+    auto SCALE_host = Kokkos::create_mirror_view(this->SYSTEM_SCALE);
+    for (int s = 0; s < count; ++s)
+    {
+        const auto &system = this->systems[s];
+        OFFSET_host(s) = system.offset;
+        WALL_MIN_host(s) = system.WALL_MIN;
+        WALL_MAX_host(s) = system.WALL_MAX;
+        CYLINDER_RADIUS_host(s) = system.cylinder_radius;
+        RELAXATION_host(s) = system.simConstants.relaxation_coefficient;
+        SCALE_host(s) = system.simConstants.radius_scale_delta_current;
+    }
+    OFFSET_host(count) = count > 0 ? this->systems[count - 1].offset + this->systems[count - 1].count : 0;
+
+    Kokkos::deep_copy(this->SYSTEM_OFFSET, OFFSET_host);
+    Kokkos::deep_copy(this->SYSTEM_WALL_MIN, WALL_MIN_host);
+    Kokkos::deep_copy(this->SYSTEM_WALL_MAX, WALL_MAX_host);
+    Kokkos::deep_copy(this->SYSTEM_CYLINDER_RADIUS, CYLINDER_RADIUS_host);
+    Kokkos::deep_copy(this->SYSTEM_RELAXATION, RELAXATION_host);
+    Kokkos::deep_copy(this->SYSTEM_SCALE, SCALE_host);
+}
@@ -2,16 +2,35 @@
 #include "DataTypes.h"
 #include "SimulationConstants.h"
 #include "YamlAPI.h"
+#include "PeriodicBox.h"
 #include <yaml-cpp/yaml.h>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 #define MAX_MATERIALS 3
 
+// Host-side state of one independent system in ensemble mode. Systems are
+// stored back to back in the particle Views: [offset, offset + count).
+struct SystemState
+{
+  std::string input;
+  index_t offset = 0;
+  index_t count = 0;
+  Vec3 WALL_MIN;
+  Vec3 WALL_MAX;
+  double cylinder_radius = 1E12;
+  double min_radius = 0;
+  SimulationConstants simConstants;
+};
+
 class Data
 {
 public:
   SimulationConstants simConstants;
   YamlAPI yaml;
-  YAML::Node config = YAML::LoadFile("config.yaml");
+  // Set by the owner (main.cxx loads config.yaml); empty by default.
+  YAML::Node config;
   unsigned long total_steps=1000;
   unsigned long cstep = 0;
   bool COMPUTE = true;
@@ -22,17 +41,80 @@ public:
   Vec3 WALL_MIN;
   Vec3 WALL_MAX;
   double cylinder_radius=1E12;
-  int PARTICLE_COUNT = 0;
+  // constrains.periodic: axes without walls; IMAGE counts box crossings and
+  // is only allocated when some axis is periodic.
+  PeriodicBox PERIODIC;
+  bool UNWRAP_OUTPUT = false;
+  index_t PARTICLE_COUNT = 0;
+  // Owned particles come first; ghost (halo) copies received from
+  // neighbouring MPI ranks follow them. PARTICLE_COUNT counts both, so
+  // OWNED_COUNT == PARTICLE_COUNT on a single rank.
+  index_t OWNED_COUNT = 0;
+  // Ghosts [OWNED_COUNT, OWNED_COUNT + LEFT_GHOST_COUNT) mirror the left
+  // rank, the rest the right rank.
+  index_t LEFT_GHOST_COUNT = 0;
+
+  // Slab decomposition of the WALL_MIN/WALL_MAX box along DOMAIN_AXIS: this
+  // rank owns [DOMAIN_LO, DOMAIN_HI) (open-ended on the outermost ranks).
+  int DOMAIN_AXIS = 0;
+  double DOMAIN_LO = -std::numeric_limits<double>::max();
+  double DOMAIN_HI = std::numeric_limits<double>::max();
+  bool ownsPosition(const Vec3 &p) const { return p[DOMAIN_AXIS] >= DOMAIN_LO && p[DOMAIN_AXIS] < DOMAIN_HI; }
 
   void initialize();
+  // Allocates and zeroes every per-particle View for `count` particles.
+  void allocateParticles(index_t count);
+  // Sizes NN_MAX from the radius range and allocates NN_IDS; clears COMPUTE
+  // if the lists do not fit the index_t / neighbour_t build.
+  void allocateNeighbours(double min_radius, double max_radius);
+  // NN_MAX for particles in [min_radius, max_radius].
+  static int neighbourCapacity(double min_radius, double max_radius);
+  // Grows every per-particle View (and NN_IDS) to hold at least `count`
+  // particles, keeping the existing contents. Exits on index overflow.
+  void reserveParticles(index_t count);
+  // Reorders the owned particles (each ensemble system on its own) along a
+  // Morton curve, so that neighbours are also close in memory. Neighbour
+  // lists are cleared; the next contact search rebuilds them.
+  void sortParticles();
+  // The neighbour lists as seen by kernels.
+  NeighbourList Neighbours() const;
+  // The current radii as seen by kernels.
+  RadiusField Radii() const;
+  // After a contact search: true if the compressed lists needed more FAR
+  // rows than there were, which are then added; the search must be rerun.
+  bool growNeighbourRows();
+  // Enters the current size of every View above in the Memory ledger.
+  void recordMemory() const;
   Kokkos::View<Vec3 *> POSITION;
+  // With DENSEPACKING_LAZY_RADIUS, RADIUS is the same View as OLD_RADIUS
+  // (the base radii): writing it sets the radii before growth starts, and
+  // kernels read the scaled radii through Radii().
   Kokkos::View<double *> RADIUS;
   Kokkos::View<double *> MAX_OVERLAP;
   Kokkos::View<double *> OLD_RADIUS;
   Kokkos::View<int *> NN_COUNT;
-  Kokkos::View<int *> NN_IDS;
+  Kokkos::View<neighbour_t *> NN_IDS;
+  // Escaped lists of the DENSEPACKING_NEIGHBOUR16 build (see NeighbourList).
+  Kokkos::View<int *> NN_ROW;
+  Kokkos::View<index_t *> NN_FAR;
+  Kokkos::View<int> NN_FAR_USED;
   Kokkos::View<Vec3 *> VELOCITY;  
-  Kokkos::View<Vec3 *> FORCE;  
   Kokkos::View<int *> FIX;
-  
+  Kokkos::View<int *[3]> IMAGE;
+
+  // Ensemble mode (config.yaml "ensemble" list). When off, systems is empty
+  // and the globals above describe the single system.
+  bool ENSEMBLE = false;
+  std::vector<SystemState> systems;
+  // Copies per-system walls, relaxation and radius scale to the SYSTEM_* Views.
+  void uploadSystems();
+  Kokkos::View<int *> SYSTEM_ID;
+  Kokkos::View<index_t *> SYSTEM_OFFSET; // systems.size() + 1 entries
+  Kokkos::View<Vec3 *> SYSTEM_WALL_MIN;
+  Kokkos::View<Vec3 *> SYSTEM_WALL_MAX;
+  Kokkos::View<double *> SYSTEM_CYLINDER_RADIUS;
+  Kokkos::View<double *> SYSTEM_RELAXATION;
+  Kokkos::View<double *> SYSTEM_SCALE;
+  Kokkos::View<double *> SYSTEM_MAX_OVERLAP;
+
 };
@@ -1,6 +1,134 @@
 #pragma once
 #include <Kokkos_Core.hpp>
 #include <cmath> // for sqrt, etc.
+#include <cstdint>
+
+// Particle counts, particle indices, neighbour-list offsets and the
+// ContactSearch tables use index_t. The 32-bit default overflows once
+// N * NN_MAX passes 2^31; configure with -DDENSEPACKING_INDEX64=ON for
+// larger packings.
+#ifdef DENSEPACKING_INDEX64
+typedef int64_t index_t;
+#else
+typedef int index_t;
+#endif
+
+// Neighbour IDs stored in NN_IDS stay 32-bit (half the bandwidth of the
+// list) as long as the particle count itself fits; DENSEPACKING_NEIGHBOUR64
+// widens them too. DENSEPACKING_NEIGHBOUR16 compresses them to 16-bit
+// offsets from the particle's own index (see NeighbourList).
+#ifdef DENSEPACKING_NEIGHBOUR64
+typedef int64_t neighbour_t;
+#elif defined(DENSEPACKING_NEIGHBOUR16)
+typedef int16_t neighbour_t;
+#else
+typedef int neighbour_t;
+#endif
+
+// Position of neighbour `k` of particle `idx` in NN_IDS, computed in index_t.
+KOKKOS_INLINE_FUNCTION
+index_t NeighbourSlot(const index_t idx, const int nn_max, const int k)
+{
+  return idx * nn_max + k;
+}
+
+// Kernel access to the neighbour lists (Data::Neighbours()). Without
+// compression NN_IDS holds the IDs themselves. With DENSEPACKING_NEIGHBOUR16
+// it holds pid - idx; a particle with any neighbour outside the 16-bit range
+// keeps its whole list as absolute index_t IDs in a row of FAR instead, ROW(idx)
+// (-1 for a compressed list). Rows are handed out by ContactSearch from the
+// FAR_USED counter; Data::growNeighbourRows resizes FAR when they run out.
+struct NeighbourList
+{
+  Kokkos::View<neighbour_t *> IDS;
+  Kokkos::View<int *> ROW;
+  Kokkos::View<index_t *> FAR;
+  Kokkos::View<int> FAR_USED;
+  int NN_MAX = 0;
+  int FAR_ROWS = 0;
+
+  // Neighbour k of particle idx.
+  KOKKOS_INLINE_FUNCTION
+  index_t operator()(const index_t idx, const int k) const
+  {
+#ifdef DENSEPACKING_NEIGHBOUR16
+    const int row = ROW(idx);
+    if (row >= 0)
+      return FAR(NeighbourSlot(row, NN_MAX, k));
+    return idx + IDS(NeighbourSlot(idx, NN_MAX, k));
+#else
+    return IDS(NeighbourSlot(idx, NN_MAX, k));
+#endif
+  }
+
+  // Appends pid as neighbour k of idx while the list is built; `row` starts
+  // at -1 and is passed to Finish once the list is complete.
+  KOKKOS_INLINE_FUNCTION
+  void Store(const index_t idx, const int k, const index_t pid, int &row) const
+  {
+#ifdef DENSEPACKING_NEIGHBOUR16
+    const index_t delta = pid - idx;
+    if (row < 0 && (delta < INT16_MIN || delta > INT16_MAX))
+    {
+      // First outlier: move the list so far to a FAR row.
+      row = Kokkos::atomic_fetch_add(&FAR_USED(), 1);
+      if (row < FAR_ROWS)
+        for (int m = 0; m < k; ++m)
+          FAR(NeighbourSlot(row, NN_MAX, m)) = idx + IDS(NeighbourSlot(idx, NN_MAX, m));
+    }
+    if (row < 0)
+      IDS(NeighbourSlot(idx, NN_MAX, k)) = (neighbour_t)delta;
+    else if (row < FAR_ROWS)
+      FAR(NeighbourSlot(row, NN_MAX, k)) = pid;
+#else
+    (void)row;
+    IDS(NeighbourSlot(idx, NN_MAX, k)) = (neighbour_t)pid;
+#endif
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void Finish(const index_t idx, const int row) const
+  {
+#ifdef DENSEPACKING_NEIGHBOUR16
+    ROW(idx) = row < FAR_ROWS ? row : -1;
+#else
+    (void)idx;
+    (void)row;
+#endif
+  }
+};
+
+// Kernel access to the particle radii (Data::Radii()). By default RADIUS
+// holds them and RadiusScaler rewrites it on every growth step. With
+// DENSEPACKING_LAZY_RADIUS only the base radii (OLD_RADIUS) are stored and a
+// free particle is scaled on read by 1 + SCALE, the cumulative
+// radius_scale_delta_current (in ensemble mode its system's SYSTEM_SCALE);
+// FIX particles keep their base radius.
+struct RadiusField
+{
+#ifdef DENSEPACKING_LAZY_RADIUS
+  Kokkos::View<double *> BASE;
+  Kokkos::View<int *> FIX;
+  Kokkos::View<int *> SYSTEM_ID;
+  Kokkos::View<double *> SYSTEM_SCALE;
+  double SCALE = 0;
+  bool ENSEMBLE = false;
+#else
+  Kokkos::View<double *> RADIUS;
+#endif
+
+  KOKKOS_INLINE_FUNCTION
+  double operator()(const index_t idx) const
+  {
+#ifdef DENSEPACKING_LAZY_RADIUS
+    if (FIX(idx) > 0)
+      return BASE(idx);
+    return BASE(idx) * (1.0 + (ENSEMBLE ? SYSTEM_SCALE(SYSTEM_ID(idx)) : SCALE));
+#else
+    return RADIUS(idx);
+#endif
+  }
+};
 
 struct Vec3
 {
@@ -0,0 +1,263 @@
+#include "Domain.h"
+#include "Parallel.h"
+#include "Memory.h"
+
+namespace
+{
+  enum DomainFlags
+  {
+    LEAVE_LEFT = 1,
+    LEAVE_RIGHT = 2,
+    HALO_TO_LEFT = 4,
+    HALO_TO_RIGHT = 8
+  };
+
+  // Compacts the indices idx < N with (FLAGS(idx) & mask) != 0, in order.
+  Kokkos::View<index_t *> Select(const Kokkos::View<int *> &FLAGS, index_t N, int mask, const char *label)
+  {
+    index_t count = 0;
+    Kokkos::parallel_reduce("DOMAIN_COUNT", N, KOKKOS_LAMBDA(const index_t idx, index_t &sum) {
+      if (FLAGS(idx) & mask)
+        sum++; }, count);
+    Kokkos::View<index_t *> selected(label, count);
+    Kokkos::parallel_scan("DOMAIN_SELECT", N, KOKKOS_LAMBDA(const index_t idx, index_t &offset, const bool final) {
+      if (FLAGS(idx) & mask)
+      {
+        if (final)
+          selected(offset) = idx;
+        offset++;
+      } });
+    return selected;
+  }
+
+  // view(i) = view(PERM(i)) for i < PERM.extent(0).
+  template <class ViewType>
+  void Gather(ViewType &view, const Kokkos::View<index_t *> &PERM)
+  {
+    const index_t count = PERM.extent(0);
+    // tmp is fully written, and view keeps the pages it was first touched on.
+    ViewType tmp(Kokkos::view_alloc(Kokkos::WithoutInitializing, view.label()), count);
+    Kokkos::parallel_for("DOMAIN_GATHER", count, KOKKOS_LAMBDA(const index_t idx) { tmp(idx) = view(PERM(idx)); });
+    Kokkos::parallel_for("DOMAIN_SCATTER", count, KOKKOS_LAMBDA(const index_t idx) { view(idx) = tmp(idx); });
+  }
+
+  // Same for the periodic image counters.
+  void GatherImage(Kokkos::View<int *[3]> &IMAGE, const Kokkos::View<index_t *> &PERM)
+  {
+    const index_t count = PERM.extent(0);
+    Kokkos::View<int *[3]> tmp(Kokkos::view_alloc(Kokkos::WithoutInitializing, IMAGE.label()), count);
+    Kokkos::parallel_for("DOMAIN_GATHER_IMAGE", count, KOKKOS_LAMBDA(const index_t idx) {
+      for (int axis = 0; axis < 3; ++axis)
+        tmp(idx, axis) = IMAGE(PERM(idx), axis); });
+    Kokkos::parallel_for("DOMAIN_SCATTER_IMAGE", count, KOKKOS_LAMBDA(const index_t idx) {
+      for (int axis = 0; axis < 3; ++axis)
+        IMAGE(idx, axis) = tmp(idx, axis); });
+  }
+}
+
+Domain::Domain(Data *data) : AModule(data) {}
+
+std::string Domain::getModuleName() { return "Domain"; };
+
+void Domain::Initialization()
+{
+  if (Parallel::Size() == 1)
+    return;
+  left = Parallel::Rank() > 0 ? Parallel::Rank() - 1 : -1;
+  right = Parallel::Rank() < Parallel::Size() - 1 ? Parallel::Rank() + 1 : -1;
+  ExchangeHalo();
+}
+
+void Domain::Processing()
+{
+  if (Parallel::Size() == 1)
+    return;
+  if (data->CONTACT_SEARCH)
+  {
+    Migrate();
+    ExchangeHalo();
+  }
+  else
+  {
+    UpdateHalo();
+  }
+}
+
+Kokkos::View<ParticleRecord *> Domain::Pack(const Kokkos::View<index_t *> &ids)
+{
+  Kokkos::View<ParticleRecord *> buffer("DOMAIN_SEND", ids.extent(0));
+  auto &POSITION = data->POSITION;
+  auto &VELOCITY = data->VELOCITY;
+  const RadiusField RADIUS = data->Radii();
+  auto &OLD_RADIUS = data->OLD_RADIUS;
+  auto &MAX_OVERLAP = data->MAX_OVERLAP;
+  auto &FIX = data->FIX;
+  auto &IMAGE = data->IMAGE;
+  const bool PERIODIC = data->PERIODIC.any();
+  Kokkos::parallel_for("DOMAIN_PACK", ids.extent(0), KOKKOS_LAMBDA(const index_t i) {
+    const index_t idx = ids(i);
+    ParticleRecord r;
+    r.position = POSITION(idx);
+    r.velocity = VELOCITY(idx);
+    r.radius = RADIUS(idx);
+    r.old_radius = OLD_RADIUS(idx);
+    r.max_overlap = MAX_OVERLAP(idx);
+    r.fix = FIX(idx);
+    for (int axis = 0; axis < 3; ++axis)
+      r.image[axis] = PERIODIC ? IMAGE(idx, axis) : 0;
+    buffer(i) = r; });
+  return buffer;
+}
+
+void Domain::Unpack(const std::vector<char> &bytes, index_t offset)
+{
+  const index_t count = bytes.size() / sizeof(ParticleRecord);
+  if (count == 0)
+    return;
+  Kokkos::View<const ParticleRecord *, Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged>> received(
+      reinterpret_cast<const ParticleRecord *>(bytes.data()), count);
+  Kokkos::View<ParticleRecord *> buffer("DOMAIN_RECV", count);
+  Kokkos::deep_copy(buffer, received);
+
+  auto &POSITION = data->POSITION;
+  auto &VELOCITY = data->VELOCITY;
+  auto &RADIUS = data->RADIUS;
+  auto &OLD_RADIUS = data->OLD_RADIUS;
+  auto &MAX_OVERLAP = data->MAX_OVERLAP;
+  auto &FIX = data->FIX;
+  auto &NN_COUNT = data->NN_COUNT;
+  auto &IMAGE = data->IMAGE;
+  const bool PERIODIC = data->PERIODIC.any();
+  Kokkos::parallel_for("DOMAIN_UNPACK", count, KOKKOS_LAMBDA(const index_t i) {
+    const index_t idx = offset + i;
+    const ParticleRecord r = buffer(i);
+    POSITION(idx) = r.position;
+    VELOCITY(idx) = r.velocity;
+    // With DENSEPACKING_LAZY_RADIUS these are the same View; the base
+    // radius is written last.
+    RADIUS(idx) = r.radius;
+    OLD_RADIUS(idx) = r.old_radius;
+    MAX_OVERLAP(idx) = r.max_overlap;
+    FIX(idx) = r.fix;
+    if (PERIODIC)
+      for (int axis = 0; axis < 3; ++axis)
+        IMAGE(idx, axis) = r.image[axis];
+    NN_COUNT(idx) = 0; });
+}
+
+// Owned particles that crossed DOMAIN_LO/DOMAIN_HI move to the neighbouring
+// rank. Assumes no particle crosses a whole slab between contact searches.
+void Domain::Migrate()
+{
+  const index_t N = data->OWNED_COUNT;
+  const int AXIS = data->DOMAIN_AXIS;
+  const double LO = data->DOMAIN_LO;
+  const double HI = data->DOMAIN_HI;
+  auto &POSITION = data->POSITION;
+  Kokkos::realloc(this->DOMAIN_FLAGS, N);
+  auto &FLAGS = this->DOMAIN_FLAGS;
+  Kokkos::parallel_for("DOMAIN_MIGRATE_FLAGS", N, KOKKOS_LAMBDA(const index_t idx) {
+    const double c = POSITION(idx)[AXIS];
+    FLAGS(idx) = c < LO ? LEAVE_LEFT : (c >= HI ? LEAVE_RIGHT : 0); });
+
+  auto toLeft = Select(FLAGS, N, LEAVE_LEFT, "DOMAIN_LEAVE_LEFT");
+  auto toRight = Select(FLAGS, N, LEAVE_RIGHT, "DOMAIN_LEAVE_RIGHT");
+  auto sendLeft = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), Pack(toLeft));
+  auto sendRight = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), Pack(toRight));
+
+  // Drop the leavers, keeping the order of the stayers.
+  if (toLeft.extent(0) + toRight.extent(0) > 0)
+  {
+    Kokkos::parallel_for("DOMAIN_INVERT_FLAGS", N, KOKKOS_LAMBDA(const index_t idx) { FLAGS(idx) = FLAGS(idx) ? 0 : 1; });
+    auto stay = Select(FLAGS, N, 1, "DOMAIN_STAY");
+    Gather(data->POSITION, stay);
+    Gather(data->VELOCITY, stay);
+#ifndef DENSEPACKING_LAZY_RADIUS
+    Gather(data->RADIUS, stay);
+#endif
+    Gather(data->OLD_RADIUS, stay);
+    Gather(data->MAX_OVERLAP, stay);
+    Gather(data->FIX, stay);
+    if (data->PERIODIC.any())
+      GatherImage(data->IMAGE, stay);
+    data->OWNED_COUNT = stay.extent(0);
+  }
+
+  auto fromRight = Parallel::SendRecv(sendLeft.data(), sendLeft.extent(0) * sizeof(ParticleRecord), left, right);
+  auto fromLeft = Parallel::SendRecv(sendRight.data(), sendRight.extent(0) * sizeof(ParticleRecord), right, left);
+
+  const index_t owned = data->OWNED_COUNT;
+  const index_t arrivedRight = fromRight.size() / sizeof(ParticleRecord);
+  const index_t arrivedLeft = fromLeft.size() / sizeof(ParticleRecord);
+  data->reserveParticles(owned + arrivedRight + arrivedLeft);
+  Unpack(fromLeft, owned);
+  Unpack(fromRight, owned + arrivedLeft);
+  data->OWNED_COUNT = owned + arrivedLeft + arrivedRight;
+  data->PARTICLE_COUNT = data->OWNED_COUNT;
+}
+
+// Rebuilds the ghost layer: owned particles within one contact-search cell
+// of the slab faces are mirrored on the neighbouring rank.
+void Domain::ExchangeHalo()
+{
+  const index_t N = data->OWNED_COUNT;
+  const int AXIS = data->DOMAIN_AXIS;
+  const double LO = data->DOMAIN_LO;
+  const double HI = data->DOMAIN_HI;
+  const bool HAS_LEFT = left >= 0;
+  const bool HAS_RIGHT = right >= 0;
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+
+  double max_radius = 0;
+  Kokkos::parallel_reduce("DOMAIN_MAX_RADIUS", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+    if (RADIUS(idx) > local)
+      local = RADIUS(idx); }, Kokkos::Max<double>(max_radius));
+  const double WIDTH = 2.0 * Parallel::AllreduceMax(max_radius) * HALO_SKIN;
+
+  Kokkos::realloc(this->DOMAIN_FLAGS, N);
+  auto &FLAGS = this->DOMAIN_FLAGS;
+  Kokkos::parallel_for("DOMAIN_HALO_FLAGS", N, KOKKOS_LAMBDA(const index_t idx) {
+    const double c = POSITION(idx)[AXIS];
+    int flag = 0;
+    if (HAS_LEFT && c < LO + WIDTH)
+      flag |= HALO_TO_LEFT;
+    if (HAS_RIGHT && c >= HI - WIDTH)
+      flag |= HALO_TO_RIGHT;
+    FLAGS(idx) = flag; });
+  HALO_LEFT = Select(FLAGS, N, HALO_TO_LEFT, "HALO_LEFT");
+  HALO_RIGHT = Select(FLAGS, N, HALO_TO_RIGHT, "HALO_RIGHT");
+  Memory::Record("Domain", "DOMAIN_FLAGS", this->DOMAIN_FLAGS);
+  Memory::Record("Domain", "HALO_LEFT", HALO_LEFT);
+  Memory::Record("Domain", "HALO_RIGHT", HALO_RIGHT);
+
+  UpdateHalo();
+}
+
+// Re-sends the current state of the HALO_LEFT/HALO_RIGHT particles into the
+// same ghost slots as the last ExchangeHalo.
+void Domain::UpdateHalo()
+{
+  auto sendLeft = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), Pack(HALO_LEFT));
+  auto sendRight = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), Pack(HALO_RIGHT));
+
+  auto fromRight = Parallel::SendRecv(sendLeft.data(), sendLeft.extent(0) * sizeof(ParticleRecord), left, right);
+  auto fromLeft = Parallel::SendRecv(sendRight.data(), sendRight.extent(0) * sizeof(ParticleRecord), right, left);
+
+  const index_t ghostsLeft = fromLeft.size() / sizeof(ParticleRecord);
+  const index_t ghostsRight = fromRight.size() / sizeof(ParticleRecord);
+  if (!data->CONTACT_SEARCH && (ghostsLeft != GHOSTS_LEFT || ghostsRight != GHOSTS_RIGHT))
+  {
+    std::cerr << "Domain::UpdateHalo: ghost count changed without a contact search.\n";
+    exit(1);
+  }
+  GHOSTS_LEFT = ghostsLeft;
+  GHOSTS_RIGHT = ghostsRight;
+  data->LEFT_GHOST_COUNT = ghostsLeft;
+
+  const index_t owned = data->OWNED_COUNT;
+  data->reserveParticles(owned + ghostsLeft + ghostsRight);
+  Unpack(fromLeft, owned);
+  Unpack(fromRight, owned + ghostsLeft);
+  data->PARTICLE_COUNT = owned + ghostsLeft + ghostsRight;
+}
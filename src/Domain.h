@@ -0,0 +1,46 @@
+#pragma once
+#include "AModule.h"
+
+// Everything a rank needs to own or mirror a particle.
+struct ParticleRecord
+{
+  Vec3 position;
+  Vec3 velocity;
+  double radius;
+  double old_radius;
+  double max_overlap;
+  int fix;
+  int image[3];
+};
+
+// MPI slab decomposition (see Data::DOMAIN_*). Runs before ContactSearch:
+// on contact-search steps it migrates owned particles that left the slab
+// during the previous Integrator step and rebuilds the ghost layer; on the
+// other steps it only refreshes the existing ghosts, because the neighbour
+// lists index ghost slots. A no-op on a single rank.
+class Domain : public AModule
+{
+public:
+  Domain(Data *data);
+  virtual void Initialization();
+  virtual std::string getModuleName();
+  void Migrate();
+  void ExchangeHalo();
+  void UpdateHalo();
+
+protected:
+  virtual void Processing();
+
+private:
+  Kokkos::View<ParticleRecord *> Pack(const Kokkos::View<index_t *> &ids);
+  void Unpack(const std::vector<char> &bytes, index_t offset);
+
+  Kokkos::View<int *> DOMAIN_FLAGS;
+  Kokkos::View<index_t *> HALO_LEFT;  // owned particles mirrored on the left rank
+  Kokkos::View<index_t *> HALO_RIGHT; // owned particles mirrored on the right rank
+  index_t GHOSTS_LEFT = 0;
+  index_t GHOSTS_RIGHT = 0;
+  int left = -1;
+  int right = -1;
+  double HALO_SKIN = 1.1;
+};
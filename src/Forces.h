@@ -1,6 +1,131 @@
 #pragma once
 #include "AModule.h"
 
+// The contact, wall and cylinder displacement of one particle, shared by the
+// FORCES kernel and the tiled step (TiledStep). Holds copies of the Views it
+// reads, so it can be captured by value.
+struct ParticleForces
+{
+  ParticleForces(const Data &data);
+
+  // Displacement of particle idx; maxas receives its largest overlap.
+  KOKKOS_INLINE_FUNCTION
+  Vec3 operator()(const index_t idx, double &maxas) const
+  {
+    Vec3 wall_min = WALL_MIN;
+    Vec3 wall_max = WALL_MAX;
+    double cylinder_radius = CYLINDER_RADIUS;
+    double relaxation_coefficient = simConstants.relaxation_coefficient;
+    if (ENSEMBLE)
+    {
+      const int system = SYSTEM_ID(idx);
+      wall_min = SYSTEM_WALL_MIN(system);
+      wall_max = SYSTEM_WALL_MAX(system);
+      cylinder_radius = SYSTEM_CYLINDER_RADIUS(system);
+      relaxation_coefficient = SYSTEM_RELAXATION(system);
+    }
+    int kiekis = NN_COUNT(idx);
+    Vec3 DISP(0, 0, 0);
+    Vec3 P1 = POSITION(idx);
+    double RADIUS1 = RADIUS(idx);
+    maxas = 0;
+    Vec3 F=Vec3(0,0,0);
+
+    for (int i = 0; i < kiekis; i++)
+    {
+      index_t pid = NEIGHBOURS(idx, i);
+      Vec3 P2 = POSITION(pid);
+      double RADIUS2 = RADIUS(pid);
+      Vec3 n_ij = BOX.MinimumImage(P1 - P2);
+      double h_ij = RADIUS1 + RADIUS2 - n_ij.length();
+      n_ij = n_ij.normalize();
+      if (h_ij < 0)
+        continue;
+      //Vec3 d = n_ij * h_ij * simConstants.relaxation_coefficient;
+      if (maxas < h_ij)
+        maxas = h_ij;
+
+      //F=F+ n_ij * (STIFFNESS * h_ij);
+     // F=F+ Jega(VELOCITY(idx),VELOCITY(pid),h_ij,n_ij,DENSITY*4.0/3.0*3.14159265359*RADIUS1*RADIUS1*RADIUS1,DENSITY*4.0/3.0*3.14159265359*RADIUS2*RADIUS2*RADIUS2,STIFFNESS,COR);
+     F=F+n_ij*h_ij*relaxation_coefficient;
+
+
+    }
+    for (int i = 0; i < 6; i++)
+    {
+      if (BOX.periodic[i / 2])
+        continue;
+      double h_ij = 0;
+      Vec3 n_ij = Vec3(0, 0, 0);
+      switch (i)
+      {
+      case 0:
+        n_ij.x = 1;
+        h_ij = RADIUS1 - fabs(wall_min.x - P1.x);
+        break;
+      case 1:
+        n_ij.x = -1;
+        h_ij = RADIUS1 - fabs(wall_max.x - P1.x);
+        break;
+      case 2:
+        n_ij.y = 1;
+        h_ij = RADIUS1 - fabs(wall_min.y - P1.y);
+        break;
+      case 3:
+        n_ij.y = -1;
+        h_ij = RADIUS1 - fabs(wall_max.y - P1.y);
+        break;
+      case 4:
+        n_ij.z = 1;
+        h_ij = RADIUS1 - fabs(wall_min.z - P1.z);
+        break;
+      case 5:
+        n_ij.z = -1;
+        h_ij = RADIUS1 - fabs(wall_max.z - P1.z);
+        break;
+      default:
+        break;
+      }
+
+      if (h_ij < 0)
+        continue;
+
+F=F+n_ij*h_ij*relaxation_coefficient;      //DISP = DISP + d;
+      if (maxas < h_ij)
+        maxas = h_ij;
+    }
+    double h_ij = (Kokkos::sqrt(P1.x * P1.x + P1.y * P1.y) + RADIUS1) - cylinder_radius;
+    if (CYLINDER && h_ij > 0)
+    {
+      Vec3 n_ij = Vec3(-P1.x, -P1.y, 0);
+      //Vec3 d = n_ij * h_ij * simConstants.relaxation_coefficient;
+      //DISP = DISP + d;
+F=F+n_ij*h_ij*relaxation_coefficient;      if (maxas < h_ij)
+        maxas = h_ij;
+    }
+    return F;
+  }
+
+  SimulationConstants simConstants;
+  double CYLINDER_RADIUS;
+  Kokkos::View<Vec3 *> POSITION;
+  RadiusField RADIUS;
+  Kokkos::View<int *> NN_COUNT;
+  NeighbourList NEIGHBOURS;
+  Vec3 WALL_MIN;
+  Vec3 WALL_MAX;
+  // Periodic axes have no walls, and the cylinder only applies when x and y are bounded.
+  PeriodicBox BOX;
+  bool CYLINDER;
+  // Ensemble mode: walls, cylinder and relaxation come from the particle's system.
+  bool ENSEMBLE;
+  Kokkos::View<int *> SYSTEM_ID;
+  Kokkos::View<Vec3 *> SYSTEM_WALL_MIN;
+  Kokkos::View<Vec3 *> SYSTEM_WALL_MAX;
+  Kokkos::View<double *> SYSTEM_CYLINDER_RADIUS;
+  Kokkos::View<double *> SYSTEM_RELAXATION;
+};
+
 class Forces : public AModule
 {
 public:
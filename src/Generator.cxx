@@ -0,0 +1,632 @@
+#include "Generator.h"
+#include "ContactSearch.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include <climits>
+#include <cstdint>
+
+Generator::Generator(Data *data) : AModule(data) {}
+std::string Generator::getModuleName() { return "Generator"; };
+
+namespace
+{
+  // Counter-based random numbers: the value depends only on (seed, particle,
+  // draw), so every backend, thread count and MPI rank generates the same
+  // configuration.
+  KOKKOS_INLINE_FUNCTION uint64_t SplitMix64(uint64_t x)
+  {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+  }
+
+  KOKKOS_INLINE_FUNCTION double Uniform(uint64_t seed, uint64_t particle, uint64_t draw)
+  {
+    const uint64_t bits = SplitMix64(SplitMix64(seed ^ (particle * 0xD1B54A32D192ED03ull)) + draw);
+    return (bits >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  // Region the free particles are placed in.
+  struct Container
+  {
+    Vec3 lo;
+    Vec3 hi;
+    int periodic[3];
+    bool cylinder;
+    double radius;
+
+    // Uniform centre for a particle of radius r that keeps it inside the
+    // walls; periodic axes use the whole box.
+    KOKKOS_INLINE_FUNCTION Vec3 Sample(double r, uint64_t seed, uint64_t particle, uint64_t round) const
+    {
+      const uint64_t draw = 4 * round;
+      Vec3 p;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        const double margin = periodic[axis] ? 0.0 : r;
+        p[axis] = lo[axis] + margin + Uniform(seed, particle, draw + axis) * (hi[axis] - lo[axis] - 2.0 * margin);
+      }
+      if (cylinder)
+      {
+        const double rho = Kokkos::fmax(radius - r, 0.0) * Kokkos::sqrt(Uniform(seed, particle, draw));
+        const double theta = 2.0 * Constants::PI * Uniform(seed, particle, draw + 1);
+        p.x = rho * Kokkos::cos(theta);
+        p.y = rho * Kokkos::sin(theta);
+      }
+      return p;
+    }
+  };
+
+  // Radius of free particle `idx`, already multiplied by
+  // simulation.initial_scale as Reader does for inputs.
+  struct RadiusSampler
+  {
+    uint64_t seed;
+    double rmin;
+    double rmax;
+    bool lognormal;
+    double scale;
+    double mu;
+    double sigma;
+
+    // Log-normal centred on the geometric mean with +-2 sigma spanning the range.
+    RadiusSampler(uint64_t seed, double rmin, double rmax, bool lognormal, double scale)
+        : seed(seed), rmin(rmin), rmax(rmax), lognormal(lognormal), scale(scale),
+          mu(0.5 * (std::log(rmin) + std::log(rmax))), sigma(0.25 * (std::log(rmax) - std::log(rmin))) {}
+
+    KOKKOS_INLINE_FUNCTION double operator()(index_t idx) const
+    {
+      double r;
+      if (lognormal)
+      {
+        const double u1 = Kokkos::fmax(Uniform(seed, idx, 0), 1E-300);
+        const double u2 = Uniform(seed, idx, 1);
+        const double normal = Kokkos::sqrt(-2.0 * Kokkos::log(u1)) * Kokkos::cos(2.0 * Constants::PI * u2);
+        r = Kokkos::fmin(Kokkos::fmax(Kokkos::exp(mu + sigma * normal), rmin), rmax);
+      }
+      else
+      {
+        r = rmin + (rmax - rmin) * Uniform(seed, idx, 0);
+      }
+      return r * scale;
+    }
+  };
+
+  // Cubic lattice sites in the (x, y) columns that fit the container: site i
+  // is height i % NZ of column COLUMNS(i / NZ), where column c = x * NY + y.
+  struct Lattice
+  {
+    Vec3 lo;
+    Vec3 extent;
+    int NX;
+    int NY;
+    int NZ;
+    Kokkos::View<int *> COLUMNS;
+
+    KOKKOS_INLINE_FUNCTION Vec3 Site(index_t i) const
+    {
+      const int c = COLUMNS(i / NZ);
+      return Vec3(lo.x + (c / NY + 0.5) * extent.x / NX,
+                  lo.y + (c % NY + 0.5) * extent.y / NY,
+                  lo.z + (i % NZ + 0.5) * extent.z / NZ);
+    }
+  };
+}
+
+void Generator::Initialization()
+{
+  auto config = data->yaml.config["generator"];
+  if (!config["count"] || !config["radius_min"] || !config["radius_max"])
+  {
+    std::cerr << "Generator::Initialization: generator.count, generator.radius_min and generator.radius_max are required.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  if (data->ENSEMBLE)
+  {
+    std::cerr << "Generator::Initialization: the generator cannot be combined with ensemble mode.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  particle_count = config["count"].as<index_t>();
+  radius_min = config["radius_min"].as<double>();
+  radius_max = config["radius_max"].as<double>();
+  cylinder = config["container"] && config["container"].as<std::string>() == "cylinder";
+  lattice = config["placement"] && config["placement"].as<std::string>() == "lattice";
+  lognormal = config["distribution"] && config["distribution"].as<std::string>() == "lognormal";
+  seed = config["seed"] ? config["seed"].as<unsigned long>() : 1;
+  max_rounds = config["max_rounds"] ? config["max_rounds"].as<int>() : 100;
+  fix_radius = config["fix_radius"] ? config["fix_radius"].as<double>() : radius_min;
+  if (config["fix_shell"])
+  {
+    auto shell = config["fix_shell"].as<std::vector<int>>();
+    for (int axis = 0; axis < 3 && axis < (int)shell.size(); ++axis)
+      fix_shell[axis] = shell[axis] != 0 && !data->PERIODIC.periodic[axis];
+  }
+  if (particle_count <= 0 || radius_min <= 0.0 || radius_max < radius_min)
+  {
+    std::cerr << "Generator::Initialization: need count > 0 and 0 < radius_min <= radius_max.\n";
+    data->COMPUTE = false;
+    return;
+  }
+
+  std::vector<Vec3> shell = ShellPoints();
+  const index_t first = shell.size();
+  // Refuse to start before allocating when the run would not fit in
+  // memory.budget_gb; the particles split evenly over the ranks.
+  const double scale = data->simConstants.initial_scale;
+  const double lowest = first > 0 ? std::min(radius_min * scale, fix_radius) : radius_min * scale;
+  const double highest = first > 0 ? std::max(radius_max * scale, fix_radius) : radius_max * scale;
+  const index_t per_rank = (first + particle_count + Parallel::Size() - 1) / Parallel::Size();
+  if (!Memory::CheckBudget(*data, per_rank, Data::neighbourCapacity(lowest, highest)))
+  {
+    data->COMPUTE = false;
+    return;
+  }
+  const bool placed = lattice ? PlaceLattice(shell, particle_count) : PlaceRandom(shell, particle_count);
+  if (!placed)
+  {
+    data->COMPUTE = false;
+    return;
+  }
+  KeepOwned();
+  Kokkos::deep_copy(data->OLD_RADIUS, data->RADIUS);
+
+  auto &RADIUS = data->RADIUS;
+  double min_radius = std::numeric_limits<double>::max();
+  double max_radius = std::numeric_limits<double>::lowest();
+  Kokkos::parallel_reduce("GENERATOR_MIN_RADIUS", data->PARTICLE_COUNT, KOKKOS_LAMBDA(const index_t idx, double &local) {
+    if (RADIUS(idx) < local)
+      local = RADIUS(idx); }, Kokkos::Min<double>(min_radius));
+  Kokkos::parallel_reduce("GENERATOR_MAX_RADIUS", data->PARTICLE_COUNT, KOKKOS_LAMBDA(const index_t idx, double &local) {
+    if (RADIUS(idx) > local)
+      local = RADIUS(idx); }, Kokkos::Max<double>(max_radius));
+  min_radius = Parallel::AllreduceMin(min_radius);
+  max_radius = Parallel::AllreduceMax(max_radius);
+
+  if (Parallel::IsRoot())
+    std::cout << "Generated " << particle_count << " particles (" << (lattice ? "lattice" : "random sequential addition") << ", "
+              << (cylinder ? "cylinder" : "box") << ") and " << first << " fixed shell particles\n";
+  if (Parallel::Size() > 1)
+    std::cout << "Rank " << Parallel::Rank() << " owns " << data->PARTICLE_COUNT << " particles\n";
+  std::cout << "Particles: " << data->PARTICLE_COUNT << ", Min radius: " << min_radius << ", Max radius: " << max_radius << std::endl;
+  data->allocateNeighbours(min_radius, max_radius);
+}
+
+void Generator::Processing() {}
+
+// Free particles stay clear of the fixed shells.
+Vec3 Generator::InnerMin() const
+{
+  Vec3 lo = data->WALL_MIN;
+  if (!cylinder)
+    for (int axis = 0; axis < 3; ++axis)
+      lo[axis] += fix_shell[axis] ? 2.0 * fix_radius : 0.0;
+  else if (fix_shell[2])
+    lo.z += 2.0 * fix_radius;
+  return lo;
+}
+
+Vec3 Generator::InnerMax() const
+{
+  Vec3 hi = data->WALL_MAX;
+  if (!cylinder)
+    for (int axis = 0; axis < 3; ++axis)
+      hi[axis] -= fix_shell[axis] ? 2.0 * fix_radius : 0.0;
+  else if (fix_shell[2])
+    hi.z -= 2.0 * fix_radius;
+  return hi;
+}
+
+// Square grids of touching fixed particles on the flagged faces, as
+// scripts/GenBoxBoundaries.py does; for a cylinder the z flag gives the two
+// end disks (scripts/GenCylinderInitial.py) and an x or y flag the mantle.
+std::vector<Vec3> Generator::ShellPoints() const
+{
+  std::vector<Vec3> points;
+  const double r = fix_radius;
+  const Vec3 lo = data->WALL_MIN;
+  const Vec3 hi = data->WALL_MAX;
+  auto steps = [&](double from, double to)
+  { return std::max(1, (int)std::floor((to - from) / (2.0 * r)) + 1); };
+
+  if (!cylinder)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (!fix_shell[axis])
+        continue;
+      const int b = (axis + 1) % 3;
+      const int c = (axis + 2) % 3;
+      // Edges shared with the faces of a lower flagged axis are already
+      // there; this face starts one particle further in, as the mantle does.
+      const double ib = fix_shell[b] && b < axis ? 3.0 * r : r;
+      const double ic = fix_shell[c] && c < axis ? 3.0 * r : r;
+      const int nb = steps(lo[b] + ib, hi[b] - ib);
+      const int nc = steps(lo[c] + ic, hi[c] - ic);
+      const double db = nb > 1 ? (hi[b] - lo[b] - 2.0 * ib) / (nb - 1) : 0.0;
+      const double dc = nc > 1 ? (hi[c] - lo[c] - 2.0 * ic) / (nc - 1) : 0.0;
+      for (double face : {lo[axis] + r, hi[axis] - r})
+        for (int i = 0; i < nb; ++i)
+          for (int j = 0; j < nc; ++j)
+          {
+            Vec3 p;
+            p[axis] = face;
+            p[b] = nb > 1 ? lo[b] + ib + i * db : 0.5 * (lo[b] + hi[b]);
+            p[c] = nc > 1 ? lo[c] + ic + j * dc : 0.5 * (lo[c] + hi[c]);
+            points.push_back(p);
+          }
+    }
+    return points;
+  }
+
+  const double R = data->cylinder_radius;
+  if (fix_shell[2])
+  {
+    const int n = (int)std::floor(R / r);
+    for (double z : {lo.z + r, hi.z - r})
+      for (int i = -n; i <= n; ++i)
+        for (int j = -n; j <= n; ++j)
+        {
+          const double x = 2.0 * r * i;
+          const double y = 2.0 * r * j;
+          if (std::sqrt(x * x + y * y) + r <= R)
+            points.push_back(Vec3(x, y, z));
+        }
+  }
+  if (fix_shell[0] || fix_shell[1])
+  {
+    const double ring = R - r;
+    const int around = std::max(1, (int)std::floor(Constants::PI * ring / r));
+    const double z0 = lo.z + (fix_shell[2] ? 3.0 * r : r);
+    const double z1 = hi.z - (fix_shell[2] ? 3.0 * r : r);
+    const int layers = steps(z0, z1);
+    for (int k = 0; k < layers; ++k)
+      for (int a = 0; a < around; ++a)
+      {
+        const double theta = 2.0 * Constants::PI * a / around;
+        const double z = layers > 1 ? z0 + k * (z1 - z0) / (layers - 1) : 0.5 * (z0 + z1);
+        points.push_back(Vec3(ring * std::cos(theta), ring * std::sin(theta), z));
+      }
+  }
+  return points;
+}
+
+// Keeps the shell points with p[DOMAIN_AXIS] in [lo, hi) and allocates room
+// for `room` free particles behind them; returns the number kept.
+index_t Generator::StoreShell(const std::vector<Vec3> &shell, double lo, double hi, index_t room)
+{
+  std::vector<Vec3> kept;
+  for (const Vec3 &p : shell)
+    if (p[data->DOMAIN_AXIS] >= lo && p[data->DOMAIN_AXIS] < hi)
+      kept.push_back(p);
+  const index_t first = kept.size();
+  data->allocateParticles(first + room);
+  auto POSITION_host = Kokkos::create_mirror_view(data->POSITION);
+  auto RADIUS_host = Kokkos::create_mirror_view(data->RADIUS);
+  auto FIX_host = Kokkos::create_mirror_view(data->FIX);
+  Kokkos::deep_copy(POSITION_host, data->POSITION);
+  Kokkos::deep_copy(RADIUS_host, data->RADIUS);
+  Kokkos::deep_copy(FIX_host, data->FIX);
+  for (index_t i = 0; i < first; ++i)
+  {
+    POSITION_host(i) = kept[i];
+    RADIUS_host(i) = fix_radius;
+    FIX_host(i) = 1;
+  }
+  Kokkos::deep_copy(data->POSITION, POSITION_host);
+  Kokkos::deep_copy(data->RADIUS, RADIUS_host);
+  Kokkos::deep_copy(data->FIX, FIX_host);
+  return first;
+}
+
+// Simple cubic lattice filling the container; the spacing is the largest one
+// that still provides `count` sites. Each rank stores only the sites in its
+// slab.
+bool Generator::PlaceLattice(const std::vector<Vec3> &shell, index_t count)
+{
+  // Sites keep the largest particle inside the walls (periodic axes wrap).
+  const double margin = radius_max * data->simConstants.initial_scale;
+  const double inner_radius = data->cylinder_radius - ((fix_shell[0] || fix_shell[1]) ? 2.0 * fix_radius : 0.0) - margin;
+  Vec3 lo = cylinder ? Vec3(-inner_radius, -inner_radius, InnerMin().z) : InnerMin();
+  Vec3 hi = cylinder ? Vec3(inner_radius, inner_radius, InnerMax().z) : InnerMax();
+  for (int axis = 0; axis < 3; ++axis)
+    if (!data->PERIODIC.periodic[axis] && !(cylinder && axis < 2))
+    {
+      lo[axis] += margin;
+      hi[axis] -= margin;
+    }
+  const Vec3 extent = hi - lo;
+  const bool CYLINDER = cylinder;
+  const double volume = cylinder ? Constants::PI * inner_radius * inner_radius * extent.z : extent.x * extent.y * extent.z;
+  if (extent.x <= 0 || extent.y <= 0 || extent.z <= 0 || (cylinder && inner_radius <= 0))
+  {
+    std::cerr << "Generator::PlaceLattice: the container is smaller than one particle.\n";
+    return false;
+  }
+
+  double spacing = std::cbrt(volume / count);
+  int nx = 0, ny = 0, nz = 0;
+  int sites = 0;
+  for (int attempt = 0; attempt < 1000 && sites < count; ++attempt, spacing *= 0.99)
+  {
+    nx = std::max(1, (int)std::floor(extent.x / spacing));
+    ny = std::max(1, (int)std::floor(extent.y / spacing));
+    nz = std::max(1, (int)std::floor(extent.z / spacing));
+    if ((double)nx * ny * nz > INT_MAX)
+      break;
+    const int NX = nx, NY = ny, NZ = nz;
+    const double R2 = inner_radius * inner_radius;
+    sites = 0;
+    Kokkos::parallel_reduce("GENERATOR_LATTICE_COUNT", NX * NY * NZ, KOKKOS_LAMBDA(const int s, int &sum) {
+      const double x = lo.x + (s / (NY * NZ) + 0.5) * extent.x / NX;
+      const double y = lo.y + ((s / NZ) % NY + 0.5) * extent.y / NY;
+      if (!CYLINDER || x * x + y * y <= R2)
+        sum++; }, sites);
+  }
+  if (sites < count)
+  {
+    std::cerr << "Generator::PlaceLattice: cannot fit " << count << " lattice sites into the container.\n";
+    return false;
+  }
+  if (Parallel::IsRoot() && spacing < 2.0 * radius_max * data->simConstants.initial_scale)
+    std::cout << "Generator: lattice spacing " << spacing << " is below the largest initial diameter; particles start overlapped.\n";
+
+  Lattice LATTICE;
+  LATTICE.lo = lo;
+  LATTICE.extent = extent;
+  LATTICE.NX = nx;
+  LATTICE.NY = ny;
+  LATTICE.NZ = nz;
+  LATTICE.COLUMNS = Kokkos::View<int *>("GENERATOR_COLUMNS", nx * ny);
+  auto &COLUMNS = LATTICE.COLUMNS;
+  const int NX = nx, NY = ny;
+  const double R2 = inner_radius * inner_radius;
+  Kokkos::parallel_scan("GENERATOR_LATTICE_COLUMNS", NX * NY, KOKKOS_LAMBDA(const int c, int &offset, const bool final) {
+    const double x = lo.x + (c / NY + 0.5) * extent.x / NX;
+    const double y = lo.y + (c % NY + 0.5) * extent.y / NY;
+    if (CYLINDER && x * x + y * y > R2)
+      return;
+    if (final)
+      COLUMNS(offset) = c;
+    offset++; });
+
+  const int AXIS = data->DOMAIN_AXIS;
+  const double LO = data->DOMAIN_LO;
+  const double HI = data->DOMAIN_HI;
+  index_t owned = 0;
+  Kokkos::parallel_reduce("GENERATOR_LATTICE_OWNED", count, KOKKOS_LAMBDA(const index_t i, index_t &sum) {
+    const double c = LATTICE.Site(i)[AXIS];
+    if (c >= LO && c < HI)
+      sum++; }, owned);
+
+  const RadiusSampler RADII(seed, radius_min, radius_max, lognormal, data->simConstants.initial_scale);
+  const index_t SHELL = shell.size();
+  const index_t first = StoreShell(shell, LO, HI, owned);
+  auto &POSITION = data->POSITION;
+  auto &RADIUS = data->RADIUS;
+  Kokkos::parallel_scan("GENERATOR_LATTICE", count, KOKKOS_LAMBDA(const index_t i, index_t &offset, const bool final) {
+    const Vec3 p = LATTICE.Site(i);
+    if (p[AXIS] < LO || p[AXIS] >= HI)
+      return;
+    if (final)
+    {
+      POSITION(first + offset) = p;
+      RADIUS(first + offset) = RADII(SHELL + i);
+    }
+    offset++; });
+  return true;
+}
+
+// Random sequential addition. Every round draws new centres for the particles
+// not placed yet, finds neighbours with ContactSearch and accepts a candidate
+// only if it overlaps neither a placed particle nor an earlier candidate.
+// A candidate draws with the slot it takes in the serial order (placed count
+// plus its position among the pending particles), so the packing does not
+// depend on the rank count. With MPI a rank holds only the placed particles
+// and candidates within a halo of its slab, decides the candidates centred
+// in the slab, and the per-particle ACCEPTED flags are summed over the ranks.
+bool Generator::PlaceRandom(const std::vector<Vec3> &shell, index_t count)
+{
+  Container container;
+  container.lo = InnerMin();
+  container.hi = InnerMax();
+  for (int axis = 0; axis < 3; ++axis)
+    container.periodic[axis] = data->PERIODIC.periodic[axis];
+  container.cylinder = cylinder;
+  container.radius = data->cylinder_radius - ((fix_shell[0] || fix_shell[1]) ? 2.0 * fix_radius : 0.0);
+
+  const index_t SHELL = shell.size();
+  const index_t total = SHELL + count;
+  const double max_radius = std::max(radius_max * data->simConstants.initial_scale, SHELL > 0 ? fix_radius : 0.0);
+  const double min_radius = std::min(radius_min * data->simConstants.initial_scale, SHELL > 0 ? fix_radius : radius_max);
+  // Anything overlapping a slab candidate lies within one largest diameter
+  // of the slab; the halo adds a margin on top.
+  const int AXIS = data->DOMAIN_AXIS;
+  const double OWN_LO = data->DOMAIN_LO;
+  const double OWN_HI = data->DOMAIN_HI;
+  const double LO = OWN_LO - 2.5 * max_radius;
+  const double HI = OWN_HI + 2.5 * max_radius;
+  const int ranks = Parallel::Size();
+  index_t local = StoreShell(shell, LO, HI, ranks == 1 ? count : count / ranks + 64);
+
+  // Neighbour lists for the local set are needed during placement. The free
+  // slots hold the largest radius until the first round fills them, so that
+  // the search grid fits every candidate; ResetTables grows the tables when
+  // the halo brings in more particles.
+  auto &RADIUS_BOUND = data->RADIUS;
+  const index_t SHELL_LOCAL = local;
+  Kokkos::parallel_for("GENERATOR_RADIUS_BOUND", data->PARTICLE_COUNT - local, KOKKOS_LAMBDA(const index_t k) {
+    RADIUS_BOUND(SHELL_LOCAL + k) = max_radius; });
+  data->allocateNeighbours(min_radius, max_radius);
+  ContactSearch search(data);
+  search.Initialization();
+  if (!data->COMPUTE)
+    return false;
+
+  const RadiusSampler RADII(seed, radius_min, radius_max, lognormal, data->simConstants.initial_scale);
+  const PeriodicBox BOX = data->PERIODIC;
+  const uint64_t SEED = seed;
+  // Per free particle, on every rank.
+  Kokkos::View<int *> PENDING("GENERATOR_PENDING", count);
+  Kokkos::View<int *> ACCEPTED("GENERATOR_ACCEPTED", count);
+  Kokkos::View<index_t *> SLOT("GENERATOR_SLOT", count);
+  auto ACCEPTED_host = Kokkos::create_mirror_view(ACCEPTED);
+  Kokkos::deep_copy(PENDING, 1);
+  // Per local candidate: its free particle and the compaction buffers.
+  Kokkos::View<index_t *> CANDIDATE;
+  Kokkos::View<Vec3 *> TMP_POSITION;
+  Kokkos::View<double *> TMP_RADIUS;
+
+  index_t placed = SHELL;
+  for (int round = 0; round < max_rounds && placed < total; ++round)
+  {
+    const index_t PLACED = placed;
+    Kokkos::parallel_scan("GENERATOR_SLOTS", count, KOKKOS_LAMBDA(const index_t k, index_t &offset, const bool final) {
+      if (!PENDING(k))
+        return;
+      if (final)
+        SLOT(k) = PLACED + offset;
+      offset++; });
+    index_t candidates = 0;
+    Kokkos::parallel_reduce("GENERATOR_REGION", count, KOKKOS_LAMBDA(const index_t k, index_t &sum) {
+      if (!PENDING(k))
+        return;
+      const double c = container.Sample(RADII(SHELL + k), SEED, SLOT(k), round + 1)[AXIS];
+      if (c >= LO && c < HI)
+        sum++; }, candidates);
+
+    const index_t from = local;
+    data->reserveParticles(from + candidates);
+    if ((index_t)CANDIDATE.extent(0) < candidates)
+    {
+      const index_t capacity = data->POSITION.extent(0);
+      CANDIDATE = Kokkos::View<index_t *>("GENERATOR_CANDIDATE", capacity);
+      TMP_POSITION = Kokkos::View<Vec3 *>("GENERATOR_POSITION", capacity);
+      TMP_RADIUS = Kokkos::View<double *>("GENERATOR_RADIUS", capacity);
+    }
+    Memory::Record("Generator", "PLACEMENT", count * (2 * sizeof(int) + sizeof(index_t)) + CANDIDATE.extent(0) * (sizeof(index_t) + sizeof(Vec3) + sizeof(double)));
+    data->PARTICLE_COUNT = data->OWNED_COUNT = from + candidates;
+
+    // Candidates in this rank's region, appended in particle order.
+    auto &POSITION = data->POSITION;
+    auto &RADIUS = data->RADIUS;
+    auto &NN_COUNT = data->NN_COUNT;
+    Kokkos::parallel_scan("GENERATOR_CANDIDATES", count, KOKKOS_LAMBDA(const index_t k, index_t &offset, const bool final) {
+      if (!PENDING(k))
+        return;
+      const double r = RADII(SHELL + k);
+      const Vec3 p = container.Sample(r, SEED, SLOT(k), round + 1);
+      if (p[AXIS] < LO || p[AXIS] >= HI)
+        return;
+      if (final)
+      {
+        POSITION(from + offset) = p;
+        RADIUS(from + offset) = r;
+        CANDIDATE(offset) = k;
+      }
+      offset++; });
+
+    search.ResetTables();
+    search.CalculateHash();
+    search.SortByCell();
+    search.FindCellBounds();
+    search.FindNeighbours(from);
+    // Taken after the search, which may have grown the compressed lists.
+    const NeighbourList NEIGHBOURS = data->Neighbours();
+
+    Kokkos::deep_copy(ACCEPTED, 0);
+    Kokkos::parallel_for("GENERATOR_ACCEPT", candidates, KOKKOS_LAMBDA(const index_t c) {
+      const index_t idx = from + c;
+      const Vec3 p = POSITION(idx);
+      if (p[AXIS] < OWN_LO || p[AXIS] >= OWN_HI)
+        return;
+      int ok = 1;
+      for (int n = 0; n < NN_COUNT(idx) && ok; ++n)
+      {
+        const index_t pid = NEIGHBOURS(idx, n);
+        if (pid < idx && BOX.MinimumImage(POSITION(pid) - p).length() < RADIUS(pid) + RADIUS(idx))
+          ok = 0;
+      }
+      ACCEPTED(CANDIDATE(c)) = ok; });
+    // Every candidate is centred in exactly one slab.
+    if (ranks > 1)
+    {
+      Kokkos::deep_copy(ACCEPTED_host, ACCEPTED);
+      Parallel::AllreduceSum(ACCEPTED_host.data(), (size_t)count);
+      Kokkos::deep_copy(ACCEPTED, ACCEPTED_host);
+    }
+
+    // Accepted candidates move up behind the placed ones; rejected ones draw
+    // again next round.
+    index_t kept = 0;
+    Kokkos::parallel_reduce("GENERATOR_KEPT", candidates, KOKKOS_LAMBDA(const index_t c, index_t &sum) {
+      sum += ACCEPTED(CANDIDATE(c)); }, kept);
+    Kokkos::parallel_scan("GENERATOR_PARTITION", candidates, KOKKOS_LAMBDA(const index_t c, index_t &offset, const bool final) {
+      if (!ACCEPTED(CANDIDATE(c)))
+        return;
+      if (final)
+      {
+        TMP_POSITION(offset) = POSITION(from + c);
+        TMP_RADIUS(offset) = RADIUS(from + c);
+      }
+      offset++; });
+    Kokkos::parallel_for("GENERATOR_COMMIT", kept, KOKKOS_LAMBDA(const index_t c) {
+      POSITION(from + c) = TMP_POSITION(c);
+      RADIUS(from + c) = TMP_RADIUS(c); });
+    local = from + kept;
+
+    index_t accepted = 0;
+    Kokkos::parallel_reduce("GENERATOR_PENDING", count, KOKKOS_LAMBDA(const index_t k, index_t &sum) {
+      PENDING(k) -= ACCEPTED(k);
+      sum += ACCEPTED(k); }, accepted);
+    placed += accepted;
+  }
+  data->PARTICLE_COUNT = data->OWNED_COUNT = local;
+  Memory::Record("Generator", "PLACEMENT", (size_t)0);
+
+  if (placed < total)
+  {
+    std::cerr << "Generator::PlaceRandom: placed only " << placed - SHELL << " of " << count << " particles in "
+              << max_rounds << " rounds; lower simulation.initial_scale or raise generator.max_rounds.\n";
+    return false;
+  }
+  return true;
+}
+
+// With MPI each rank keeps the particles in its slab; the halo was only
+// needed for placement.
+void Generator::KeepOwned()
+{
+  if (Parallel::Size() == 1)
+    return;
+  const auto ALL_POSITION = data->POSITION;
+  const auto ALL_RADIUS = data->RADIUS;
+  const auto ALL_FIX = data->FIX;
+  const index_t total = data->PARTICLE_COUNT;
+  const int AXIS = data->DOMAIN_AXIS;
+  const double LO = data->DOMAIN_LO;
+  const double HI = data->DOMAIN_HI;
+
+  index_t owned = 0;
+  Kokkos::parallel_reduce("GENERATOR_OWNED", total, KOKKOS_LAMBDA(const index_t idx, index_t &sum) {
+    const double c = ALL_POSITION(idx)[AXIS];
+    if (c >= LO && c < HI)
+      sum++; }, owned);
+  data->allocateParticles(owned);
+  auto &POSITION = data->POSITION;
+  auto &RADIUS = data->RADIUS;
+  auto &FIX = data->FIX;
+  Kokkos::parallel_scan("GENERATOR_KEEP_OWNED", total, KOKKOS_LAMBDA(const index_t idx, index_t &offset, const bool final) {
+    const double c = ALL_POSITION(idx)[AXIS];
+    if (c < LO || c >= HI)
+      return;
+    if (final)
+    {
+      POSITION(offset) = ALL_POSITION(idx);
+      RADIUS(offset) = ALL_RADIUS(idx);
+      FIX(offset) = ALL_FIX(idx);
+    }
+    offset++; });
+}
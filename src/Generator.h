@@ -0,0 +1,42 @@
+#pragma once
+#include "AModule.h"
+#include <vector>
+
+// Builds the initial configuration from the config.yaml "generator" section
+// instead of reading simulation.input. Radii are sampled and particles
+// placed on the device, either on a cubic lattice or by random sequential
+// addition checked on the ContactSearch grid, inside the box or cylinder
+// container. Optional FIX shells line the container faces. Every particle
+// is a function of its index and the seed; with MPI a rank only builds its
+// slab (plus a halo during random placement), and the result does not
+// depend on the rank count.
+class Generator : public AModule
+{
+public:
+  Generator(Data *data);
+  virtual void Initialization();
+  virtual std::string getModuleName();
+
+protected:
+  virtual void Processing();
+
+private:
+  std::vector<Vec3> ShellPoints() const;
+  index_t StoreShell(const std::vector<Vec3> &shell, double lo, double hi, index_t room);
+  bool PlaceLattice(const std::vector<Vec3> &shell, index_t count);
+  bool PlaceRandom(const std::vector<Vec3> &shell, index_t count);
+  void KeepOwned();
+  Vec3 InnerMin() const;
+  Vec3 InnerMax() const;
+
+  index_t particle_count = 0;
+  bool cylinder = false;
+  bool lattice = false;
+  bool lognormal = false;
+  double radius_min = 0;
+  double radius_max = 0;
+  double fix_radius = 0;
+  int fix_shell[3] = {0, 0, 0};
+  unsigned long seed = 1;
+  int max_rounds = 100;
+};
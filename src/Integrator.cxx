@@ -1,4 +1,6 @@
 #include "Integrator.h"
+#include "Tuning.h"
+#include "Parallel.h"
 // removed unused Kokkos_StdAlgorithms include
 
 Integrator::Integrator(Data *data) : AModule(data) {}
@@ -16,30 +18,66 @@ void Integrator::Processing()
 void Integrator::RunKernels()
 {
   (void)0; // no local copy of simConstants needed here
-  const int N = data->PARTICLE_COUNT;
+  const index_t N = data->OWNED_COUNT;
   auto &POSITION = data->POSITION;
   auto &RADIUS = data->RADIUS;
   auto &VELOCITY = data->VELOCITY;
-  auto &FORCE = data->FORCE;
   auto &FIX = data->FIX;
+  auto &IMAGE = data->IMAGE;
+  const PeriodicBox BOX = data->PERIODIC;
 
-  Kokkos::parallel_for("INTEGRATION", N, KOKKOS_LAMBDA(const int idx) {
+  Tuning::For("INTEGRATION", 0, N, KOKKOS_LAMBDA(const index_t idx) {
     if (FIX(idx) > 0)
       return;
-    Vec3 pos = POSITION(idx);
-    Vec3 vel = VELOCITY(idx);
-    pos+=vel;
-    POSITION(idx) = pos;
+    POSITION(idx) = Advance(idx, POSITION(idx), VELOCITY(idx), BOX, IMAGE);
   });
     Kokkos::fence();
 
+    if (data->ENSEMBLE)
+    {
+      ReduceSystemOverlaps();
+      return;
+    }
+
      auto MAX_OVERLAP_host = Kokkos::create_mirror_view(data->MAX_OVERLAP);
     Kokkos::deep_copy(MAX_OVERLAP_host, data->MAX_OVERLAP);
     Kokkos::fence();
     double max_val = 0.0;
-    for (int i = 0; i < N; ++i) {
+    for (index_t i = 0; i < N; ++i) {
       if (MAX_OVERLAP_host(i) > max_val) max_val = MAX_OVERLAP_host(i);
     }
-    data->simConstants.maxOverlap = max_val;
+    // The growth decision in RadiusScaler must be the same on every rank.
+    data->simConstants.maxOverlap = Parallel::AllreduceMax(max_val);
+
+}
+
+// One team per system: systems are contiguous, so each team reduces its own
+// [offset, offset + count) range and all systems finish in a single launch.
+void Integrator::ReduceSystemOverlaps()
+{
+  auto &MAX_OVERLAP = data->MAX_OVERLAP;
+  auto &SYSTEM_OFFSET = data->SYSTEM_OFFSET;
+  auto &SYSTEM_MAX_OVERLAP = data->SYSTEM_MAX_OVERLAP;
+  const int SYSTEMS = data->systems.size();
+
+  typedef Kokkos::TeamPolicy<>::member_type member_type;
+  Tuning::TeamFor("SYSTEM_MAX_OVERLAP", SYSTEMS, KOKKOS_LAMBDA(const member_type &team) {
+    const int system = team.league_rank();
+    double max_val = 0.0;
+    Kokkos::parallel_reduce(Kokkos::TeamThreadRange(team, SYSTEM_OFFSET(system), SYSTEM_OFFSET(system + 1)), [&](const index_t idx, double &local) {
+      if (MAX_OVERLAP(idx) > local) local = MAX_OVERLAP(idx);
+    }, Kokkos::Max<double>(max_val));
+    if (team.team_rank() == 0)
+      SYSTEM_MAX_OVERLAP(system) = max_val;
+  });
 
+  auto SYSTEM_MAX_OVERLAP_host = Kokkos::create_mirror_view(SYSTEM_MAX_OVERLAP);
+  Kokkos::deep_copy(SYSTEM_MAX_OVERLAP_host, SYSTEM_MAX_OVERLAP);
+  double max_val = 0.0;
+  for (int s = 0; s < SYSTEMS; ++s)
+  {
+    data->systems[s].simConstants.maxOverlap = SYSTEM_MAX_OVERLAP_host(s);
+    if (SYSTEM_MAX_OVERLAP_host(s) > max_val) max_val = SYSTEM_MAX_OVERLAP_host(s);
+  }
+  data->simConstants.maxOverlap = max_val;
 }
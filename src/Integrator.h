@@ -8,7 +8,24 @@ public:
   virtual void Initialization();
   virtual std::string getModuleName();
   void RunKernels();
+  // Ensemble mode: per-system maxOverlap in one team-parallel launch.
+  void ReduceSystemOverlaps();
+  // Moves particle idx from pos by its displacement. Periodic axes wrap the
+  // position back into the box and count the crossing in IMAGE(idx).
+  KOKKOS_INLINE_FUNCTION
+  static Vec3 Advance(const index_t idx, Vec3 pos, const Vec3 &displacement, const PeriodicBox &BOX, const Kokkos::View<int *[3]> &IMAGE)
+  {
+    pos += displacement;
+    if (BOX.any())
+    {
+      int image[3] = {IMAGE(idx, 0), IMAGE(idx, 1), IMAGE(idx, 2)};
+      BOX.Wrap(pos, image);
+      for (int axis = 0; axis < 3; ++axis)
+        IMAGE(idx, axis) = image[axis];
+    }
+    return pos;
+  }
 
 protected:
   void Processing();
-};
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "Memory.h"
+#include "Data.h"
+#include "Parallel.h"
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  std::map<std::string, std::map<std::string, size_t>> ledger;
+  size_t current = 0;
+  size_t peak = 0;
+
+  double MB(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+  // A missing section of the (const) config comes back as an invalid node that
+  // cannot be indexed further; an empty node can.
+  YAML::Node Section(const Data &data, const char *name)
+  {
+    return data.config[name] ? data.config[name] : YAML::Node();
+  }
+
+  void PrintRow(std::ostream &out, const std::string &name, size_t bytes)
+  {
+    out << "  " << std::left << std::setw(16) << name << std::right << std::setw(12) << std::fixed
+        << std::setprecision(1) << MB(bytes) << " MB\n";
+  }
+
+  // Estimated bytes per subsystem for one rank holding `N` particles. The
+  // per-particle sizes mirror the Views of each module; the Writer bonds
+  // assume four kept contacts per particle.
+  std::vector<std::pair<std::string, size_t>> Estimate(const Data &data, long N, int nn_max)
+  {
+    const bool periodic = data.PERIODIC.any();
+    // Ghost particles and migration headroom (Data::reserveParticles).
+    const long capacity = Parallel::Size() > 1 ? (long)(N * 1.2) + 64 : N;
+    std::vector<std::pair<std::string, size_t>> parts;
+    size_t particle = 80 + sizeof(neighbour_t) * (size_t)nn_max;
+    if (periodic)
+      particle += 12;
+    if (data.ENSEMBLE)
+      particle += 4;
+#ifdef DENSEPACKING_NEIGHBOUR16
+    // NN_ROW and the initial NN_FAR rows (one list in 64).
+    particle += sizeof(int) + sizeof(index_t) * (size_t)nn_max / 64;
+#endif
+#ifdef DENSEPACKING_LAZY_RADIUS
+    // No RADIUS next to the base radii.
+    particle -= sizeof(double);
+#endif
+    parts.push_back({"Data", capacity * particle});
+    if (data.config["tiling"])
+      parts.push_back({"TiledStep", capacity * sizeof(Vec3)});
+    // CELL_ID, PARTICLE_ID, two hash tables of 2N entries and sort scratch.
+    parts.push_back({"ContactSearch", capacity * 8 * sizeof(index_t)});
+    parts.push_back({"Writer", N * (size_t)(12 + 48 + (periodic ? 12 : 0) + 4 * 8)});
+    // Random placement flags for every generated particle, on each rank.
+    auto generator = Section(data, "generator");
+    if (generator["count"] && !(generator["placement"] && generator["placement"].as<std::string>() == "lattice"))
+      parts.push_back({"Generator", generator["count"].as<long>() * (2 * sizeof(int) + sizeof(index_t))});
+    if (Parallel::Size() > 1)
+      parts.push_back({"Domain", capacity * (size_t)12});
+    if (data.config["analysis"])
+      parts.push_back({"Analysis", capacity * (size_t)(4 * 4 + 8)});
+    if (data.config["porosity"] && data.config["porosity"]["resolution"])
+    {
+      auto resolution = data.config["porosity"]["resolution"].as<std::vector<long>>();
+      size_t voxels = 1;
+      for (long n : resolution)
+        voxels *= n;
+      parts.push_back({"Porosity", 8 * voxels});
+    }
+#ifdef DENSEPACKING_USE_CATALYST
+    // COORDINATION, the point connectivity and, lazily, the scaled radii.
+    if (data.config["catalyst"])
+    {
+      size_t particle_bytes = sizeof(int) + sizeof(index_t);
+#ifdef DENSEPACKING_LAZY_RADIUS
+      particle_bytes += sizeof(double);
+#endif
+      parts.push_back({"Catalyst", capacity * particle_bytes});
+    }
+#endif
+    return parts;
+  }
+}
+
+namespace Memory
+{
+  void Record(const std::string &subsystem, const std::string &name, size_t bytes)
+  {
+    size_t &entry = ledger[subsystem][name];
+    current = current - entry + bytes;
+    entry = bytes;
+    if (current > peak)
+      peak = current;
+  }
+
+  size_t Current() { return current; }
+  size_t Peak() { return peak; }
+
+  void Report(std::ostream &out)
+  {
+    out << "Device memory by subsystem (rank " << Parallel::Rank() << "):\n";
+    for (const auto &subsystem : ledger)
+    {
+      size_t bytes = 0;
+      for (const auto &view : subsystem.second)
+        bytes += view.second;
+      PrintRow(out, subsystem.first, bytes);
+    }
+    PrintRow(out, "Total", current);
+  }
+
+  bool CheckBudget(const Data &data, long particles, int nn_max)
+  {
+    const auto parts = Estimate(data, particles, nn_max);
+    size_t total = 0;
+    for (const auto &part : parts)
+      total += part.second;
+    // Every rank must take the same decision.
+    total = (size_t)Parallel::AllreduceMax((double)total);
+
+    auto memory = Section(data, "memory");
+    const double budget_gb = memory["budget_gb"] ? memory["budget_gb"].as<double>() : 0.0;
+    const size_t budget = (size_t)(budget_gb * 1024.0 * 1024.0 * 1024.0);
+    const bool fits = budget == 0 || total <= budget;
+    if (Parallel::IsRoot() && (budget > 0 || DryRunRequested(data)))
+    {
+      std::cout << "Estimated device memory per rank for " << particles << " particles, NN_MAX " << nn_max << ":\n";
+      for (const auto &part : parts)
+        PrintRow(std::cout, part.first, part.second);
+      PrintRow(std::cout, "Total", total);
+      if (budget > 0)
+        PrintRow(std::cout, "Budget", budget);
+    }
+    if (!fits && Parallel::IsRoot())
+      std::cerr << "Memory::CheckBudget: the estimated footprint exceeds memory.budget_gb, not starting.\n";
+    return fits;
+  }
+
+  bool DryRunRequested(const Data &data)
+  {
+    auto memory = Section(data, "memory");
+    return memory["dry_run"] && memory["dry_run"].as<bool>();
+  }
+
+  int DryRun(const Data &data)
+  {
+    auto memory = Section(data, "memory");
+    auto generator = Section(data, "generator");
+    long particles = 0;
+    if (memory["particles"])
+      particles = memory["particles"].as<long>();
+    else if (generator["count"])
+      particles = generator["count"].as<long>();
+    int nn_max = 0;
+    if (memory["nn_max"])
+      nn_max = memory["nn_max"].as<int>();
+    else if (generator["radius_min"] && generator["radius_max"])
+      nn_max = Data::neighbourCapacity(generator["radius_min"].as<double>(), generator["radius_max"].as<double>());
+    if (particles <= 0 || nn_max <= 0)
+    {
+      std::cerr << "Memory::DryRun: set memory.particles and memory.nn_max (or a generator section).\n";
+      return 1;
+    }
+    // Particles are split evenly over the ranks.
+    return CheckBudget(data, (particles + Parallel::Size() - 1) / Parallel::Size(), nn_max) ? 0 : 1;
+  }
+}
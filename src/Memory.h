@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+class Data;
+
+// Ledger of the device Views held by each subsystem. Allocation sites call
+// Record after (re)allocating a View; the ledger keeps the latest size per
+// subsystem and name, the running total and its peak.
+//
+// The config.yaml "memory" section sets a per-rank budget (budget_gb) that
+// the estimated footprint of the whole run is checked against before the
+// modules allocate, and a dry_run mode that only prints that estimate for
+// memory.particles and memory.nn_max.
+namespace Memory
+{
+  void Record(const std::string &subsystem, const std::string &name, size_t bytes);
+
+  template <class ViewType>
+  void Record(const std::string &subsystem, const std::string &name, const ViewType &view)
+  {
+    Record(subsystem, name, view.span() * sizeof(typename ViewType::value_type));
+  }
+
+  size_t Current();
+  size_t Peak();
+  // Per-subsystem breakdown of the current allocations.
+  void Report(std::ostream &out);
+
+  // Estimated bytes per rank for `particles` particles and NN_MAX `nn_max`,
+  // printed by subsystem; false if it exceeds memory.budget_gb.
+  bool CheckBudget(const Data &data, long particles, int nn_max);
+  bool DryRunRequested(const Data &data);
+  // Estimate for memory.particles / memory.nn_max (defaulting to the
+  // generator settings); returns the process exit status.
+  int DryRun(const Data &data);
+}
@@ -0,0 +1,101 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#ifdef DENSEPACKING_USE_MPI
+#include <mpi.h>
+#endif
+
+namespace Parallel
+{
+#ifdef DENSEPACKING_USE_MPI
+  void Initialize(int *argc, char ***argv) { MPI_Init(argc, argv); }
+  void Finalize() { MPI_Finalize(); }
+  int Rank()
+  {
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+  }
+  int Size()
+  {
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+  }
+  void Barrier() { MPI_Barrier(MPI_COMM_WORLD); }
+  double AllreduceMax(double value)
+  {
+    double result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    return result;
+  }
+  double AllreduceMin(double value)
+  {
+    double result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    return result;
+  }
+  long AllreduceSum(long value)
+  {
+    long result = value;
+    MPI_Allreduce(&value, &result, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+    return result;
+  }
+  void AllreduceSum(double *values, int count)
+  {
+    MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  }
+  void AllreduceSum(double *values, size_t count)
+  {
+    for (size_t done = 0; done < count; done += INT_MAX)
+      MPI_Allreduce(MPI_IN_PLACE, values + done, (int)std::min(count - done, (size_t)INT_MAX), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  }
+  void AllreduceSum(int *values, size_t count)
+  {
+    // MPI counts are int; long arrays go in chunks.
+    for (size_t done = 0; done < count; done += INT_MAX)
+      MPI_Allreduce(MPI_IN_PLACE, values + done, (int)std::min(count - done, (size_t)INT_MAX), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  }
+  std::vector<char> SendRecv(const void *send, size_t bytes, int dest, int source)
+  {
+    // Sizes first, then the payload.
+    unsigned long send_bytes = bytes, recv_bytes = 0;
+    MPI_Sendrecv(&send_bytes, 1, MPI_UNSIGNED_LONG, dest < 0 ? MPI_PROC_NULL : dest, 0,
+                 &recv_bytes, 1, MPI_UNSIGNED_LONG, source < 0 ? MPI_PROC_NULL : source, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if (source < 0)
+      recv_bytes = 0;
+    std::vector<char> received(recv_bytes);
+    MPI_Sendrecv(send, (int)send_bytes, MPI_BYTE, dest < 0 ? MPI_PROC_NULL : dest, 1,
+                 received.data(), (int)recv_bytes, MPI_BYTE, source < 0 ? MPI_PROC_NULL : source, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    return received;
+  }
+#else
+  void Initialize(int *, char ***) {}
+  void Finalize() {}
+  int Rank() { return 0; }
+  int Size() { return 1; }
+  void Barrier() {}
+  double AllreduceMax(double value) { return value; }
+  double AllreduceMin(double value) { return value; }
+  long AllreduceSum(long value) { return value; }
+  void AllreduceSum(double *, int) {}
+  void AllreduceSum(double *, size_t) {}
+  void AllreduceSum(int *, size_t) {}
+  std::vector<char> SendRecv(const void *send, size_t bytes, int dest, int source)
+  {
+    // A single rank can only talk to itself.
+    if (dest == 0 && source == 0)
+    {
+      std::vector<char> received(bytes);
+      std::memcpy(received.data(), send, bytes);
+      return received;
+    }
+    return std::vector<char>();
+  }
+#endif
+
+  bool IsRoot() { return Rank() == 0; }
+}
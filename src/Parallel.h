@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Thin wrapper over MPI. Without DENSEPACKING_USE_MPI every call is the
+// single-rank identity, so callers never need their own #ifdefs.
+namespace Parallel
+{
+  void Initialize(int *argc, char ***argv);
+  void Finalize();
+  int Rank();
+  int Size();
+  bool IsRoot();
+  void Barrier();
+  double AllreduceMax(double value);
+  double AllreduceMin(double value);
+  long AllreduceSum(long value);
+  // In-place sum of `count` values over all ranks.
+  void AllreduceSum(double *values, int count);
+  void AllreduceSum(double *values, size_t count);
+  void AllreduceSum(int *values, size_t count);
+  // Sends `bytes` to `dest` and receives whatever `source` sends in the same
+  // call. A negative rank means "no neighbour" on that side.
+  std::vector<char> SendRecv(const void *send, size_t bytes, int dest, int source);
+}
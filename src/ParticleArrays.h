@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+// Initial particles handed over in memory instead of simulation.input (see
+// Simulation::Setup). Same columns as a RawParticles file; the arrays stay
+// owned by the caller and are only read during Setup.
+struct ParticleArrays
+{
+  size_t count = 0;
+  const double *position = nullptr; // 3 * count, x y z interleaved
+  const double *radius = nullptr;   // count
+  const double *velocity = nullptr; // 3 * count, optional
+  const int *fix = nullptr;         // count, optional
+};
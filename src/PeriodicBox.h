@@ -0,0 +1,52 @@
+#pragma once
+
+#include "DataTypes.h"
+
+// Per-axis periodic boundaries of the WALL_MIN/WALL_MAX box. Only the
+// particles inside the box are stored; pair vectors use the minimum image
+// and positions are wrapped back into the box, counting the crossings in
+// an image index so that output can be unwrapped.
+struct PeriodicBox
+{
+  Vec3 origin;
+  Vec3 length;
+  int periodic[3] = {0, 0, 0};
+
+  KOKKOS_INLINE_FUNCTION
+  bool any() const { return periodic[0] || periodic[1] || periodic[2]; }
+
+  // Shortest vector between two points over all periodic images.
+  KOKKOS_INLINE_FUNCTION
+  Vec3 MinimumImage(Vec3 d) const
+  {
+    for (int axis = 0; axis < 3; ++axis)
+      if (periodic[axis])
+        d[axis] -= length[axis] * Kokkos::round(d[axis] / length[axis]);
+    return d;
+  }
+
+  // Moves p into [origin, origin + length) along the periodic axes and adds
+  // the number of box lengths it was shifted by to image.
+  KOKKOS_INLINE_FUNCTION
+  void Wrap(Vec3 &p, int image[3]) const
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (!periodic[axis])
+        continue;
+      const int shift = (int)Kokkos::floor((p[axis] - origin[axis]) / length[axis]);
+      if (shift != 0)
+      {
+        p[axis] -= shift * length[axis];
+        image[axis] += shift;
+      }
+    }
+  }
+
+  // Position in the unwrapped (continuous) frame.
+  KOKKOS_INLINE_FUNCTION
+  Vec3 Unwrap(const Vec3 &p, const int image[3]) const
+  {
+    return Vec3(p.x + image[0] * length.x, p.y + image[1] * length.y, p.z + image[2] * length.z);
+  }
+};
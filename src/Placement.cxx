@@ -0,0 +1,156 @@
+#include "Placement.h"
+#include "Data.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  struct ThreadPlace
+  {
+    int cpu = -1;
+    int node = -1;
+  };
+
+  // CPU and NUMA node the calling thread runs on (-1 where unknown).
+  ThreadPlace CurrentPlace()
+  {
+    ThreadPlace place;
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    {
+      place.cpu = (int)cpu;
+      place.node = (int)node;
+    }
+#endif
+    return place;
+  }
+
+  int NodeCount()
+  {
+    int nodes = 0;
+    while (std::ifstream("/sys/devices/system/node/node" + std::to_string(nodes) + "/cpulist"))
+      nodes++;
+    return std::max(nodes, 1);
+  }
+
+  std::string Env(const char *name)
+  {
+    const char *value = std::getenv(name);
+    return value ? value : "unset";
+  }
+
+  size_t PageSize()
+  {
+#ifdef __linux__
+    return sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+  }
+
+  // Node of each page in `pages`, -1 for pages that are not resident.
+  std::vector<int> PageNodes(std::vector<void *> &pages)
+  {
+    std::vector<int> status(pages.size(), -1);
+#if defined(__linux__) && defined(SYS_move_pages)
+    // With nodes == nullptr move_pages only reports where the pages are.
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0)
+      std::fill(status.begin(), status.end(), -1);
+#endif
+    return status;
+  }
+}
+
+namespace Placement
+{
+  void Grow(Kokkos::View<int *[3]> &view, index_t capacity)
+  {
+    Kokkos::View<int *[3]> old = view;
+    const index_t OLD_SIZE = old.extent(0);
+    Kokkos::View<int *[3]> grown(Kokkos::view_alloc(Kokkos::WithoutInitializing, old.label()), capacity);
+    Kokkos::parallel_for("PLACEMENT_GROW_IMAGE", Policy(0, capacity), KOKKOS_LAMBDA(const index_t idx) {
+      for (int axis = 0; axis < 3; ++axis)
+        grown(idx, axis) = idx < OLD_SIZE ? old(idx, axis) : 0; });
+    view = grown;
+  }
+
+  void Report(std::ostream &out, const Data &data)
+  {
+    // One iteration per host thread: with the static schedule iteration t
+    // runs on thread t.
+    const int THREADS = Kokkos::DefaultHostExecutionSpace().concurrency();
+    std::vector<ThreadPlace> places(THREADS);
+    Kokkos::parallel_for("PLACEMENT_THREADS", Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace, Kokkos::Schedule<Kokkos::Static>>(0, THREADS),
+                         [&](const int t) { places[t] = CurrentPlace(); });
+
+    const int nodes = NodeCount();
+    std::map<int, std::vector<int>> cpus_by_node;
+    for (const ThreadPlace &place : places)
+      cpus_by_node[place.node].push_back(place.cpu);
+
+    out << "[NUMA] " << nodes << (nodes == 1 ? " node, " : " nodes, ") << THREADS << " host threads (OMP_PROC_BIND=" << Env("OMP_PROC_BIND")
+        << ", OMP_PLACES=" << Env("OMP_PLACES") << ")\n";
+    for (auto &entry : cpus_by_node)
+    {
+      std::vector<int> &cpus = entry.second;
+      std::sort(cpus.begin(), cpus.end());
+      out << "[NUMA]   node " << (entry.first < 0 ? std::string("?") : std::to_string(entry.first)) << ": " << cpus.size() << " threads on CPUs";
+      for (size_t i = 0; i < cpus.size() && i < 16; ++i)
+        out << " " << cpus[i];
+      if (cpus.size() > 16)
+        out << " ...";
+      out << "\n";
+    }
+    if (nodes > 1 && cpus_by_node.size() > 1 && (Env("OMP_PROC_BIND") == "unset" || Env("OMP_PROC_BIND") == "false"))
+      out << "[NUMA] warning: host threads are not bound; first-touch placement needs OMP_PROC_BIND=spread OMP_PLACES=cores\n";
+
+    // Page check: only meaningful for host memory and more than one node.
+    if (nodes == 1 || THREADS == 1 || !Kokkos::SpaceAccessibility<Kokkos::HostSpace, Kokkos::DefaultExecutionSpace::memory_space>::accessible)
+      return;
+    const index_t N = data.OWNED_COUNT;
+    const size_t PAGE = PageSize();
+    const uintptr_t base = reinterpret_cast<uintptr_t>(data.POSITION.data());
+    std::vector<void *> pages;
+    std::vector<int> expected;
+    for (int t = 0; t < THREADS; ++t)
+    {
+      // Pages lying entirely inside particles [first, last), the share of
+      // thread t under the static partition; up to 16 of them are sampled.
+      const index_t first = N * t / THREADS, last = N * (t + 1) / THREADS;
+      const uintptr_t begin = (base + first * sizeof(Vec3) + PAGE - 1) / PAGE * PAGE;
+      const uintptr_t end = (base + last * sizeof(Vec3)) / PAGE * PAGE;
+      if (end <= begin)
+        continue;
+      const uintptr_t step = std::max<uintptr_t>((end - begin) / PAGE / 16, 1) * PAGE;
+      for (uintptr_t page = begin; page < end; page += step)
+      {
+        pages.push_back(reinterpret_cast<void *>(page));
+        expected.push_back(places[t].node);
+      }
+    }
+    const std::vector<int> found = PageNodes(pages);
+    size_t resident = 0, local = 0;
+    for (size_t i = 0; i < found.size(); ++i)
+      if (found[i] >= 0)
+      {
+        resident++;
+        if (found[i] == expected[i])
+          local++;
+      }
+    if (resident == 0)
+      return;
+    out << "[NUMA] POSITION: " << std::fixed << std::setprecision(1) << 100.0 * local / resident << "% of " << resident
+        << " sampled pages on the node of the thread that works on them\n";
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "DataTypes.h"
+#include <ostream>
+#include <string>
+
+class Data;
+
+// NUMA placement of the particle arrays. On a multi-socket host backend a
+// page lands on the NUMA node of the thread that first writes it, so the
+// particle Views are allocated without initialization and first touched by
+// Placement::Policy over the particle index: the same static partition the
+// step kernels run with, so every thread streams memory of its own node.
+// Grow keeps that placement when Data::reserveParticles reallocates, and
+// reorderings (Domain::Migrate) rewrite pages that already have their node.
+namespace Placement
+{
+  typedef Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>> Policy;
+
+  template <class ViewType>
+  ViewType Allocate(const std::string &label, size_t count)
+  {
+    return ViewType(Kokkos::view_alloc(Kokkos::WithoutInitializing, label), count);
+  }
+
+  // Reallocates `view` for `capacity` particles of `stride` entries each,
+  // copying the old entries and zeroing the new ones in the first-touch
+  // partition.
+  template <class ViewType>
+  void Grow(ViewType &view, index_t capacity, int stride = 1)
+  {
+    typedef typename ViewType::non_const_value_type value_type;
+    ViewType old = view;
+    const size_t OLD_SIZE = old.extent(0);
+    ViewType grown = Allocate<ViewType>(old.label(), (size_t)capacity * stride);
+    Kokkos::parallel_for("PLACEMENT_GROW", Policy(0, capacity), KOKKOS_LAMBDA(const index_t idx) {
+      for (int k = 0; k < stride; ++k)
+      {
+        const size_t slot = (size_t)idx * stride + k;
+        grown(slot) = slot < OLD_SIZE ? old(slot) : value_type();
+      } });
+    view = grown;
+  }
+
+  // Same for the periodic image counters.
+  void Grow(Kokkos::View<int *[3]> &view, index_t capacity);
+
+  // Thread to CPU/NUMA node mapping of the host threads and, on host
+  // memory, how many sampled POSITION pages sit on the node of the thread
+  // that works on them.
+  void Report(std::ostream &out, const Data &data);
+}
@@ -0,0 +1,177 @@
+#include "Porosity.h"
+#include "Tuning.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+// VTK Includes
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkFloatArray.h>
+#include <vtkCellData.h>
+#include <vtkXMLImageDataWriter.h>
+
+Porosity::Porosity(Data *data) : AModule(data) {}
+std::string Porosity::getModuleName() { return "Porosity"; };
+
+void Porosity::Initialization()
+{
+  auto config = data->yaml.config["porosity"];
+  if (!config["every"] || !config["resolution"] || config["every"].as<int>() <= 0)
+  {
+    std::cerr << "Porosity::Initialization: porosity.every and porosity.resolution [nx, ny, nz] are required.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  auto resolution = config["resolution"].as<std::vector<int>>();
+  if (resolution.size() != 3 || resolution[0] < 1 || resolution[1] < 1 || resolution[2] < 1)
+  {
+    std::cerr << "Porosity::Initialization: porosity.resolution needs three positive voxel counts.\n";
+    data->COMPUTE = false;
+    return;
+  }
+  every = config["every"].as<int>();
+  for (int axis = 0; axis < 3; ++axis)
+    this->resolution[axis] = resolution[axis];
+  samples = config["samples"] ? config["samples"].as<int>() : 4;
+  include_fixed = config["include_fixed"] && config["include_fixed"].as<bool>();
+  if (samples < 1)
+    samples = 1;
+
+  SOLID = Kokkos::View<double *>("POROSITY_SOLID", (size_t)resolution[0] * resolution[1] * resolution[2]);
+  SOLID_host = Kokkos::create_mirror_view(SOLID);
+  Memory::Record("Porosity", "SOLID", SOLID);
+}
+
+void Porosity::Processing()
+{
+  if (data->cstep % every != 0)
+    return;
+  Rasterize();
+  Kokkos::deep_copy(SOLID_host, SOLID);
+  // Every rank rasterizes its owned particles onto the whole grid.
+  Parallel::AllreduceSum(SOLID_host.data(), SOLID_host.extent(0));
+  if (!Parallel::IsRoot())
+    return;
+  std::stringstream filename;
+  filename << "data/POROSITY_" << std::setfill('0') << std::setw(10) << data->cstep << ".vti";
+  WriteImage(filename.str());
+}
+
+// One team per particle covers the voxels of its bounding box. Voxels
+// entirely inside or outside the sphere are decided from their nearest and
+// farthest corners; the others are sampled at samples^3 points. Volume
+// fractions of overlapping particles add up.
+void Porosity::Rasterize()
+{
+  const index_t N = data->OWNED_COUNT;
+  const int NX = resolution[0], NY = resolution[1], NZ = resolution[2];
+  const int S = samples;
+  const bool INCLUDE_FIXED = include_fixed;
+  const PeriodicBox BOX = data->PERIODIC;
+  const Vec3 LO = data->WALL_MIN;
+  const Vec3 H((data->WALL_MAX.x - LO.x) / NX, (data->WALL_MAX.y - LO.y) / NY, (data->WALL_MAX.z - LO.z) / NZ);
+  auto &POSITION = data->POSITION;
+  const RadiusField RADIUS = data->Radii();
+  auto &FIX = data->FIX;
+  auto &SOLID = this->SOLID;
+
+  Kokkos::deep_copy(SOLID, 0.0);
+  typedef Kokkos::TeamPolicy<>::member_type member_type;
+  Tuning::TeamFor("POROSITY_RASTERIZE", N, KOKKOS_LAMBDA(const member_type &team) {
+    const index_t idx = team.league_rank();
+    if (FIX(idx) != 0 && !INCLUDE_FIXED)
+      return;
+    const Vec3 P = POSITION(idx);
+    const double R = RADIUS(idx);
+    const int n[3] = {NX, NY, NZ};
+    int first[3], count[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      first[axis] = (int)Kokkos::floor((P[axis] - R - LO[axis]) / H[axis]);
+      int last = (int)Kokkos::floor((P[axis] + R - LO[axis]) / H[axis]);
+      // Non-periodic axes are clipped to the grid; periodic ones wrap below.
+      if (!BOX.periodic[axis])
+      {
+        first[axis] = Kokkos::max(first[axis], 0);
+        last = Kokkos::min(last, n[axis] - 1);
+      }
+      count[axis] = Kokkos::max(last - first[axis] + 1, 0);
+    }
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, count[0] * count[1] * count[2]), [&](const int v) {
+      const int c[3] = {first[0] + v % count[0], first[1] + (v / count[0]) % count[1], first[2] + v / (count[0] * count[1])};
+      // Nearest and farthest distances from the centre to the voxel.
+      double near2 = 0, far2 = 0;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        const double lo = LO[axis] + c[axis] * H[axis] - P[axis];
+        const double hi = lo + H[axis];
+        const double nearest = lo > 0 ? lo : (hi < 0 ? hi : 0.0);
+        const double farthest = Kokkos::fmax(Kokkos::fabs(lo), Kokkos::fabs(hi));
+        near2 += nearest * nearest;
+        far2 += farthest * farthest;
+      }
+      if (near2 >= R * R)
+        return;
+      double fraction = 1.0;
+      if (far2 > R * R)
+      {
+        int inside = 0;
+        for (int i = 0; i < S; ++i)
+          for (int j = 0; j < S; ++j)
+            for (int k = 0; k < S; ++k)
+            {
+              const double dx = LO.x + (c[0] + (i + 0.5) / S) * H.x - P.x;
+              const double dy = LO.y + (c[1] + (j + 0.5) / S) * H.y - P.y;
+              const double dz = LO.z + (c[2] + (k + 0.5) / S) * H.z - P.z;
+              if (dx * dx + dy * dy + dz * dz < R * R)
+                inside++;
+            }
+        fraction = (double)inside / (S * S * S);
+      }
+      int w[3];
+      for (int axis = 0; axis < 3; ++axis)
+        w[axis] = BOX.periodic[axis] ? ((c[axis] % n[axis]) + n[axis]) % n[axis] : c[axis];
+      Kokkos::atomic_add(&SOLID(((size_t)w[2] * NY + w[1]) * NX + w[0]), fraction);
+    });
+  });
+}
+
+void Porosity::WriteImage(const std::string &filename)
+{
+  const size_t voxels = SOLID_host.extent(0);
+  auto image = vtkSmartPointer<vtkImageData>::New();
+  // Voxels are the cells of the image, so it has one more point per axis.
+  image->SetDimensions(resolution[0] + 1, resolution[1] + 1, resolution[2] + 1);
+  image->SetOrigin(data->WALL_MIN.x, data->WALL_MIN.y, data->WALL_MIN.z);
+  image->SetSpacing((data->WALL_MAX.x - data->WALL_MIN.x) / resolution[0],
+                    (data->WALL_MAX.y - data->WALL_MIN.y) / resolution[1],
+                    (data->WALL_MAX.z - data->WALL_MIN.z) / resolution[2]);
+
+  auto solid = vtkSmartPointer<vtkFloatArray>::New();
+  solid->SetName("SOLID_FRACTION");
+  solid->SetNumberOfTuples(voxels);
+  auto porosity = vtkSmartPointer<vtkFloatArray>::New();
+  porosity->SetName("POROSITY");
+  porosity->SetNumberOfTuples(voxels);
+  float *solid_values = solid->GetPointer(0);
+  float *porosity_values = porosity->GetPointer(0);
+  Kokkos::parallel_for("POROSITY_VALUES", Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>(0, voxels), [&](const size_t v) {
+    // Overlaps between particles can push the summed fraction above one.
+    const float value = SOLID_host(v) < 1.0 ? (float)SOLID_host(v) : 1.0f;
+    solid_values[v] = value;
+    porosity_values[v] = 1.0f - value; });
+  image->GetCellData()->SetScalars(porosity);
+  image->GetCellData()->AddArray(solid);
+
+  auto writer = vtkSmartPointer<vtkXMLImageDataWriter>::New();
+  writer->SetFileName(filename.c_str());
+  writer->SetInputData(image);
+  writer->SetDataModeToAppended();
+  writer->EncodeAppendedDataOff();
+  writer->SetCompressorTypeToLZ4();
+  if (writer->Write() == 0)
+    std::cerr << "Porosity: failed to write " << filename << "\n";
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "AModule.h"
+
+// Rasterizes the particle volumes onto the voxel grid of the config.yaml
+// "porosity" section, which covers the WALL_MIN/WALL_MAX box, every
+// porosity.every steps and writes data/POROSITY_<step>.vti with the
+// SOLID_FRACTION and POROSITY of every voxel.
+class Porosity : public AModule
+{
+public:
+  Porosity(Data *data);
+  virtual void Initialization();
+  virtual std::string getModuleName();
+
+protected:
+  virtual void Processing();
+
+private:
+  void Rasterize();
+  void WriteImage(const std::string &filename);
+
+  int every = 0;
+  int resolution[3] = {0, 0, 0};
+  int samples = 4; // sub-samples per voxel edge for partially covered voxels
+  bool include_fixed = false;
+
+  Kokkos::View<double *> SOLID; // x fastest, as in VTK image data
+  Kokkos::View<double *>::HostMirror SOLID_host;
+};
@@ -1,5 +1,8 @@
 #include "RadiusScaler.h"
+#include "Tuning.h"
+#include <algorithm>
 #include <iomanip>
+#include "Parallel.h"
 
 RadiusScaler::RadiusScaler(Data *data) : AModule(data) {}
 
@@ -18,11 +21,11 @@ void RadiusScaler::RunKernels()
 {
   //if (data->cstep % 100 != 0)return;
   
-  const int N = data->PARTICLE_COUNT;
-  auto &RADIUS = data->RADIUS;
-  auto &OLD_RADIUS = data->OLD_RADIUS;
-  auto &FIX = data->FIX;
-
+  if (data->ENSEMBLE)
+  {
+    ScaleSystems();
+    return;
+  }
 
   if (data->simConstants.maxOverlap > data->simConstants.overlap_limit)
     return;
@@ -36,8 +39,9 @@ void RadiusScaler::RunKernels()
       const double cumulative_scale = data->simConstants.radius_scale_delta_current;
       radius_min = data->min_radius * (1.0 + cumulative_scale);
 
-      std::cout << data->cstep << " Max overlap: " << std::setprecision(5) << std::scientific << data->simConstants.maxOverlap
-            << " radius_min " << radius_min << "\n";
+      if (Parallel::IsRoot())
+        std::cout << data->cstep << " Max overlap: " << std::setprecision(5) << std::scientific << data->simConstants.maxOverlap
+                  << " radius_min " << radius_min << "\n";
   ///i//f(data->cstep%100==0)
   {
     data->simConstants.radius_scale_delta_current += data->simConstants.radius_scale_delta;
@@ -48,11 +52,67 @@ void RadiusScaler::RunKernels()
     // of multiplying by a factor that grows with the iteration count.
     const double cumulative_scale_after = data->simConstants.radius_scale_delta_current;
 
-    Kokkos::parallel_for("RadiusScaler", N, KOKKOS_LAMBDA(const int idx) {
-      if (FIX(idx) > 0)
-        return;
-      RADIUS(idx) = OLD_RADIUS(idx) * (1.0 + cumulative_scale_after);
-    });
+    ScaleRadii(cumulative_scale_after);
   }
   Kokkos::fence();
 }
+
+void RadiusScaler::ScaleRadii(double cumulative_scale)
+{
+#ifdef DENSEPACKING_LAZY_RADIUS
+  // Kernels scale the base radii on read (Data::Radii).
+  (void)cumulative_scale;
+#else
+  const index_t N = data->PARTICLE_COUNT;
+  auto &RADIUS = data->RADIUS;
+  auto &OLD_RADIUS = data->OLD_RADIUS;
+  auto &FIX = data->FIX;
+
+  Tuning::For("RadiusScaler", 0, N, KOKKOS_LAMBDA(const index_t idx) {
+    if (FIX(idx) > 0)
+      return;
+    RADIUS(idx) = OLD_RADIUS(idx) * (1.0 + cumulative_scale);
+  });
+#endif
+}
+
+// Ensemble mode: every system makes its own growth decision against its own
+// maxOverlap; the radii of all systems are then updated in one launch.
+void RadiusScaler::ScaleSystems()
+{
+  size_t grown = 0;
+  double max_overlap = 0.0;
+  for (size_t s = 0; s < data->systems.size(); ++s)
+  {
+    auto &system = data->systems[s];
+    if (system.simConstants.maxOverlap > system.simConstants.overlap_limit)
+      continue;
+    max_overlap = std::max(max_overlap, system.simConstants.maxOverlap);
+    system.simConstants.radius_scale_delta_current += system.simConstants.radius_scale_delta;
+    system.simConstants.relaxation_coefficient = system.simConstants.relaxation_coefficient * system.simConstants.relaxation_coefficient_scale;
+    grown++;
+  }
+  if (grown == 0)
+    return;
+  // One summary line per step instead of one per system.
+  if (Parallel::IsRoot())
+    std::cout << data->cstep << " Systems grown: " << grown << "/" << data->systems.size() << " Max overlap: " << std::setprecision(5)
+              << std::scientific << max_overlap << "\n";
+  data->uploadSystems();
+  // With DENSEPACKING_LAZY_RADIUS SYSTEM_SCALE is all the kernels need.
+#ifndef DENSEPACKING_LAZY_RADIUS
+  const index_t N = data->PARTICLE_COUNT;
+  auto &RADIUS = data->RADIUS;
+  auto &OLD_RADIUS = data->OLD_RADIUS;
+  auto &FIX = data->FIX;
+  auto &SYSTEM_ID = data->SYSTEM_ID;
+  auto &SYSTEM_SCALE = data->SYSTEM_SCALE;
+
+  Tuning::For("RadiusScalerSystems", 0, N, KOKKOS_LAMBDA(const index_t idx) {
+    if (FIX(idx) > 0)
+      return;
+    RADIUS(idx) = OLD_RADIUS(idx) * (1.0 + SYSTEM_SCALE(SYSTEM_ID(idx)));
+  });
+  Kokkos::fence();
+#endif
+}
@@ -8,9 +8,14 @@ public:
   virtual void Initialization();
   virtual std::string getModuleName();
   void RunKernels();
+  // Sets RADIUS = OLD_RADIUS * (1 + cumulative_scale) for every free particle;
+  // a no-op with DENSEPACKING_LAZY_RADIUS, where kernels scale on read.
+  void ScaleRadii(double cumulative_scale);
+  // Ensemble mode: per-system growth decision and one radius update launch.
+  void ScaleSystems();
 
 protected:
   void Processing();
   double radius_min=0;
   int kiekis=0;
-};
\ No newline at end of file
+};
\ No newline at end of file
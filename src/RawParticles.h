@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Native raw particle file (*.dpraw), read by Reader through mmap without
+// VTK. Layout (little endian, no padding):
+//   RawParticlesHeader
+//   double position[3 * count]   (x, y, z interleaved)
+//   double radius[count]
+//   double velocity[3 * count]   only if flags & RAW_HAS_VELOCITY
+//   int32  fix[count]            only if flags & RAW_HAS_FIX
+// scripts/ConvertToRaw.py converts .vtk/.vtp inputs.
+namespace RawParticles
+{
+  constexpr char MAGIC[8] = {'D', 'P', 'R', 'A', 'W', '0', '0', '1'};
+  constexpr const char *EXTENSION = ".dpraw";
+
+  enum Flags : uint32_t
+  {
+    RAW_HAS_VELOCITY = 1,
+    RAW_HAS_FIX = 2
+  };
+
+  struct Header
+  {
+    char magic[8];
+    uint64_t count;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(Header) == 24, "RawParticles::Header must stay 24 bytes");
+
+  inline bool IsRawFile(const std::string &filename)
+  {
+    const std::string ext(EXTENSION);
+    return filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+  }
+}
@@ -1,150 +1,403 @@
 #include "Reader.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "RawParticles.h"
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vtkSmartPointer.h>
 #include <vtkXMLPolyDataReader.h>
 #include <vtkPolyData.h>
 #include <vtkPoints.h>
 #include <vtkDataArray.h>
-#include <vtkFloatArray.h>
-#include <vtkIntArray.h>
 #include <vtkPointData.h>
-#include <vtkCellArray.h>
-#include <vtkCell.h>
-#include <vtkCellData.h>
 #include <vtkDataSetReader.h>
+#include <vtkType.h>
 
 Reader::Reader(Data *data) : AModule(data) {}
+Reader::Reader(Data *data, const ParticleArrays &arrays) : AModule(data), arrays(&arrays) {}
 std::string Reader::getModuleName() { return "Reader"; };
 
-void Reader::Initialization()
+namespace
 {
-  auto filename=this->data->yaml.ReadString("simulation","input");
-    vtkPolyData *polyData=vtkPolyData::New() ;
-  if (filename.length() >= 3 && filename.rfind("vtp") == (filename.length() - 3))
-  {auto reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
-  reader->SetFileName(filename.c_str());
-  reader->Update();
-  //polyData = reader->GetOutput();
-  polyData->DeepCopy(reader->GetOutput());
-  }else 
-  {
-    auto reader = vtkSmartPointer<vtkDataSetReader>::New();
-  reader->SetFileName(filename.c_str());
-  reader->Update();
-  polyData->DeepCopy(reader->GetOutput());
-  //polyData = reader->GetOutput();
-
-  std::cout<<"aaaa\n";
-
-  }
-    polyData->Print(std::cout);
+  // One input column resolved once per file: a typed pointer into the VTK
+  // array or the mapped raw file, or the VTK array itself when its memory
+  // layout or type has no fast path.
+  struct InputColumn
+  {
+    const void *values = nullptr;
+    int type = 0;
+    int components = 0;
+    vtkDataArray *array = nullptr;
 
+    bool empty() const { return values == nullptr && array == nullptr; }
+    double Get(vtkIdType j, int c) const
+    {
+      const vtkIdType k = j * components + c;
+      switch (type)
+      {
+      case VTK_DOUBLE:
+        return static_cast<const double *>(values)[k];
+      case VTK_FLOAT:
+        return static_cast<const float *>(values)[k];
+      case VTK_INT:
+        return static_cast<const int *>(values)[k];
+      default:
+        return array->GetComponent(j, c);
+      }
+    }
+  };
 
-  vtkPoints *points = polyData->GetPoints();
-  if (!points) {
-    std::cerr << "Reader::Initialization: input has no points. Aborting initialization.\n";
-    data->COMPUTE = false;
-    return;
+  InputColumn Resolve(vtkDataArray *array)
+  {
+    InputColumn column;
+    if (!array)
+      return column;
+    column.components = array->GetNumberOfComponents();
+    column.array = array;
+    const int type = array->GetDataType();
+    if (array->HasStandardMemoryLayout() && (type == VTK_DOUBLE || type == VTK_FLOAT || type == VTK_INT))
+    {
+      column.values = array->GetVoidPointer(0);
+      column.type = type;
+    }
+    return column;
   }
 
-  vtkDataArray *radiusArray = nullptr;
-  if (polyData->GetPointData())
-    radiusArray = polyData->GetPointData()->GetArray("RADIUS");
-  if (!radiusArray) {
-    std::cerr << "Reader::Initialization: missing 'RADIUS' array in input. Aborting initialization.\n";
-    data->COMPUTE = false;
-    return;
+  InputColumn Resolve(const void *values, int type, int components)
+  {
+    InputColumn column;
+    column.values = values;
+    column.type = type;
+    column.components = components;
+    return column;
   }
-  data->PARTICLE_COUNT = points->GetNumberOfPoints();
-  data->POSITION = Kokkos::View<Vec3 *>("POSITION", data->PARTICLE_COUNT);
-  data->FORCE = Kokkos::View<Vec3 *>("FORCE", data->PARTICLE_COUNT);
-  
-  data->RADIUS = Kokkos::View<double *>("RADIUS", data->PARTICLE_COUNT);
-  data->OLD_RADIUS = Kokkos::View<double *>("OLD_RADIUS", data->PARTICLE_COUNT);
-  data->VELOCITY = Kokkos::View<Vec3 *>("VELOCITY", data->PARTICLE_COUNT);
-  data->NN_COUNT = Kokkos::View<int *>("NN_COUNT", data->PARTICLE_COUNT);
-  data->FIX = Kokkos::View<int *>("FIX", data->PARTICLE_COUNT);
-  data->MAX_OVERLAP = Kokkos::View<double *>("MAX_OVERLAP", data->PARTICLE_COUNT);
-  
-  
-  auto POSITION_host = Kokkos::create_mirror_view(data->POSITION);
-  auto RADIUS_host = Kokkos::create_mirror_view(data->RADIUS);
-  auto OLD_RADIUS_host = Kokkos::create_mirror_view(data->OLD_RADIUS);
-  auto VELOCITY_host = Kokkos::create_mirror_view(data->VELOCITY);  
-  auto FIX_host = Kokkos::create_mirror_view(data->FIX);
 
-  Kokkos::deep_copy(data->POSITION, Vec3{0.0, 0.0, 0.0});
-  Kokkos::deep_copy(data->VELOCITY, Vec3{0.0, 0.0, 0.0});
-  Kokkos::deep_copy(data->FORCE, Vec3{0.0, 0.0, 0.0});
-  Kokkos::deep_copy(data->NN_COUNT, 0);
-  Kokkos::deep_copy(data->FIX, 0);
-  Kokkos::deep_copy(data->RADIUS, 0);
-  Kokkos::deep_copy(data->OLD_RADIUS, 0);
-  Kokkos::deep_copy(data->MAX_OVERLAP, 0);
-  
+  // A read-only private mapping of a whole file.
+  struct MappedFile
+  {
+    void *address = MAP_FAILED;
+    size_t size = 0;
+    ~MappedFile()
+    {
+      if (address != MAP_FAILED)
+        munmap(address, size);
+    }
+  };
 
-  double min_radius = std::numeric_limits<double>::max();
-  double max_radius = std::numeric_limits<double>::lowest();
-  for (int i = 0; i < data->PARTICLE_COUNT; ++i)
+  // Everything Reader needs from one input file. The VTK polydata or the
+  // mapping is kept alive for as long as the columns point into it.
+  struct ParticleInput
   {
-    double p[3];
-    points->GetPoint(i, p);
-    double r = radiusArray->GetTuple1(i);
+    vtkIdType count = 0;
+    InputColumn position;
+    InputColumn radius;
+    InputColumn velocity;
+    InputColumn fix;
+    vtkSmartPointer<vtkPolyData> polyData;
+    std::shared_ptr<MappedFile> mapped;
+  };
 
-    if (polyData->GetPointData()->HasArray("FIX"))
+  // Loads a legacy .vtk or XML .vtp polydata file.
+  bool ReadPolyData(const std::string &filename, ParticleInput &input)
+  {
+    vtkSmartPointer<vtkPolyData> polyData;
+    if (filename.length() >= 3 && filename.rfind("vtp") == (filename.length() - 3))
     {
-      FIX_host(i) = polyData->GetPointData()->GetArray("FIX")->GetTuple1(i);
+      auto reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+      reader->SetFileName(filename.c_str());
+      reader->Update();
+      polyData = reader->GetOutput();
     }
     else
     {
-      FIX_host(i) = 0;
+      auto reader = vtkSmartPointer<vtkDataSetReader>::New();
+      reader->SetFileName(filename.c_str());
+      reader->Update();
+      polyData = reader->GetPolyDataOutput();
     }
 
-    if (polyData->GetPointData()->HasArray("VELOCITY"))
+    vtkPoints *points = polyData ? polyData->GetPoints() : nullptr;
+    if (!points)
     {
-      double v[3];
-      polyData->GetPointData()->GetArray("VELOCITY")->GetTuple(i, v);
-      VELOCITY_host(i) = Vec3(v[0], v[1], v[2]);
+      std::cerr << "Reader::Initialization: input " << filename << " has no points. Aborting initialization.\n";
+      return false;
     }
-    else
+    vtkPointData *pointData = polyData->GetPointData();
+    if (!pointData || !pointData->GetArray("RADIUS"))
     {
-      VELOCITY_host(i) = Vec3{0.0, 0.0, 0.0};
+      std::cerr << "Reader::Initialization: missing 'RADIUS' array in input " << filename << ". Aborting initialization.\n";
+      return false;
     }
+    input.polyData = polyData;
+    input.count = points->GetNumberOfPoints();
+    input.position = Resolve(points->GetData());
+    input.radius = Resolve(pointData->GetArray("RADIUS"));
+    input.velocity = Resolve(pointData->GetArray("VELOCITY"));
+    input.fix = Resolve(pointData->GetArray("FIX"));
+    return true;
+  }
 
-    
-    if(FIX_host(i)==0)r=r*data->simConstants.initial_scale;
-    POSITION_host(i) = Vec3(p[0], p[1], p[2]);
+  // Maps a RawParticles file; the columns point straight into the mapping.
+  bool ReadRaw(const std::string &filename, ParticleInput &input)
+  {
+    auto mapped = std::make_shared<MappedFile>();
+    const int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+      std::cerr << "Reader::Initialization: cannot open raw input " << filename << ". Aborting initialization.\n";
+      if (fd >= 0)
+        close(fd);
+      return false;
+    }
+    mapped->size = st.st_size;
+    if (mapped->size >= sizeof(RawParticles::Header))
+      mapped->address = mmap(nullptr, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped->address == MAP_FAILED)
+    {
+      std::cerr << "Reader::Initialization: cannot map raw input " << filename << ". Aborting initialization.\n";
+      return false;
+    }
+
+    RawParticles::Header header;
+    std::memcpy(&header, mapped->address, sizeof(header));
+    const size_t count = header.count;
+    const bool hasVelocity = header.flags & RawParticles::RAW_HAS_VELOCITY;
+    const bool hasFix = header.flags & RawParticles::RAW_HAS_FIX;
+    const size_t expected = sizeof(header) + count * (4 * sizeof(double) + (hasVelocity ? 3 * sizeof(double) : 0) + (hasFix ? sizeof(int32_t) : 0));
+    if (std::memcmp(header.magic, RawParticles::MAGIC, sizeof(header.magic)) != 0 || mapped->size != expected)
+    {
+      std::cerr << "Reader::Initialization: " << filename << " is not a valid raw particle file. Aborting initialization.\n";
+      return false;
+    }
+
+    const char *cursor = static_cast<const char *>(mapped->address) + sizeof(header);
+    input.count = count;
+    input.position = Resolve(cursor, VTK_DOUBLE, 3);
+    cursor += 3 * count * sizeof(double);
+    input.radius = Resolve(cursor, VTK_DOUBLE, 1);
+    cursor += count * sizeof(double);
+    if (hasVelocity)
+    {
+      input.velocity = Resolve(cursor, VTK_DOUBLE, 3);
+      cursor += 3 * count * sizeof(double);
+    }
+    if (hasFix)
+      input.fix = Resolve(cursor, VTK_INT, 1);
+    madvise(mapped->address, mapped->size, MADV_SEQUENTIAL);
+    input.mapped = mapped;
+    return true;
+  }
+
+  // Columns over arrays passed in memory.
+  bool ReadArrays(const ParticleArrays &arrays, ParticleInput &input)
+  {
+    if (!arrays.position || !arrays.radius)
+    {
+      std::cerr << "Reader::Initialization: in-memory input needs position and radius arrays. Aborting initialization.\n";
+      return false;
+    }
+    input.count = arrays.count;
+    input.position = Resolve(arrays.position, VTK_DOUBLE, 3);
+    input.radius = Resolve(arrays.radius, VTK_DOUBLE, 1);
+    if (arrays.velocity)
+      input.velocity = Resolve(arrays.velocity, VTK_DOUBLE, 3);
+    if (arrays.fix)
+      input.fix = Resolve(arrays.fix, VTK_INT, 1);
+    return true;
+  }
+}
 
-    RADIUS_host(i) = r;
-    OLD_RADIUS_host(i) = r;
-    if (r < min_radius)
-      min_radius = r;
-    if (r > max_radius)
-      max_radius = r;
+void Reader::Initialization()
+{
+  std::vector<ParticleInput> inputs;
+  if (arrays)
+  {
+    if (data->ENSEMBLE)
+    {
+      std::cerr << "Reader::Initialization: in-memory input cannot be combined with ensemble mode.\n";
+      data->COMPUTE = false;
+      return;
+    }
+    inputs.resize(1);
+    if (!ReadArrays(*arrays, inputs[0]))
+    {
+      data->COMPUTE = false;
+      return;
+    }
+  }
+  else
+  {
+    // One input per system; the normal run is a single system.
+    std::vector<std::string> filenames;
+    if (data->ENSEMBLE)
+      for (const auto &system : data->systems)
+        filenames.push_back(system.input);
+    else
+      filenames.push_back(this->data->yaml.ReadString("simulation", "input"));
 
+    inputs.resize(filenames.size());
+    for (size_t s = 0; s < filenames.size(); ++s)
+    {
+      const bool ok = RawParticles::IsRawFile(filenames[s]) ? ReadRaw(filenames[s], inputs[s]) : ReadPolyData(filenames[s], inputs[s]);
+      if (!ok)
+      {
+        data->COMPUTE = false;
+        return;
+      }
+    }
+  }
 
+  // With MPI every rank keeps only the particles inside its own slab, so
+  // each input gets the list of input indices this rank stores; a single
+  // rank stores every input particle in order.
+  typedef Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace> HostPolicy;
+  const bool decomposed = Parallel::Size() > 1;
+  // The radius range of the stored particles (free ones scaled by
+  // initial_scale) sizes NN_MAX; it is known before anything is allocated.
+  std::vector<std::vector<index_t>> owned(inputs.size());
+  std::vector<index_t> counts(inputs.size());
+  std::vector<double> system_min_radius(inputs.size());
+  double min_radius = std::numeric_limits<double>::max();
+  double max_radius = std::numeric_limits<double>::lowest();
+  index_t total = 0;
+  for (size_t s = 0; s < inputs.size(); ++s)
+  {
+    const ParticleInput &input = inputs[s];
+    const double initial_scale = data->ENSEMBLE ? data->systems[s].simConstants.initial_scale : data->simConstants.initial_scale;
+    auto owns = [&](const index_t j) {
+      return data->ownsPosition(Vec3(input.position.Get(j, 0), input.position.Get(j, 1), input.position.Get(j, 2)));
+    };
+    if (decomposed)
+    {
+      std::vector<index_t> &source = owned[s];
+      index_t count = 0;
+      Kokkos::parallel_reduce("READER_OWNED", HostPolicy(0, input.count), [&](const index_t j, index_t &sum) {
+        if (owns(j))
+          sum++; }, count);
+      source.resize(count);
+      Kokkos::parallel_scan("READER_SELECT", HostPolicy(0, input.count), [&](const index_t j, index_t &offset, const bool final) {
+        if (owns(j))
+        {
+          if (final)
+            source[offset] = j;
+          offset++;
+        } });
+    }
+    counts[s] = decomposed ? (index_t)owned[s].size() : (index_t)input.count;
+    const index_t *source = decomposed ? owned[s].data() : nullptr;
+    auto radius = [&](const index_t k) {
+      const vtkIdType j = source ? source[k] : k;
+      const bool fixed = !input.fix.empty() && (int)input.fix.Get(j, 0) != 0;
+      return fixed ? input.radius.Get(j, 0) : input.radius.Get(j, 0) * initial_scale;
+    };
+    double lo = std::numeric_limits<double>::max();
+    double hi = std::numeric_limits<double>::lowest();
+    Kokkos::parallel_reduce("READER_MIN_RADIUS", HostPolicy(0, counts[s]), [&](const index_t k, double &local) {
+      local = std::min(local, radius(k)); }, Kokkos::Min<double>(lo));
+    Kokkos::parallel_reduce("READER_MAX_RADIUS", HostPolicy(0, counts[s]), [&](const index_t k, double &local) {
+      local = std::max(local, radius(k)); }, Kokkos::Max<double>(hi));
+    system_min_radius[s] = lo;
+    min_radius = std::min(min_radius, lo);
+    max_radius = std::max(max_radius, hi);
+    total += counts[s];
   }
-  
-  if (min_radius <= 0.0) {
+
+  min_radius = Parallel::AllreduceMin(min_radius);
+  max_radius = Parallel::AllreduceMax(max_radius);
+  if (min_radius <= 0.0)
+  {
     std::cerr << "Reader::Initialization: non-positive min radius detected (" << min_radius << "). Aborting.\n";
     data->COMPUTE = false;
     return;
   }
-  data->min_radius=min_radius;
-  std::cout << "Min radius: " << min_radius << ", Max radius: " << max_radius << std::endl;
-  
-  data->simConstants.NN_MAX = (int)(4.0 * 0.74 * (min_radius + max_radius * 1.1) * (min_radius + max_radius * 1.1) / (min_radius * min_radius)) +1;
-  data->simConstants.NN_MAX=data->simConstants.NN_MAX*2;
-  
-  std::cout << "NN max " << data->simConstants.NN_MAX << "\n";
+  if (decomposed)
+    std::cout << "Rank " << Parallel::Rank() << " owns " << total << " particles\n";
+  std::cout << "Particles: " << total << ", Min radius: " << min_radius << ", Max radius: " << max_radius << std::endl;
+  // Refuse to start before allocating when the run would not fit in memory.budget_gb.
+  if (!Memory::CheckBudget(*data, total, Data::neighbourCapacity(min_radius, max_radius)))
+  {
+    data->COMPUTE = false;
+    return;
+  }
 
-  data->NN_IDS = Kokkos::View<int *>("NN_IDS", data->PARTICLE_COUNT * data->simConstants.NN_MAX);  
-  Kokkos::deep_copy(data->NN_IDS, 0);
+  data->allocateParticles(total);
+
+  auto POSITION_host = Kokkos::create_mirror_view(data->POSITION);
+  auto RADIUS_host = Kokkos::create_mirror_view(data->RADIUS);
+  auto OLD_RADIUS_host = Kokkos::create_mirror_view(data->OLD_RADIUS);
+  auto VELOCITY_host = Kokkos::create_mirror_view(data->VELOCITY);
+  auto FIX_host = Kokkos::create_mirror_view(data->FIX);
+  auto IMAGE_host = Kokkos::create_mirror_view(data->IMAGE);
+  const bool periodic = data->PERIODIC.any();
+  const PeriodicBox box = data->PERIODIC;
+  Kokkos::View<int *>::HostMirror SYSTEM_ID_host;
+  if (data->ENSEMBLE)
+  {
+    data->SYSTEM_ID = Kokkos::View<int *>("SYSTEM_ID", total);
+    SYSTEM_ID_host = Kokkos::create_mirror_view(data->SYSTEM_ID);
+  }
+
+  index_t offset = 0;
+  for (size_t s = 0; s < inputs.size(); ++s)
+  {
+    const ParticleInput &input = inputs[s];
+    const index_t *source = decomposed ? owned[s].data() : nullptr;
+    const index_t count = counts[s];
+    const double initial_scale = data->ENSEMBLE ? data->systems[s].simConstants.initial_scale : data->simConstants.initial_scale;
+    const bool ensemble = data->ENSEMBLE;
+
+    Kokkos::parallel_for("READER_CONVERT", HostPolicy(0, count), [&](const index_t k) {
+      const vtkIdType j = source ? source[k] : k;
+      const index_t i = offset + k;
+      FIX_host(i) = input.fix.empty() ? 0 : (int)input.fix.Get(j, 0);
+      VELOCITY_host(i) = input.velocity.empty() ? Vec3(0.0, 0.0, 0.0) : Vec3(input.velocity.Get(j, 0), input.velocity.Get(j, 1), input.velocity.Get(j, 2));
+
+      double r = input.radius.Get(j, 0);
+      if (FIX_host(i) == 0)
+        r = r * initial_scale;
+      Vec3 position(input.position.Get(j, 0), input.position.Get(j, 1), input.position.Get(j, 2));
+      if (periodic)
+      {
+        // Inputs may extend past a periodic face; store the in-box image.
+        int image[3] = {0, 0, 0};
+        box.Wrap(position, image);
+        for (int axis = 0; axis < 3; ++axis)
+          IMAGE_host(i, axis) = image[axis];
+      }
+      POSITION_host(i) = position;
+      RADIUS_host(i) = r;
+      OLD_RADIUS_host(i) = r;
+      if (ensemble)
+        SYSTEM_ID_host(i) = s; });
+
+    if (data->ENSEMBLE)
+    {
+      data->systems[s].offset = offset;
+      data->systems[s].count = count;
+      data->systems[s].min_radius = system_min_radius[s];
+    }
+    offset += count;
+  }
+
+  data->allocateNeighbours(min_radius, max_radius);
 
   Kokkos::deep_copy(data->POSITION, POSITION_host);
   Kokkos::deep_copy(data->RADIUS, RADIUS_host);
   Kokkos::deep_copy(data->OLD_RADIUS, OLD_RADIUS_host);
   Kokkos::deep_copy(data->VELOCITY, VELOCITY_host);
   Kokkos::deep_copy(data->FIX, FIX_host);
+  Kokkos::deep_copy(data->IMAGE, IMAGE_host);
+  if (data->ENSEMBLE)
+  {
+    Kokkos::deep_copy(data->SYSTEM_ID, SYSTEM_ID_host);
+    data->uploadSystems();
+  }
 }
 
 void Reader::Processing() {}
@@ -1,12 +1,18 @@
 #pragma once
 #include "AModule.h"
+#include "ParticleArrays.h"
 
 class Reader : public AModule {
 public:
   Reader(Data *data);
+  // Reads `arrays` instead of simulation.input (single system only).
+  Reader(Data *data, const ParticleArrays &arrays);
   virtual void Initialization();
   virtual std::string getModuleName();
 
 protected:
   virtual void Processing();
-};
\ No newline at end of file
+
+private:
+  const ParticleArrays *arrays = nullptr;
+};
\ No newline at end of file
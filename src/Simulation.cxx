@@ -0,0 +1,170 @@
+#include "Simulation.h"
+#include "ContactSearch.h"
+#include "Forces.h"
+#include "Reader.h"
+#include "Generator.h"
+#include "Time.h"
+#include "Writer.h"
+#include "Integrator.h"
+#include "RadiusScaler.h"
+#include "Domain.h"
+#include "Analysis.h"
+#include "Porosity.h"
+#include "Tuning.h"
+#include "Counters.h"
+#include "TiledStep.h"
+#include "CatalystAdaptor.h"
+
+Simulation::Simulation(const YAML::Node &config)
+{
+  data.config = config;
+  data.yaml.config = config;
+}
+
+Simulation::~Simulation()
+{
+  for (AModule *module : modules)
+    delete module;
+  Tuning::Finalize();
+  Counters::Finalize();
+}
+
+bool Simulation::Setup() { return Start(nullptr); }
+
+bool Simulation::Setup(const ParticleArrays &particles) { return Start(&particles); }
+
+bool Simulation::Start(const ParticleArrays *particles)
+{
+  data.initialize();
+  Tuning::Initialize(data.config["tuning"]);
+  Counters::Initialize(data.config["counters"]);
+  // The initial configuration is either passed in memory, generated in
+  // place or read from simulation.input.
+  if (particles)
+  {
+    Reader reader(&data, *particles);
+    reader.Initialization();
+  }
+  else if (data.config["generator"])
+  {
+    Generator generator(&data);
+    generator.Initialization();
+  }
+  else
+  {
+    Reader reader(&data);
+    reader.Initialization();
+  }
+  if (!data.COMPUTE)
+    return false;
+  // simulation.spatial_sort: Morton order keeps neighbours close in memory;
+  // compressed neighbour lists and the tiled step rely on it and sort by
+  // default.
+  auto tiling = data.config["tiling"];
+  const bool tiled = tiling && !(tiling["enabled"] && !tiling["enabled"].as<bool>());
+#ifdef DENSEPACKING_NEIGHBOUR16
+  bool spatial_sort = true;
+#else
+  bool spatial_sort = tiled;
+#endif
+  if (data.config["simulation"]["spatial_sort"])
+    spatial_sort = data.config["simulation"]["spatial_sort"].as<bool>();
+  if (spatial_sort)
+    data.sortParticles();
+
+  modules.push_back(new RadiusScaler(&data));
+  modules.push_back(new Domain(&data));
+  modules.push_back(new ContactSearch(&data));
+  if (tiled)
+    modules.push_back(new TiledStep(&data));
+  else
+  {
+    modules.push_back(new Forces(&data));
+    modules.push_back(new Integrator(&data));
+  }
+  modules.push_back(new Time(&data));
+  if (data.config["analysis"])
+    modules.push_back(new Analysis(&data));
+  if (data.config["porosity"])
+    modules.push_back(new Porosity(&data));
+  auto catalyst = data.config["catalyst"];
+  if (catalyst && !(catalyst["enabled"] && !catalyst["enabled"].as<bool>()))
+    modules.push_back(new CatalystAdaptor(&data));
+  auto output = data.config["output"];
+  if (!(output["enabled"] && !output["enabled"].as<bool>()))
+    modules.push_back(new Writer(&data));
+
+  for (AModule *module : modules)
+    module->Initialization();
+  // Modules reject their config sections by clearing COMPUTE.
+  return data.COMPUTE;
+}
+
+bool Simulation::Step()
+{
+  const double growth = GrowthState();
+  for (AModule *module : modules)
+    module->RunProcessing();
+  stalled = GrowthState() != growth ? 0 : stalled + 1;
+  return data.COMPUTE;
+}
+
+unsigned long Simulation::Run(unsigned long steps, const StepCallback &callback)
+{
+  unsigned long taken = 0;
+  while (taken < steps && data.COMPUTE)
+  {
+    Step();
+    taken++;
+    if (callback && !callback(*this))
+      break;
+  }
+  return taken;
+}
+
+unsigned long Simulation::RunToConvergence(unsigned long stall_steps, const StepCallback &callback)
+{
+  unsigned long taken = 0;
+  while (data.COMPUTE && stalled < stall_steps)
+  {
+    Step();
+    taken++;
+    if (callback && !callback(*this))
+      break;
+  }
+  return taken;
+}
+
+// The cumulative radius scale; in ensemble mode the sum over the systems.
+double Simulation::GrowthState() const
+{
+  if (!data.ENSEMBLE)
+    return data.simConstants.radius_scale_delta_current;
+  double sum = 0;
+  for (const SystemState &system : data.systems)
+    sum += system.simConstants.radius_scale_delta_current;
+  return sum;
+}
+
+void Simulation::CopyParticles(std::vector<double> &position, std::vector<double> &radius) const
+{
+  const index_t N = data.OWNED_COUNT;
+  auto POSITION = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), data.POSITION);
+#ifdef DENSEPACKING_LAZY_RADIUS
+  const RadiusField RADII = data.Radii();
+  Kokkos::View<double *> SCALED("COPY_RADIUS", N);
+  Kokkos::parallel_for("COPY_RADIUS", N, KOKKOS_LAMBDA(const index_t idx) { SCALED(idx) = RADII(idx); });
+  auto RADIUS = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), SCALED);
+#else
+  auto RADIUS = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), data.RADIUS);
+#endif
+  position.resize(3 * (size_t)N);
+  radius.resize(N);
+  for (index_t i = 0; i < N; ++i)
+  {
+    position[3 * i] = POSITION(i).x;
+    position[3 * i + 1] = POSITION(i).y;
+    position[3 * i + 2] = POSITION(i).z;
+    radius[i] = RADIUS(i);
+  }
+}
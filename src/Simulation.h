@@ -0,0 +1,59 @@
+#pragma once
+#include "Data.h"
+#include "AModule.h"
+#include "ParticleArrays.h"
+#include <yaml-cpp/yaml.h>
+#include <functional>
+#include <vector>
+
+// The simulation pipeline of the DensePacking executable: the initial
+// configuration (Generator, Reader or in-memory arrays), the memory budget
+// check and the module list RadiusScaler, Domain, ContactSearch, Forces,
+// Integrator (or TiledStep in their place), Time [, Analysis, Porosity],
+// Writer. This is the API of the
+// densepacking library; main.cxx and the Python module are built on it.
+// Kokkos (and MPI, if enabled) must be initialized by the caller.
+class Simulation
+{
+public:
+  // Called after every step of Run / RunToConvergence; returning false
+  // stops the run. The particle state is in simulation.data (POSITION,
+  // RADIUS, ... for data.OWNED_COUNT particles).
+  typedef std::function<bool(Simulation &)> StepCallback;
+
+  // `config` takes the place of config.yaml. output.enabled: false leaves
+  // out the Writer, so nothing is written to data/.
+  explicit Simulation(const YAML::Node &config);
+  ~Simulation();
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  // Loads the initial configuration and initializes the modules; false when
+  // the configuration could not be loaded, does not fit memory.budget_gb or
+  // a module rejected its config section.
+  bool Setup();
+  // Same, starting from `particles` instead of the generator or
+  // simulation.input.
+  bool Setup(const ParticleArrays &particles);
+  // One pass through the module list; returns data.COMPUTE.
+  bool Step();
+  // Up to `steps` steps, fewer if the run ends (simulation.total) or the
+  // callback stops it; returns the number of steps taken.
+  unsigned long Run(unsigned long steps, const StepCallback &callback = StepCallback());
+  // Steps until the radii have not grown for `stall_steps` consecutive
+  // steps, i.e. the packing no longer relaxes below overlap_limit, or until
+  // the run ends or the callback stops it; returns the number of steps.
+  unsigned long RunToConvergence(unsigned long stall_steps, const StepCallback &callback = StepCallback());
+  // Steps since the radii last grew.
+  unsigned long StalledSteps() const { return stalled; }
+  // Host copies of the owned particles: position as x y z triples.
+  void CopyParticles(std::vector<double> &position, std::vector<double> &radius) const;
+
+  Data data;
+  std::vector<AModule *> modules;
+
+private:
+  bool Start(const ParticleArrays *particles);
+  double GrowthState() const;
+  unsigned long stalled = 0;
+};
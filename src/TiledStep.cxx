@@ -0,0 +1,137 @@
+#include "TiledStep.h"
+#include "Forces.h"
+#include "Tuning.h"
+#include "Parallel.h"
+#include "Placement.h"
+#include "Memory.h"
+#include <iomanip>
+
+TiledStep::TiledStep(Data *data) : AModule(data), integrator(data) {}
+
+std::string TiledStep::getModuleName() { return "TiledStep"; };
+
+void TiledStep::Initialization()
+{
+  // The bench builds the module without a config.
+  const YAML::Node &root = data->config;
+  const YAML::Node config = root.IsMap() ? root["tiling"] : YAML::Node();
+  const bool section = config.IsMap();
+  const double cache_kb = section && config["cache_kb"] ? config["cache_kb"].as<double>() : 1024.0;
+  if (section && config["tile"])
+    tile = config["tile"].as<index_t>();
+  else
+    tile = (index_t)(cache_kb * 1024.0 / ParticleBytes());
+  // Very small tiles only add scheduling overhead.
+  if (tile < 64)
+    tile = 64;
+}
+
+size_t TiledStep::ParticleBytes() const
+{
+  // POSITION, POSITION_NEXT, VELOCITY, RADIUS, MAX_OVERLAP, FIX, NN_COUNT
+  // and the neighbour list.
+  size_t bytes = 3 * sizeof(Vec3) + 2 * sizeof(double) + 2 * sizeof(int) + sizeof(neighbour_t) * (size_t)data->simConstants.NN_MAX;
+  if (data->PERIODIC.any())
+    bytes += 3 * sizeof(int);
+  return bytes;
+}
+
+double TiledStep::HaloFraction() const
+{
+  const index_t N = data->OWNED_COUNT;
+  const index_t TILE = tile;
+  auto &NN_COUNT = data->NN_COUNT;
+  const NeighbourList NEIGHBOURS = data->Neighbours();
+  long references = 0;
+  long halo = 0;
+  Kokkos::parallel_reduce("TILE_REFERENCES", N, KOKKOS_LAMBDA(const index_t idx, long &sum) { sum += NN_COUNT(idx); }, references);
+  Kokkos::parallel_reduce("TILE_HALO", N, KOKKOS_LAMBDA(const index_t idx, long &sum) {
+    for (int k = 0; k < NN_COUNT(idx); ++k)
+      if (NEIGHBOURS(idx, k) / TILE != idx / TILE)
+        sum++; }, halo);
+  return references > 0 ? (double)halo / references : 0.0;
+}
+
+void TiledStep::Processing()
+{
+  RunKernels();
+  if (!reported && Parallel::IsRoot())
+  {
+    std::cout << "Tiled step: " << (data->OWNED_COUNT + tile - 1) / tile << " tiles of " << tile << " particles ("
+              << std::fixed << std::setprecision(0) << tile * ParticleBytes() / 1024.0 << " KB), "
+              << std::setprecision(1) << 100.0 * HaloFraction() << "% of neighbour references in the halo\n"
+              << std::defaultfloat;
+  }
+  reported = true;
+}
+
+void TiledStep::RunKernels()
+{
+  const index_t N = data->OWNED_COUNT;
+  // POSITION is replaced when Data::reserveParticles or sortParticles
+  // reallocate it.
+  if (POSITION_NEXT.extent(0) != data->POSITION.extent(0))
+  {
+    POSITION_NEXT = Kokkos::View<Vec3 *>();
+    POSITION_NEXT = Placement::Allocate<Kokkos::View<Vec3 *>>("POSITION_NEXT", data->POSITION.extent(0));
+    Memory::Record("TiledStep", "POSITION_NEXT", POSITION_NEXT);
+  }
+  const index_t TILE = tile;
+  const int TILES = (N + TILE - 1) / TILE;
+  if ((int)TILE_MAX.extent(0) < TILES)
+  {
+    TILE_MAX = Kokkos::View<double *>("TILE_MAX", TILES);
+    Memory::Record("TiledStep", "TILE_MAX", TILE_MAX);
+  }
+
+  const ParticleForces FORCE(*data);
+  auto &POSITION = data->POSITION;
+  auto &NEXT = this->POSITION_NEXT;
+  auto &VELOCITY = data->VELOCITY;
+  auto &FIX = data->FIX;
+  auto &MAX_OVERLAP = data->MAX_OVERLAP;
+  auto &IMAGE = data->IMAGE;
+  auto &MAXIMA = this->TILE_MAX;
+  const PeriodicBox BOX = data->PERIODIC;
+
+  // Same per-particle work as the FORCES and INTEGRATION kernels.
+  typedef Kokkos::TeamPolicy<>::member_type member_type;
+  Tuning::TeamFor("TILED_STEP", TILES, KOKKOS_LAMBDA(const member_type &team) {
+    const index_t begin = (index_t)team.league_rank() * TILE;
+    const index_t end = begin + TILE < N ? begin + TILE : N;
+    double tile_max = 0.0;
+    Kokkos::parallel_reduce(Kokkos::TeamThreadRange(team, begin, end), [&](const index_t idx, double &local) {
+      Vec3 pos = POSITION(idx);
+      if (FIX(idx) == 0)
+      {
+        double maxas = 0;
+        VELOCITY(idx) = FORCE(idx, maxas);
+        MAX_OVERLAP(idx) = maxas;
+      }
+      if (FIX(idx) <= 0)
+        pos = Integrator::Advance(idx, pos, VELOCITY(idx), BOX, IMAGE);
+      NEXT(idx) = pos;
+      if (MAX_OVERLAP(idx) > local) local = MAX_OVERLAP(idx);
+    }, Kokkos::Max<double>(tile_max));
+    if (team.team_rank() == 0)
+      MAXIMA(team.league_rank()) = tile_max;
+  });
+  // Copied back rather than swapped: POSITION keeps its allocation, which
+  // the Python arrays share and the first-touch placement put on its nodes.
+  // Ghosts are not moved here; Domain refreshes them next step.
+  Kokkos::parallel_for("TILED_POSITION", Placement::Policy(0, N), KOKKOS_LAMBDA(const index_t idx) { POSITION(idx) = NEXT(idx); });
+
+  if (data->ENSEMBLE)
+  {
+    integrator.ReduceSystemOverlaps();
+    return;
+  }
+  auto TILE_MAX_host = Kokkos::create_mirror_view(TILE_MAX);
+  Kokkos::deep_copy(TILE_MAX_host, TILE_MAX);
+  double max_val = 0.0;
+  for (int t = 0; t < TILES; ++t)
+    if (TILE_MAX_host(t) > max_val)
+      max_val = TILE_MAX_host(t);
+  // The growth decision in RadiusScaler must be the same on every rank.
+  data->simConstants.maxOverlap = Parallel::AllreduceMax(max_val);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "AModule.h"
+#include "Integrator.h"
+
+// Cache-blocked Forces + Integrator (config.yaml "tiling"). The owned
+// particles, in Morton order (simulation.spatial_sort), are cut into tiles
+// whose per-particle data fits tiling.cache_kb, and one team works through
+// a tile at a time: contact forces, the position update and the tile's
+// largest overlap in a single pass, while the tile is still in cache.
+// Neighbours in other tiles (the halo) are read from POSITION, which holds
+// the positions of the start of the step until the pass ends; the new ones
+// go to a second buffer that is copied back afterwards. Results are the same
+// as with the separate modules.
+class TiledStep : public AModule
+{
+public:
+  TiledStep(Data *data);
+  virtual void Initialization();
+  virtual std::string getModuleName();
+  void RunKernels();
+
+  index_t TileSize() const { return tile; }
+  // Share of the neighbour references of the current lists that point
+  // outside the particle's own tile.
+  double HaloFraction() const;
+
+protected:
+  virtual void Processing();
+
+private:
+  // Bytes each particle brings into the cache during the pass.
+  size_t ParticleBytes() const;
+
+  index_t tile = 0;
+  bool reported = false;
+  Kokkos::View<Vec3 *> POSITION_NEXT;
+  Kokkos::View<double *> TILE_MAX;
+  // Its ReduceSystemOverlaps gives the per-system maxOverlap in ensemble mode.
+  Integrator integrator;
+};
@@ -5,7 +5,7 @@ std::string Time::getModuleName() { return "Time"; };
 
 void Time::Initialization()
 {
-  data->COMPUTE = true;
+  // COMPUTE stays false when an earlier module rejected its config.
   data->CONTACT_SEARCH = true;
   data->WRITE_RESULTS = true;
   data->PRINT_TIMES = true;
@@ -24,7 +24,8 @@ void Time::Processing()
   data->PRINT_TIMES = (data->cstep % this->PRINT_TIMES_SKIP == 0);
   data->CONTACT_SEARCH = (data->cstep % this->CONTACT_SEARCH_SKIP == 0);
   data->WRITE_RESULTS = (data->cstep % this->WRITE_RESULTS_SKIP == 0);
-  data->COMPUTE = (data->cstep <= this->END);
+  if (data->cstep > this->END)
+    data->COMPUTE = false;
   //   if(data->simConstants.maxOverlap<data->simConstants.overlap_limit)
   // {
   //   data->WRITE_RESULTS=true;
@@ -0,0 +1,185 @@
+#include "TimeSeries.h"
+#include <cstring>
+
+namespace
+{
+  template <class T>
+  bool WriteArray(FILE *file, const T *values, size_t n)
+  {
+    return n == 0 || std::fwrite(values, sizeof(T), n, file) == n;
+  }
+
+  template <class T>
+  bool ReadArray(FILE *file, T *values, size_t n)
+  {
+    return n == 0 || std::fread(values, sizeof(T), n, file) == n;
+  }
+}
+
+namespace TimeSeries
+{
+  SeriesWriter::~SeriesWriter()
+  {
+    if (file)
+      std::fclose(file);
+  }
+
+  bool SeriesWriter::Open(const std::string &filename, index_t count, const int *fix, const Vec3 *position,
+                          const double *radius, bool delta, int keyframe_interval)
+  {
+    file = std::fopen(filename.c_str(), "wb");
+    if (!file)
+      return false;
+    this->count = count;
+    this->delta = delta;
+    this->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 1;
+
+    std::vector<int32_t> fix32(count);
+    std::vector<double> fixed_position, fixed_radius;
+    for (index_t i = 0; i < count; ++i)
+    {
+      fix32[i] = fix[i];
+      if (fix[i] > 0)
+      {
+        for (int axis = 0; axis < 3; ++axis)
+          fixed_position.push_back(position[i][axis]);
+        fixed_radius.push_back(radius[i]);
+      }
+      else
+        free_ids.push_back(i);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.count = count;
+    header.fixed = fixed_radius.size();
+    header.flags = delta ? (uint32_t)SERIES_DELTA : 0;
+    header.keyframe_interval = this->keyframe_interval;
+    if (!WriteArray(file, &header, 1) || !WriteArray(file, fix32.data(), fix32.size()) ||
+        !WriteArray(file, fixed_position.data(), fixed_position.size()) ||
+        !WriteArray(file, fixed_radius.data(), fixed_radius.size()))
+      return false;
+    end = ftello(file);
+    return true;
+  }
+
+  bool SeriesWriter::Append(uint64_t step, const Vec3 *position, const double *radius, const double *max_overlap)
+  {
+    const size_t F = free_ids.size();
+    FrameHeader frame{};
+    frame.step = step;
+    frame.keyframe = !delta || index.size() % keyframe_interval == 0;
+    if (fseeko(file, end, SEEK_SET) != 0 || !WriteArray(file, &frame, 1))
+      return false;
+
+    bool ok = true;
+    if (frame.keyframe)
+    {
+      key_position.resize(3 * F);
+      key_radius.resize(F);
+      for (size_t k = 0; k < F; ++k)
+      {
+        for (int axis = 0; axis < 3; ++axis)
+          key_position[3 * k + axis] = position[free_ids[k]][axis];
+        key_radius[k] = radius[free_ids[k]];
+      }
+      ok = WriteArray(file, key_position.data(), key_position.size()) && WriteArray(file, key_radius.data(), F);
+    }
+    else
+    {
+      std::vector<float> delta_position(3 * F), delta_radius(F);
+      for (size_t k = 0; k < F; ++k)
+      {
+        for (int axis = 0; axis < 3; ++axis)
+          delta_position[3 * k + axis] = float(position[free_ids[k]][axis] - key_position[3 * k + axis]);
+        delta_radius[k] = float(radius[free_ids[k]] - key_radius[k]);
+      }
+      ok = WriteArray(file, delta_position.data(), delta_position.size()) && WriteArray(file, delta_radius.data(), F);
+    }
+    ok = ok && WriteArray(file, max_overlap, count);
+    if (!ok)
+      return false;
+
+    const uint64_t keyframe_offset = frame.keyframe ? end : index.back().keyframe_offset;
+    index.push_back({step, end, keyframe_offset});
+    end = ftello(file);
+
+    // The index and trailer follow the last frame and are overwritten by the next one.
+    Trailer trailer{};
+    trailer.index_offset = end;
+    trailer.frames = index.size();
+    std::memcpy(trailer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    return WriteArray(file, index.data(), index.size()) && WriteArray(file, &trailer, 1) && std::fflush(file) == 0;
+  }
+
+  SeriesReader::~SeriesReader()
+  {
+    if (file)
+      std::fclose(file);
+  }
+
+  bool SeriesReader::Open(const std::string &filename)
+  {
+    file = std::fopen(filename.c_str(), "rb");
+    if (!file || !ReadArray(file, &header, 1) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+      return false;
+    fix.resize(header.count);
+    fixed_position.resize(3 * header.fixed);
+    fixed_radius.resize(header.fixed);
+    if (!ReadArray(file, fix.data(), fix.size()) || !ReadArray(file, fixed_position.data(), fixed_position.size()) ||
+        !ReadArray(file, fixed_radius.data(), fixed_radius.size()))
+      return false;
+    for (uint64_t i = 0; i < header.count; ++i)
+      (fix[i] > 0 ? fixed_ids : free_ids).push_back(i);
+    if (fixed_ids.size() != header.fixed)
+      return false;
+
+    Trailer trailer{};
+    if (fseeko(file, -off_t(sizeof(Trailer)), SEEK_END) != 0 || !ReadArray(file, &trailer, 1) ||
+        std::memcmp(trailer.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+      return false;
+    index.resize(trailer.frames);
+    return fseeko(file, trailer.index_offset, SEEK_SET) == 0 && ReadArray(file, index.data(), index.size());
+  }
+
+  bool SeriesReader::Read(size_t frame, Frame &out)
+  {
+    if (frame >= index.size())
+      return false;
+    const IndexEntry &entry = index[frame];
+    const size_t N = header.count;
+    const size_t F = free_ids.size();
+    out.step = entry.step;
+    out.position.resize(N);
+    out.radius.resize(N);
+    out.max_overlap.resize(N);
+    for (size_t k = 0; k < fixed_ids.size(); ++k)
+    {
+      out.position[fixed_ids[k]] = Vec3(&fixed_position[3 * k]);
+      out.radius[fixed_ids[k]] = fixed_radius[k];
+    }
+
+    std::vector<double> position(3 * F), radius(F);
+    FrameHeader frameHeader{};
+    if (fseeko(file, entry.keyframe_offset, SEEK_SET) != 0 || !ReadArray(file, &frameHeader, 1) || !frameHeader.keyframe ||
+        !ReadArray(file, position.data(), position.size()) || !ReadArray(file, radius.data(), F))
+      return false;
+    if (entry.offset != entry.keyframe_offset)
+    {
+      std::vector<float> delta_position(3 * F), delta_radius(F);
+      if (fseeko(file, entry.offset, SEEK_SET) != 0 || !ReadArray(file, &frameHeader, 1) ||
+          !ReadArray(file, delta_position.data(), delta_position.size()) || !ReadArray(file, delta_radius.data(), F))
+        return false;
+      for (size_t k = 0; k < 3 * F; ++k)
+        position[k] += delta_position[k];
+      for (size_t k = 0; k < F; ++k)
+        radius[k] += delta_radius[k];
+    }
+    for (size_t k = 0; k < F; ++k)
+    {
+      out.position[free_ids[k]] = Vec3(&position[3 * k]);
+      out.radius[free_ids[k]] = radius[k];
+    }
+    return ReadArray(file, out.max_overlap.data(), N);
+  }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "DataTypes.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Single-file time series (*.dpts) written by Writer with output.series.
+// Static data is stored once; every frame appends the dynamic arrays and
+// the trailing frame index is rewritten, so any frame can be read directly.
+// Layout (little endian, no padding):
+//   Header
+//   int32  fix[count]
+//   double position[3 * fixed], radius[fixed]    particles with FIX > 0, in order
+//   frames:
+//     FrameHeader
+//     keyframe:   double position[3 * free], radius[free]
+//     delta:      float  position[3 * free], radius[free], relative to the
+//                 frame's keyframe (only with SERIES_DELTA)
+//     double max_overlap[count]
+//   IndexEntry index[frames]
+//   Trailer
+// scripts/ReadSeries.py reads frames from Python.
+namespace TimeSeries
+{
+  constexpr char MAGIC[8] = {'D', 'P', 'T', 'S', '0', '0', '0', '1'};
+  constexpr char INDEX_MAGIC[8] = {'D', 'P', 'T', 'S', 'I', 'D', 'X', '1'};
+  constexpr const char *EXTENSION = ".dpts";
+
+  enum Flags : uint32_t
+  {
+    SERIES_DELTA = 1
+  };
+
+  struct Header
+  {
+    char magic[8];
+    uint64_t count;
+    uint64_t fixed;
+    uint32_t flags;
+    uint32_t keyframe_interval;
+  };
+  static_assert(sizeof(Header) == 32, "TimeSeries::Header must stay 32 bytes");
+
+  struct FrameHeader
+  {
+    uint64_t step;
+    uint32_t keyframe;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(FrameHeader) == 16, "TimeSeries::FrameHeader must stay 16 bytes");
+
+  struct IndexEntry
+  {
+    uint64_t step;
+    uint64_t offset;
+    uint64_t keyframe_offset;
+  };
+  static_assert(sizeof(IndexEntry) == 24, "TimeSeries::IndexEntry must stay 24 bytes");
+
+  struct Trailer
+  {
+    uint64_t index_offset;
+    uint64_t frames;
+    char magic[8];
+  };
+  static_assert(sizeof(Trailer) == 24, "TimeSeries::Trailer must stay 24 bytes");
+
+  struct Frame
+  {
+    uint64_t step = 0;
+    std::vector<Vec3> position;
+    std::vector<double> radius;
+    std::vector<double> max_overlap;
+  };
+
+  class SeriesWriter
+  {
+  public:
+    ~SeriesWriter();
+    // Writes the header and the static arrays taken from the first frame.
+    bool Open(const std::string &filename, index_t count, const int *fix, const Vec3 *position, const double *radius,
+              bool delta, int keyframe_interval);
+    // Appends a frame of `count` particles and rewrites the index.
+    bool Append(uint64_t step, const Vec3 *position, const double *radius, const double *max_overlap);
+    index_t Count() const { return count; }
+
+  private:
+    FILE *file = nullptr;
+    index_t count = 0;
+    bool delta = false;
+    int keyframe_interval = 1;
+    std::vector<index_t> free_ids;
+    std::vector<double> key_position;
+    std::vector<double> key_radius;
+    std::vector<IndexEntry> index;
+    uint64_t end = 0;
+  };
+
+  class SeriesReader
+  {
+  public:
+    ~SeriesReader();
+    bool Open(const std::string &filename);
+    size_t Frames() const { return index.size(); }
+    uint64_t Step(size_t frame) const { return index[frame].step; }
+    const std::vector<int> &Fix() const { return fix; }
+    // Random access: reads the frame's keyframe and, for a delta frame, the frame itself.
+    bool Read(size_t frame, Frame &out);
+
+  private:
+    FILE *file = nullptr;
+    Header header{};
+    std::vector<int> fix;
+    std::vector<index_t> fixed_ids;
+    std::vector<index_t> free_ids;
+    std::vector<double> fixed_position;
+    std::vector<double> fixed_radius;
+    std::vector<IndexEntry> index;
+  };
+}
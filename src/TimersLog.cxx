@@ -0,0 +1,50 @@
+#include "TimersLog.h"
+#include <fstream>
+#include <sstream>
+
+TimersLog::TimersLog(const std::string &filename, const std::vector<AModule *> &modules)
+{
+  this->filename = filename;
+  this->modules = modules;
+
+  std::stringstream csvHeader;
+  csvHeader << "STEP;OVERLAP;RADIUS_SCALE_DELTA;RELAXATION_COEFFICIENT";
+  for (int i = 0; i < modules.size(); ++i)
+  {
+    csvHeader << ";" << modules[i]->getModuleName();
+  }
+  csvHeader << ";Total\n";
+
+  if (filename.empty())
+    return;
+  std::ofstream file(filename);
+  file << csvHeader.str();
+  file.close();
+}
+
+std::vector<double> TimersLog::Record(const Data &data)
+{
+  double total = 0.0;
+  std::vector<double> times(modules.size());
+  for (int i = 0; i < modules.size(); ++i)
+  {
+    times[i] = modules[i]->getModuleWorkTime();
+    total += times[i];
+  }
+
+  std::stringstream csvLine;
+  csvLine << data.cstep << ";" << data.simConstants.maxOverlap << ";" << data.simConstants.radius_scale_delta_current << ";" << data.simConstants.relaxation_coefficient;
+  for (double t : times)
+  {
+    csvLine << ";" << t;
+  }
+  csvLine << ";" << total << "\n";
+
+  times.push_back(total);
+  if (filename.empty())
+    return times;
+  std::ofstream file(filename, std::ios_base::app);
+  file << csvLine.str();
+  file.close();
+  return times;
+}
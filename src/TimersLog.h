@@ -0,0 +1,20 @@
+#pragma once
+#include "AModule.h"
+#include <string>
+#include <vector>
+
+// Appends per-module timings to a semicolon-separated CSV (timers.csv).
+// One row per call; every module column holds the time accumulated since
+// the previous row, so summing a column gives the module's total time.
+// An empty filename only collects the times (used on non-root MPI ranks).
+class TimersLog
+{
+public:
+  TimersLog(const std::string &filename, const std::vector<AModule *> &modules);
+  // Writes one CSV row and returns the module times followed by their total.
+  std::vector<double> Record(const Data &data);
+
+private:
+  std::string filename;
+  std::vector<AModule *> modules;
+};
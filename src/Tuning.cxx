@@ -0,0 +1,278 @@
+#include "Tuning.h"
+#include "Parallel.h"
+#include "YamlAPI.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace Tuning
+{
+  // Search state of one kernel and N bucket.
+  struct Entry
+  {
+    std::string kernel;
+    int64_t bucket = 0;
+    bool team = false;
+    std::vector<Choice> candidates;
+    std::vector<double> best;
+    size_t next = 0;
+    int trial = 0;
+    bool done = false;
+    Choice choice;
+  };
+}
+
+namespace
+{
+  using namespace Kokkos::Tools::Experimental;
+
+  bool enabled = false;
+  bool tool = false;
+  int trials = 3;
+  std::string cache_file;
+  std::string node;
+  YAML::Node cache;
+  bool dirty = false;
+  std::map<std::string, Tuning::Entry> entries;
+
+  // Kokkos Tools tuning variables.
+  size_t kernel_input = 0, size_input = 0;
+  size_t schedule_output = 0, chunk_output = 0, team_output = 0, vector_output = 0;
+
+  const int CHUNKS[] = {0, 8, 32, 128, 512, 2048};
+  const int TEAM_SIZES[] = {0, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+  const int VECTOR_LENGTHS[] = {1, 2, 4, 8, 16, 32};
+
+  int64_t Bucket(int64_t n)
+  {
+    int64_t bucket = 1;
+    while (bucket * 2 <= n)
+      bucket *= 2;
+    return bucket;
+  }
+
+  bool Fits(const Tuning::Choice &c, int team_size_max)
+  {
+    return c.first * std::max(c.second, 1) <= team_size_max && c.second <= Kokkos::TeamPolicy<>::vector_length_max();
+  }
+
+  std::string Describe(const Tuning::Entry &entry, const Tuning::Choice &c)
+  {
+    std::stringstream text;
+    if (entry.team)
+      text << "team_size " << (c.first == 0 ? std::string("AUTO") : std::to_string(c.first)) << ", vector_length " << c.second;
+    else
+      text << (c.first == Tuning::DYNAMIC ? "dynamic" : "static") << ", chunk " << (c.second == 0 ? std::string("default") : std::to_string(c.second));
+    return text.str();
+  }
+
+  // Settings learned by an earlier run on this node type, if any.
+  bool FromCache(Tuning::Entry &entry, int team_size_max)
+  {
+    YAML::Node saved = cache[node][entry.kernel][std::to_string(entry.bucket)];
+    if (!saved || !saved.IsMap())
+      return false;
+    Tuning::Choice c;
+    if (entry.team)
+    {
+      if (!saved["team_size"] || !saved["vector_length"])
+        return false;
+      c.first = saved["team_size"].as<int>();
+      c.second = saved["vector_length"].as<int>();
+      if (!Fits(c, team_size_max))
+        return false;
+    }
+    else
+    {
+      if (!saved["schedule"] || !saved["chunk"])
+        return false;
+      c.first = saved["schedule"].as<std::string>() == "dynamic" ? Tuning::DYNAMIC : Tuning::STATIC;
+      c.second = saved["chunk"].as<int>();
+    }
+    entry.choice = c;
+    entry.done = true;
+    return true;
+  }
+
+  Tuning::Entry &Lookup(const char *kernel, int64_t n, bool team, int team_size_max)
+  {
+    const int64_t bucket = Bucket(n);
+    const std::string key = std::string(kernel) + "@" + std::to_string(bucket);
+    auto found = entries.find(key);
+    if (found != entries.end())
+      return found->second;
+
+    Tuning::Entry &entry = entries[key];
+    entry.kernel = kernel;
+    entry.bucket = bucket;
+    entry.team = team;
+    if (FromCache(entry, team_size_max))
+      return entry;
+    if (team)
+    {
+      for (int v : VECTOR_LENGTHS)
+        for (int t : TEAM_SIZES)
+          if (Fits(Tuning::Choice{t, v}, team_size_max))
+            entry.candidates.push_back(Tuning::Choice{t, v});
+    }
+    else
+    {
+      for (int schedule : {Tuning::STATIC, Tuning::DYNAMIC})
+        for (int chunk : CHUNKS)
+          entry.candidates.push_back(Tuning::Choice{schedule, chunk});
+    }
+    entry.best.assign(entry.candidates.size(), std::numeric_limits<double>::max());
+    return entry;
+  }
+
+  // Keeps the best of `trials` timings per candidate; after the last one the
+  // fastest candidate is fixed and stored in the cache.
+  void Record(Tuning::Entry &entry, double seconds)
+  {
+    entry.best[entry.next] = std::min(entry.best[entry.next], seconds);
+    if (++entry.trial < trials)
+      return;
+    entry.trial = 0;
+    if (++entry.next < entry.candidates.size())
+      return;
+    const size_t fastest = std::min_element(entry.best.begin(), entry.best.end()) - entry.best.begin();
+    entry.choice = entry.candidates[fastest];
+    entry.done = true;
+
+    YAML::Node saved;
+    if (entry.team)
+    {
+      saved["team_size"] = entry.choice.first;
+      saved["vector_length"] = entry.choice.second;
+    }
+    else
+    {
+      saved["schedule"] = entry.choice.first == Tuning::DYNAMIC ? "dynamic" : "static";
+      saved["chunk"] = entry.choice.second;
+    }
+    cache[node][entry.kernel][std::to_string(entry.bucket)] = saved;
+    dirty = true;
+    if (Parallel::IsRoot())
+      std::cout << "Tuning: " << entry.kernel << " (N ~ " << entry.bucket << "): " << Describe(entry, entry.choice) << ", "
+                << std::fixed << std::setprecision(3) << entry.best[fastest] * 1E3 << " ms\n";
+  }
+
+  size_t DeclareSet(const std::string &name, std::vector<int64_t> &values)
+  {
+    VariableInfo info;
+    info.type = ValueType::kokkos_value_int64;
+    info.category = StatisticalCategory::kokkos_value_categorical;
+    info.valueQuantity = CandidateValueType::kokkos_value_set;
+    info.candidates = make_candidate_set(values.size(), values.data());
+    return declare_output_type(name, info);
+  }
+
+  void DeclareToolVariables()
+  {
+    VariableInfo kernel;
+    kernel.type = ValueType::kokkos_value_string;
+    kernel.category = StatisticalCategory::kokkos_value_categorical;
+    kernel.valueQuantity = CandidateValueType::kokkos_value_unbounded;
+    kernel_input = declare_input_type("densepacking_kernel", kernel);
+    VariableInfo size;
+    size.type = ValueType::kokkos_value_int64;
+    size.category = StatisticalCategory::kokkos_value_interval;
+    size.valueQuantity = CandidateValueType::kokkos_value_unbounded;
+    size_input = declare_input_type("densepacking_n", size);
+
+    // The candidate arrays must outlive the declarations.
+    static std::vector<int64_t> schedules = {Tuning::STATIC, Tuning::DYNAMIC};
+    static std::vector<int64_t> chunks(std::begin(CHUNKS), std::end(CHUNKS));
+    static std::vector<int64_t> teams(std::begin(TEAM_SIZES), std::end(TEAM_SIZES));
+    static std::vector<int64_t> vectors(std::begin(VECTOR_LENGTHS), std::end(VECTOR_LENGTHS));
+    schedule_output = DeclareSet("densepacking_schedule", schedules);
+    chunk_output = DeclareSet("densepacking_chunk_size", chunks);
+    team_output = DeclareSet("densepacking_team_size", teams);
+    vector_output = DeclareSet("densepacking_vector_length", vectors);
+  }
+}
+
+namespace Tuning
+{
+  void Initialize(const YAML::Node &config)
+  {
+    enabled = config && !(config["enabled"] && !config["enabled"].as<bool>());
+    if (!enabled)
+      return;
+    trials = config["trials"] ? std::max(1, config["trials"].as<int>()) : 3;
+    cache_file = config["cache"] ? config["cache"].as<std::string>() : "tuning_cache.yaml";
+    // Node types that share backend and concurrency can be told apart with tuning.node.
+    node = config["node"] ? config["node"].as<std::string>()
+                          : std::string(Kokkos::DefaultExecutionSpace::name()) + "_" + std::to_string(Kokkos::DefaultExecutionSpace().concurrency());
+    tool = have_tuning_tool();
+    if (tool)
+      DeclareToolVariables();
+    else
+      cache = YamlAPI::LoadConfig(cache_file);
+    if (Parallel::IsRoot())
+      std::cout << "Tuning: " << (tool ? "Kokkos Tools tuning tool" : "built-in search, cache " + cache_file) << ", node " << node << "\n";
+  }
+
+  void Finalize()
+  {
+    if (!enabled || !dirty || !Parallel::IsRoot())
+      return;
+    std::ofstream out(cache_file);
+    out << cache << "\n";
+    if (!out)
+      std::cerr << "Tuning: failed to write " << cache_file << "\n";
+    dirty = false;
+  }
+
+  bool Enabled() { return enabled; }
+
+  Launch::Launch(const char *kernel, int64_t n, bool team, int team_size_max)
+  {
+    if (tool)
+    {
+      const std::string name(kernel);
+      context = get_new_context_id();
+      begin_context(context);
+      VariableValue inputs[2] = {make_variable_value(kernel_input, name), make_variable_value(size_input, n)};
+      set_input_values(context, 2, inputs);
+      VariableValue outputs[2] = {make_variable_value(team ? team_output : schedule_output, int64_t(team ? 0 : STATIC)),
+                                  make_variable_value(team ? vector_output : chunk_output, int64_t(team ? 1 : 0))};
+      request_output_values(context, 2, outputs);
+      choice.first = outputs[0].value.int_value;
+      choice.second = outputs[1].value.int_value;
+      if (team && !Fits(choice, team_size_max))
+        choice = Choice{0, 1};
+      return;
+    }
+    entry = &Lookup(kernel, n, team, team_size_max);
+    if (entry->done)
+    {
+      choice = entry->choice;
+      return;
+    }
+    choice = entry->candidates[entry->next];
+    Kokkos::fence();
+    timed = true;
+    start = std::chrono::steady_clock::now();
+  }
+
+  Launch::~Launch()
+  {
+    if (context != 0)
+    {
+      // The tool times the context, so the kernel has to be finished.
+      Kokkos::fence();
+      end_context(context);
+      return;
+    }
+    if (!timed)
+      return;
+    Kokkos::fence();
+    Record(*entry, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "DataTypes.h"
+#include <yaml-cpp/yaml.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Launch-parameter tuning for the step kernels (config.yaml "tuning").
+// Tuning::For picks the schedule and chunk size of a range kernel and
+// Tuning::TeamFor the team size and vector length of a team kernel, per
+// kernel name and power-of-two bucket of N:
+//  - with a Kokkos Tools tuning tool loaded (KOKKOS_TOOLS_LIBS) every launch
+//    asks the tool through the Kokkos Tools tuning interface;
+//  - otherwise every candidate is timed tuning.trials times, the fastest is
+//    kept for the rest of the run and saved to tuning.cache under the node
+//    name, so later runs on the same node type start with it.
+// Without the section every launch is the plain default policy.
+namespace Tuning
+{
+  enum Schedule
+  {
+    STATIC = 0,
+    DYNAMIC = 1
+  };
+
+  // chunk 0 and team_size 0 leave the choice to Kokkos (Kokkos::AUTO).
+  struct Choice
+  {
+    int first = 0;  // schedule, or team size
+    int second = 0; // chunk size, or vector length
+  };
+
+  void Initialize(const YAML::Node &config);
+  // Saves newly learned settings to the cache.
+  void Finalize();
+  bool Enabled();
+
+  struct Entry;
+
+  // One tuned launch: the constructor picks the parameters and the
+  // destructor reports how long the launch took (fencing only while the
+  // kernel is still being searched or a tool is listening).
+  class Launch
+  {
+  public:
+    Launch(const char *kernel, int64_t n, bool team, int team_size_max);
+    ~Launch();
+    Choice choice;
+
+  private:
+    Entry *entry = nullptr;
+    size_t context = 0;
+    bool timed = false;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  template <class Policy>
+  Policy WithChunk(Policy policy, int chunk)
+  {
+    if (chunk > 0)
+      policy.set_chunk_size(chunk);
+    return policy;
+  }
+
+  template <class Functor>
+  void For(const char *kernel, index_t begin, index_t end, const Functor &f)
+  {
+    if (!Enabled())
+    {
+      Kokkos::parallel_for(kernel, Kokkos::RangePolicy<>(begin, end), f);
+      return;
+    }
+    Launch launch(kernel, end - begin, false, 0);
+    if (launch.choice.first == DYNAMIC)
+      Kokkos::parallel_for(kernel, WithChunk(Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Dynamic>>(begin, end), launch.choice.second), f);
+    else
+      Kokkos::parallel_for(kernel, WithChunk(Kokkos::RangePolicy<Kokkos::Schedule<Kokkos::Static>>(begin, end), launch.choice.second), f);
+  }
+
+  template <class Functor>
+  void TeamFor(const char *kernel, int league, const Functor &f)
+  {
+    if (!Enabled())
+    {
+      Kokkos::parallel_for(kernel, Kokkos::TeamPolicy<>(league, Kokkos::AUTO), f);
+      return;
+    }
+    const int team_size_max = Kokkos::TeamPolicy<>(league, 1).team_size_max(f, Kokkos::ParallelForTag());
+    Launch launch(kernel, league, true, team_size_max);
+    const int vector_length = launch.choice.second > 0 ? launch.choice.second : 1;
+    if (launch.choice.first == 0)
+      Kokkos::parallel_for(kernel, Kokkos::TeamPolicy<>(league, Kokkos::AUTO, vector_length), f);
+    else
+      Kokkos::parallel_for(kernel, Kokkos::TeamPolicy<>(league, launch.choice.first, vector_length), f);
+  }
+}
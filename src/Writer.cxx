@@ -1,7 +1,12 @@
 #include "Writer.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <unordered_map>
 #include <vector>
 
 // VTK Includes
@@ -9,13 +14,41 @@
 #include <vtkPolyData.h>
 #include <vtkPoints.h>
 #include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
 #include <vtkIntArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkDataSetAttributes.h>
 #include <vtkXMLPolyDataWriter.h>
 #include <vtkPointData.h>
 #include <vtkCellArray.h>
 
 
 
+namespace
+{
+    template <class Mirror, class ViewType>
+    void CopyOut(Mirror &host, const ViewType &device)
+    {
+        host = Kokkos::create_mirror_view(device);
+        Kokkos::deep_copy(host, device);
+    }
+
+    // Creates a named VTK array of `tuples` x `components` filled from get(tuple, component).
+    template <class ArrayType, class Getter>
+    vtkSmartPointer<vtkDataArray> MakeArray(const char *name, int components, index_t tuples, Getter get)
+    {
+        auto arr = vtkSmartPointer<ArrayType>::New();
+        arr->SetName(name);
+        arr->SetNumberOfComponents(components);
+        arr->SetNumberOfTuples(tuples);
+        auto *out = arr->GetPointer(0);
+        for (index_t j = 0; j < tuples; ++j)
+            for (int c = 0; c < components; ++c)
+                out[j * components + c] = get(j, c);
+        return vtkSmartPointer<vtkDataArray>(arr.Get());
+    }
+}
+
 Writer::Writer(Data *data) : AModule(data) {}
 std::string Writer::getModuleName() { return "Writer"; };
 
@@ -23,166 +56,490 @@ void Writer::Initialization()
 {
     namespace fs = std::filesystem;
     const std::string dir = "data";
+
+    // Optional output format; without an "output" section the XML writer defaults are kept.
+    auto output = data->yaml.config["output"];
+    binary = output["binary"] && output["binary"].as<bool>();
+    float32 = output["float32"] && output["float32"].as<bool>();
+    pieces = output["pieces"] ? output["pieces"].as<int>() : 1;
+    compression_level = output["compression_level"] ? output["compression_level"].as<int>() : -1;
+    compression = output["compression"] ? output["compression"].as<std::string>() : "";
+    if (compression == "zstd")
+    {
+        // VTK's XML writers have no ZSTD compressor; LZ4 is the fast one they do have.
+        if (Parallel::IsRoot())
+            std::cerr << "Writer::Initialization: zstd is not available in VTK, using lz4.\n";
+        compression = "lz4";
+    }
+    if (!compression.empty() && compression != "none" && compression != "lz4" && compression != "zlib" && compression != "lzma")
+    {
+        std::cerr << "Writer::Initialization: output.compression must be none, lz4, zlib or lzma.\n";
+        data->COMPUTE = false;
+        return;
+    }
+    series = output["series"] && output["series"].as<bool>();
+    series_delta = output["series_delta"] && output["series_delta"].as<bool>();
+    keyframe_interval = output["keyframe_interval"] ? output["keyframe_interval"].as<int>() : 10;
+    if (series && Parallel::Size() > 1)
+    {
+        // Particles migrate between ranks, so no rank keeps a fixed particle set.
+        std::cerr << "Writer::Initialization: output.series cannot be combined with MPI.\n";
+        data->COMPUTE = false;
+        return;
+    }
+    seriesFiles.resize(data->ENSEMBLE ? data->systems.size() : 1);
+    if (pieces < 1)
+    {
+        std::cerr << "Writer::Initialization: output.pieces must be at least 1.\n";
+        data->COMPUTE = false;
+        return;
+    }
     // Using fs::create_directories handles creation even if parent directories don't exist.
     // However, the original logic was to clean the directory, so we keep that.
     
-    if (fs::exists(dir))
+    if (Parallel::IsRoot())
+    {
+        if (fs::exists(dir))
+        {
+            fs::remove_all(dir);
+        }
+        fs::create_directory(dir);
+    }
+    Parallel::Barrier();
+    for (size_t s = 0; s < data->systems.size(); ++s)
     {
-        fs::remove_all(dir);
+        std::stringstream systemDir;
+        systemDir << dir << "/SYSTEM_" << std::setfill('0') << std::setw(4) << s;
+        fs::create_directory(systemDir.str());
     }
-    fs::create_directory(dir);
     Processing(); // Initial write to create the first file with initial conditions
 }
 
 void Writer::Processing()
 {
+    if (data->ENSEMBLE)
+    {
+        // Each system writes its own series once it is within its overlap limit.
+        bool any = false;
+        for (const auto &system : data->systems)
+            any = any || system.simConstants.maxOverlap <= system.simConstants.overlap_limit;
+        if (!any)
+            return;
+        for (size_t s = 0; s < data->systems.size(); ++s)
+        {
+            const auto &system = data->systems[s];
+            if (system.simConstants.maxOverlap > system.simConstants.overlap_limit)
+                continue;
+            std::stringstream stepParticles;
+            stepParticles << "data/SYSTEM_" << std::setfill('0') << std::setw(4) << s;
+            if (series)
+            {
+                AppendSeries(s, system.offset, system.count, stepParticles.str() + "/PARTICLES" + TimeSeries::EXTENSION);
+                continue;
+            }
+            stepParticles << "/PARTICLES_" << std::setw(10) << this->data->cstep << ".vtp";
+            WriteParticles(system.offset, system.count, system.simConstants.maxOverlap, stepParticles.str());
+        }
+        return;
+    }
+
 if(data->simConstants.maxOverlap>data->simConstants.overlap_limit)return;
     //if (data->WRITE_RESULTS  )
-        {
 
-    const int N = data->PARTICLE_COUNT;
-    const int MIN_COORD_NUM = 0; // Filter threshold for stable particles
+    if (series)
+    {
+        AppendSeries(0, 0, data->OWNED_COUNT, std::string("data/PARTICLES") + TimeSeries::EXTENSION);
+        return;
+    }
 
-    // --- 1. Copy Data from Device to Host Mirrors (Consolidated) ---
-    // Using auto& for mirrors for clarity.
-    auto POSITION = Kokkos::create_mirror_view(data->POSITION);
-    auto RADIUS = Kokkos::create_mirror_view(data->RADIUS);
-    auto NN_COUNT = Kokkos::create_mirror_view(data->NN_COUNT);
-    auto NN_IDS = Kokkos::create_mirror_view(data->NN_IDS);
-    auto FIX = Kokkos::create_mirror_view(data->FIX);
-    auto MAX_OVERLAP = Kokkos::create_mirror_view(data->MAX_OVERLAP);
-
-    Kokkos::deep_copy(POSITION, data->POSITION);
-    Kokkos::deep_copy(RADIUS, data->RADIUS);
-    // NN_COUNT mirror must be populated from device as well — missing copy caused empty sets on GPU
-    Kokkos::deep_copy(NN_COUNT, data->NN_COUNT);
-    Kokkos::deep_copy(NN_IDS, data->NN_IDS);
-    Kokkos::deep_copy(FIX, data->FIX);
-    Kokkos::deep_copy(MAX_OVERLAP, data->MAX_OVERLAP);
-    
-    // --- 2. Calculate Coordination Number (Z) ---
-    std::vector<int> cnumber(N, 0);
-    for (int i = 0; i < N; ++i)
+    // With MPI or output.pieces > 1 every rank writes its owned particles as
+    // `pieces` pieces and rank 0 writes the .pvtp index over all of them.
+    std::stringstream stepParticles;
+    stepParticles << "data/PARTICLES_" 
+                  << std::setfill('0') << std::setw(10) << this->data->cstep;
+    const int totalPieces = pieces * Parallel::Size();
+    if (totalPieces == 1)
     {
-        int kiekis = NN_COUNT(i); // Use operator() for Kokkos view mirrors
-        Vec3 P1 = POSITION(i);
-        double R1 = RADIUS(i);
+        WriteParticles(0, data->OWNED_COUNT, data->simConstants.maxOverlap, stepParticles.str() + ".vtp");
+        return;
+    }
+    if (Parallel::IsRoot())
+        WriteIndex(stepParticles.str(), totalPieces);
+    WritePieces(0, data->OWNED_COUNT, data->simConstants.maxOverlap, stepParticles.str(), Parallel::Rank() * pieces);
+}
 
-        for (int z = 0; z < kiekis; ++z)
+// Coordination numbers, the MIN_COORD_NUM filter, index remapping and the
+// bond list are built on the device for particles [first, first + N);
+// only the compact output arrays are copied to the host. Neighbours lie in
+// the same range (one system) except for MPI ghosts [N, END). A bond to a
+// ghost is written by the lower of the two ranks, so by this rank for the
+// ghosts of the right rank [RIGHT, END); those ghosts follow the kept
+// particles in the output as bond end points. The return value counts the
+// kept particles only.
+index_t Writer::ExtractParticles(index_t first, index_t N, double maxOverlap)
+{
+    const int MIN_COORD_NUM = 0; // Filter threshold for stable particles
+    const PeriodicBox BOX = data->PERIODIC;
+    const bool PERIODIC = BOX.any();
+    const bool UNWRAP = data->UNWRAP_OUTPUT;
+    auto &POSITION = data->POSITION;
+    const RadiusField RADIUS = data->Radii();
+    auto &FIX = data->FIX;
+    auto &MAX_OVERLAP = data->MAX_OVERLAP;
+    auto &IMAGE = data->IMAGE;
+    auto &NN_COUNT = data->NN_COUNT;
+    const NeighbourList NEIGHBOURS = data->Neighbours();
+    // Ghosts only exist with MPI, where first = 0 and N = OWNED_COUNT.
+    const index_t END = first + N == data->OWNED_COUNT ? data->PARTICLE_COUNT - first : N;
+    const index_t RIGHT = std::min(END, N + data->LEFT_GHOST_COUNT);
+
+    Kokkos::realloc(this->COORDINATION, N);
+    Kokkos::realloc(this->NEW_INDEX, END);
+    Kokkos::realloc(this->BOND_OFFSET, N + 1);
+    auto &COORDINATION = this->COORDINATION;
+    auto &NEW_INDEX = this->NEW_INDEX;
+    auto &BOND_OFFSET = this->BOND_OFFSET;
+
+    // A bond is counted once, by its lower-index particle, for both ends.
+    Kokkos::deep_copy(COORDINATION, 0);
+    Kokkos::parallel_for("WRITER_COORDINATION", N, KOKKOS_LAMBDA(const index_t i) {
+        const Vec3 P1 = POSITION(first + i);
+        const double R1 = RADIUS(first + i);
+        int own = 0;
+        for (int z = 0; z < NN_COUNT(first + i); ++z)
         {
-            int pid = NN_IDS(i * data->simConstants.NN_MAX + z);
-            
-            // Only calculate for i < pid to count each bond once
+            const index_t pid = NEIGHBOURS(first + i, z) - first;
             if (i >= pid)
                 continue;
+            const double distance = BOX.MinimumImage(P1 - POSITION(first + pid)).length();
+            if (R1 + RADIUS(first + pid) - distance > -maxOverlap)
+            {
+                own++;
+                if (pid < N)
+                    Kokkos::atomic_add(&COORDINATION(pid), 1);
+            }
+        }
+        Kokkos::atomic_add(&COORDINATION(i), own); });
 
-            Vec3 P2 = POSITION(pid);
-            double R2 = RADIUS(pid);
-            double distance = (P1 - P2).length();
-            double overlapas = R1 + R2 - distance;
-            
-            // Bond condition check
-            if (overlapas > -data->simConstants.maxOverlap)
+    // New index of every kept particle; -1 for the filtered ones.
+    index_t kept = 0;
+    Kokkos::parallel_scan("WRITER_REMAP", N, KOKKOS_LAMBDA(const index_t i, index_t &offset, const bool final) {
+        const bool keep = COORDINATION(i) >= MIN_COORD_NUM;
+        if (final)
+            NEW_INDEX(i) = keep ? offset : -1;
+        if (keep)
+            offset++; }, kept);
+
+    // Bonds between kept particles and to the right rank's ghosts, compacted
+    // through a scan of per-particle counts. NEW_INDEX marks the ghosts used.
+    if (END > N)
+        Kokkos::deep_copy(Kokkos::subview(NEW_INDEX, std::make_pair(N, END)), 0);
+    Kokkos::parallel_for("WRITER_BOND_COUNT", N, KOKKOS_LAMBDA(const index_t i) {
+        index_t count = 0;
+        if (NEW_INDEX(i) >= 0)
+        {
+            const Vec3 P1 = POSITION(first + i);
+            const double R1 = RADIUS(first + i);
+            for (int z = 0; z < NN_COUNT(first + i); ++z)
             {
-                cnumber[i]++;
-                cnumber[pid]++;
+                const index_t pid = NEIGHBOURS(first + i, z) - first;
+                if (i < pid && (pid < N ? NEW_INDEX(pid) >= 0 : pid >= RIGHT && pid < END) &&
+                    R1 + RADIUS(first + pid) - BOX.MinimumImage(P1 - POSITION(first + pid)).length() > -maxOverlap)
+                {
+                    count++;
+                    if (pid >= N)
+                        NEW_INDEX(pid) = 1;
+                }
             }
         }
-    }
+        BOND_OFFSET(i) = count; });
+    index_t bonds = 0;
+    Kokkos::parallel_scan("WRITER_BOND_OFFSET", N + 1, KOKKOS_LAMBDA(const index_t i, index_t &offset, const bool final) {
+        const index_t count = i < N ? BOND_OFFSET(i) : 0;
+        if (final)
+            BOND_OFFSET(i) = offset;
+        offset += count; }, bonds);
+    index_t ghosts = 0;
+    Kokkos::parallel_scan("WRITER_GHOST_REMAP", END - N, KOKKOS_LAMBDA(const index_t g, index_t &offset, const bool final) {
+        const bool used = NEW_INDEX(N + g) > 0;
+        if (final)
+            NEW_INDEX(N + g) = used ? kept + offset : -1;
+        if (used)
+            offset++; }, ghosts);
 
-    // --- 3. Filter Particles and Create Index Map ---
-    std::vector<int> old_to_new_index(N, -1);
-    std::vector<int> particles_to_keep;
-    int N_filtered = 0;
+    Kokkos::realloc(this->BONDS, 2 * bonds);
+    Kokkos::realloc(this->OUT_POSITION, kept + ghosts);
+    Kokkos::realloc(this->OUT_RADIUS, kept + ghosts);
+    Kokkos::realloc(this->OUT_FIX, kept + ghosts);
+    Kokkos::realloc(this->OUT_MAX_OVERLAP, kept + ghosts);
+    Kokkos::realloc(this->OUT_COORDINATION, kept + ghosts);
+    Kokkos::realloc(this->OUT_IMAGE, PERIODIC ? kept + ghosts : 0);
+    auto &BONDS = this->BONDS;
+    auto &OUT_POSITION = this->OUT_POSITION;
+    auto &OUT_RADIUS = this->OUT_RADIUS;
+    auto &OUT_FIX = this->OUT_FIX;
+    auto &OUT_MAX_OVERLAP = this->OUT_MAX_OVERLAP;
+    auto &OUT_COORDINATION = this->OUT_COORDINATION;
+    auto &OUT_IMAGE = this->OUT_IMAGE;
+    Memory::Record("Writer", "COORDINATION", COORDINATION);
+    Memory::Record("Writer", "NEW_INDEX", NEW_INDEX);
+    Memory::Record("Writer", "BOND_OFFSET", BOND_OFFSET);
+    Memory::Record("Writer", "BONDS", BONDS);
+    Memory::Record("Writer", "OUT_POSITION", OUT_POSITION);
+    Memory::Record("Writer", "OUT_RADIUS", OUT_RADIUS);
+    Memory::Record("Writer", "OUT_FIX", OUT_FIX);
+    Memory::Record("Writer", "OUT_MAX_OVERLAP", OUT_MAX_OVERLAP);
+    Memory::Record("Writer", "OUT_COORDINATION", OUT_COORDINATION);
+    Memory::Record("Writer", "OUT_IMAGE", OUT_IMAGE);
 
-    for (int i = 0; i < N; ++i)
-    {
-        if (cnumber[i] >= MIN_COORD_NUM)
+    // Ghost end points carry no coordination number; their owner writes it.
+    Kokkos::parallel_for("WRITER_COMPACT", END, KOKKOS_LAMBDA(const index_t i) {
+        const index_t j = NEW_INDEX(i);
+        if (j < 0)
+            return;
+        const Vec3 P1 = POSITION(first + i);
+        const double R1 = RADIUS(first + i);
+        Vec3 pos = P1;
+        if (PERIODIC)
         {
-            particles_to_keep.push_back(i);
-            old_to_new_index[i] = N_filtered;
-            N_filtered++;
+            const int image[3] = {IMAGE(first + i, 0), IMAGE(first + i, 1), IMAGE(first + i, 2)};
+            if (UNWRAP)
+                pos = BOX.Unwrap(pos, image);
+            for (int axis = 0; axis < 3; ++axis)
+                OUT_IMAGE(j, axis) = image[axis];
         }
-    }
+        OUT_POSITION(j) = pos;
+        OUT_RADIUS(j) = R1;
+        OUT_FIX(j) = FIX(first + i);
+        OUT_MAX_OVERLAP(j) = MAX_OVERLAP(first + i);
+        OUT_COORDINATION(j) = i < N ? COORDINATION(i) : 0;
+        if (i >= N)
+            return;
 
-    // --- 4. Initialize and Populate VTK Objects with Filtered Data ---
-    auto polyData = vtkSmartPointer<vtkPolyData>::New();
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    auto points = vtkSmartPointer<vtkPoints>::New();
-    points->SetDataTypeToDouble();
-    points->SetNumberOfPoints(N_filtered); // Set size immediately
+        index_t b = BOND_OFFSET(i);
+        for (int z = 0; z < NN_COUNT(first + i); ++z)
+        {
+            const index_t pid = NEIGHBOURS(first + i, z) - first;
+            if (i < pid && pid < END && NEW_INDEX(pid) >= 0 && (pid < N || pid >= RIGHT) &&
+                R1 + RADIUS(first + pid) - BOX.MinimumImage(P1 - POSITION(first + pid)).length() > -maxOverlap)
+            {
+                BONDS(2 * b) = j;
+                BONDS(2 * b + 1) = NEW_INDEX(pid);
+                b++;
+            }
+        }
+    });
 
-    // Lambda to create and configure a VTK array (DRY Principle)
-    auto create_array = [&](const char* name, int components) {
-        auto arr = vtkSmartPointer<vtkDoubleArray>::New();
-        arr->SetName(name);
-        arr->SetNumberOfComponents(components);
-        arr->SetNumberOfTuples(N_filtered);
-        return arr;
-    };
-    // Lambda for Int Array
-    auto create_int_array = [&](const char* name, int components) {
-        auto arr = vtkSmartPointer<vtkIntArray>::New();
-        arr->SetName(name);
-        arr->SetNumberOfComponents(components);
-        arr->SetNumberOfTuples(N_filtered);
-        return arr;
-    };
+    CopyOut(OUT_POSITION_host, OUT_POSITION);
+    CopyOut(OUT_RADIUS_host, OUT_RADIUS);
+    CopyOut(OUT_FIX_host, OUT_FIX);
+    CopyOut(OUT_MAX_OVERLAP_host, OUT_MAX_OVERLAP);
+    CopyOut(OUT_COORDINATION_host, OUT_COORDINATION);
+    CopyOut(OUT_IMAGE_host, OUT_IMAGE);
+    CopyOut(BONDS_host, BONDS);
+    return kept;
+}
 
-    auto radiusArray = create_array("RADIUS", 1);
-    auto MAX_OVERLAPArray = create_array("MAX_OVERLAP", 1);
-    auto fixArray = create_int_array("FIX", 1);
-    auto coordNRArray = create_int_array("COORDINATION_NUMBER", 1);
-    
+// The .dpts series stores every particle of the range and neither bonds nor
+// coordination numbers: only POSITION, RADIUS, MAX_OVERLAP and FIX are
+// copied out, without the neighbour passes of ExtractParticles.
+void Writer::ExtractSeriesFrame(index_t first, index_t N)
+{
+    const PeriodicBox BOX = data->PERIODIC;
+    const bool UNWRAP = BOX.any() && data->UNWRAP_OUTPUT;
+    auto &POSITION = data->POSITION;
+    const RadiusField RADIUS = data->Radii();
+    auto &FIX = data->FIX;
+    auto &MAX_OVERLAP = data->MAX_OVERLAP;
+    auto &IMAGE = data->IMAGE;
 
-    // Populate filtered arrays
-    for (int j = 0; j < N_filtered; ++j)
-    {
-        int i = particles_to_keep[j]; // Original index
+    Kokkos::realloc(this->OUT_POSITION, N);
+    Kokkos::realloc(this->OUT_RADIUS, N);
+    Kokkos::realloc(this->OUT_FIX, N);
+    Kokkos::realloc(this->OUT_MAX_OVERLAP, N);
+    auto &OUT_POSITION = this->OUT_POSITION;
+    auto &OUT_RADIUS = this->OUT_RADIUS;
+    auto &OUT_FIX = this->OUT_FIX;
+    auto &OUT_MAX_OVERLAP = this->OUT_MAX_OVERLAP;
+    Memory::Record("Writer", "OUT_POSITION", OUT_POSITION);
+    Memory::Record("Writer", "OUT_RADIUS", OUT_RADIUS);
+    Memory::Record("Writer", "OUT_FIX", OUT_FIX);
+    Memory::Record("Writer", "OUT_MAX_OVERLAP", OUT_MAX_OVERLAP);
+
+    Kokkos::parallel_for("WRITER_SERIES_COMPACT", N, KOKKOS_LAMBDA(const index_t i) {
+        Vec3 pos = POSITION(first + i);
+        if (UNWRAP)
+        {
+            const int image[3] = {IMAGE(first + i, 0), IMAGE(first + i, 1), IMAGE(first + i, 2)};
+            pos = BOX.Unwrap(pos, image);
+        }
+        OUT_POSITION(i) = pos;
+        OUT_RADIUS(i) = RADIUS(first + i);
+        OUT_FIX(i) = FIX(first + i);
+        OUT_MAX_OVERLAP(i) = MAX_OVERLAP(first + i); });
 
-        // Use SetPoint and SetTupleX methods for efficiency when size is known
-        Vec3 pos = POSITION(i);
-        points->SetPoint(j, pos.x, pos.y, pos.z);
-        radiusArray->SetValue(j, RADIUS(i));
-        fixArray->SetValue(j, FIX(i));
-        MAX_OVERLAPArray->SetValue(j, MAX_OVERLAP(i));
-        coordNRArray->SetValue(j, cnumber[i]); // Use SetValue/SetTuple1
-        
+    CopyOut(OUT_POSITION_host, OUT_POSITION);
+    CopyOut(OUT_RADIUS_host, OUT_RADIUS);
+    CopyOut(OUT_FIX_host, OUT_FIX);
+    CopyOut(OUT_MAX_OVERLAP_host, OUT_MAX_OVERLAP);
+}
+
+void Writer::WriteParticles(index_t first, index_t N, double maxOverlap, const std::string &filename)
+{
+    const index_t N_filtered = ExtractParticles(first, N, maxOverlap);
+    const index_t bonds = BONDS_host.extent(0) / 2;
+    auto polyData = BuildPolyData(nullptr, N_filtered, N_filtered, BONDS_host.data(), bonds, false);
+    WritePolyData(polyData, filename);
+}
+
+// Partitioned output: the kept particles are cut into `pieces` slabs of
+// equal width along the longest axis of their bounding box, and every piece
+// is built and written by its own host thread as <base>_P<index>.vtp. A bond
+// belongs to the piece of its first end point; an end point from another
+// piece, or from the right MPI rank, is repeated there as a duplicate-point
+// ghost.
+void Writer::WritePieces(index_t first, index_t N, double maxOverlap, const std::string &base, int pieceOffset)
+{
+    using HostRange = Kokkos::RangePolicy<Kokkos::DefaultHostExecutionSpace>;
+    const index_t kept = ExtractParticles(first, N, maxOverlap);
+    const index_t bonds = BONDS_host.extent(0) / 2;
+
+    Vec3 lo(0, 0, 0), hi(0, 0, 0);
+    for (index_t j = 0; j < kept; ++j)
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const double x = OUT_POSITION_host(j)[axis];
+            lo[axis] = j == 0 ? x : std::min(lo[axis], x);
+            hi[axis] = j == 0 ? x : std::max(hi[axis], x);
+        }
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+        if (hi[a] - lo[a] > hi[axis] - lo[axis])
+            axis = a;
+    const double width = hi[axis] - lo[axis];
+
+    // MPI ghost end points [kept, ...) belong to no piece.
+    std::vector<int> piece(OUT_POSITION_host.extent(0), -1);
+    Kokkos::parallel_for("WRITER_PIECE", HostRange(0, kept), [&](const index_t j) {
+        const int p = width > 0 ? int((OUT_POSITION_host(j)[axis] - lo[axis]) / width * pieces) : 0;
+        piece[j] = std::min(std::max(p, 0), pieces - 1); });
+
+    // Counting sort of the particles by piece, and of the bonds by the piece
+    // of their first end point.
+    std::vector<index_t> pointOffset(pieces + 1, 0), bondOffset(pieces + 1, 0);
+    for (index_t j = 0; j < kept; ++j)
+        pointOffset[piece[j] + 1]++;
+    for (index_t b = 0; b < bonds; ++b)
+        bondOffset[piece[BONDS_host(2 * b)] + 1]++;
+    for (int p = 0; p < pieces; ++p)
+    {
+        pointOffset[p + 1] += pointOffset[p];
+        bondOffset[p + 1] += bondOffset[p];
+    }
+    std::vector<index_t> ids(kept), local(kept), pieceBonds(bonds);
+    {
+        std::vector<index_t> next(pointOffset.begin(), pointOffset.end() - 1);
+        for (index_t j = 0; j < kept; ++j)
+        {
+            local[j] = next[piece[j]] - pointOffset[piece[j]];
+            ids[next[piece[j]]++] = j;
+        }
+        std::vector<index_t> nextBond(bondOffset.begin(), bondOffset.end() - 1);
+        for (index_t b = 0; b < bonds; ++b)
+            pieceBonds[nextBond[piece[BONDS_host(2 * b)]]++] = b;
     }
 
-    // --- 5. Recalculate and Insert Bonds (Lines/Cells) with New Indices ---
-    for (int i = 0; i < N; ++i)
+    Kokkos::parallel_for("WRITER_PIECES", HostRange(0, pieces), [&](const int p) {
+        std::vector<index_t> pointIds(ids.begin() + pointOffset[p], ids.begin() + pointOffset[p + 1]);
+        const index_t owned = pointIds.size();
+        std::unordered_map<index_t, index_t> ghosts;
+        auto localIndex = [&](index_t j) {
+            if (piece[j] == p)
+                return local[j];
+            auto inserted = ghosts.emplace(j, index_t(pointIds.size()));
+            if (inserted.second)
+                pointIds.push_back(j);
+            return inserted.first->second;
+        };
+        std::vector<index_t> lines;
+        lines.reserve(2 * (bondOffset[p + 1] - bondOffset[p]));
+        for (index_t k = bondOffset[p]; k < bondOffset[p + 1]; ++k)
+        {
+            const index_t b = pieceBonds[k];
+            lines.push_back(localIndex(BONDS_host(2 * b)));
+            lines.push_back(localIndex(BONDS_host(2 * b + 1)));
+        }
+        auto polyData = BuildPolyData(pointIds.data(), pointIds.size(), owned, lines.data(), lines.size() / 2, true);
+        WritePolyData(polyData, PieceName(base, pieceOffset + p)); });
+}
+
+// The series is created on the first written frame, which provides the
+// static FIX array and the fixed particles; the particle count must not change.
+void Writer::AppendSeries(size_t system, index_t first, index_t N, const std::string &filename)
+{
+    ExtractSeriesFrame(first, N);
+    auto &file = seriesFiles[system];
+    if (!file)
     {
-        if (old_to_new_index[i] != -1) // If particle i was kept
+        file = std::make_unique<TimeSeries::SeriesWriter>();
+        if (!file->Open(filename, N, OUT_FIX_host.data(), OUT_POSITION_host.data(), OUT_RADIUS_host.data(),
+                        series_delta, keyframe_interval))
         {
-            int new_i = old_to_new_index[i];
-            
-            // Loop through neighbors (NN_IDS is the original neighbor list)
-            for (int z = 0; z < NN_COUNT(i); ++z)
-            {
-                int pid = NN_IDS(i * data->simConstants.NN_MAX + z);
-                
-                // Check if neighbor (pid) was kept AND avoid double counting (i < pid)
-                if (old_to_new_index[pid] != -1 && i < pid)
-                {
-                    int new_pid = old_to_new_index[pid];
-                    
-                    // Recalculate overlap for safety (or reuse the logic from step 2 if possible)
-                    double distance = (POSITION(i) - POSITION(pid)).length();
-                    double overlapas = RADIUS(i) + RADIUS(pid) - distance;
-
-                    if (overlapas > -data->simConstants.maxOverlap)
-                    {
-                        cells->InsertNextCell(2);
-                        cells->InsertCellPoint(new_i); // Filtered index
-                        cells->InsertCellPoint(new_pid); // Filtered index
-                    }
-                }
-            }
+            std::cerr << "Writer: cannot create " << filename << "\n";
+            data->COMPUTE = false;
+            return;
         }
     }
+    if (N != file->Count())
+    {
+        std::cerr << "Writer: " << filename << " holds " << file->Count() << " particles, frame has " << N << "\n";
+        data->COMPUTE = false;
+        return;
+    }
+    if (!file->Append(data->cstep, OUT_POSITION_host.data(), OUT_RADIUS_host.data(), OUT_MAX_OVERLAP_host.data()))
+    {
+        std::cerr << "Writer: failed to append to " << filename << "\n";
+        data->COMPUTE = false;
+    }
+}
+
+std::string Writer::PieceName(const std::string &base, int index)
+{
+    std::stringstream name;
+    name << base << "_P" << std::setfill('0') << std::setw(4) << index << ".vtp";
+    return name.str();
+}
+
+// Points [0, count) are OUT_*_host(ids[j]), or OUT_*_host(j) without ids;
+// with `ghostArray` the points from `owned` on are flagged as duplicates.
+vtkSmartPointer<vtkPolyData> Writer::BuildPolyData(const index_t *ids, index_t count, index_t owned, const index_t *bonds, index_t bonds_count, bool ghostArray) const
+{
+    const bool periodic = data->PERIODIC.any();
+    auto index = [ids](index_t j) { return ids ? ids[j] : j; };
+    // Positions and radii are stored as Float32 when output.float32 is set.
+    auto create_real_array = [&](const char *name, int components, auto get) {
+        return float32 ? MakeArray<vtkFloatArray>(name, components, count, get)
+                       : MakeArray<vtkDoubleArray>(name, components, count, get);
+    };
+
+    auto polyData = vtkSmartPointer<vtkPolyData>::New();
+    auto points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(create_real_array("Points", 3, [&](index_t j, int c) { return OUT_POSITION_host(index(j))[c]; }));
+    auto radiusArray = create_real_array("RADIUS", 1, [&](index_t j, int) { return OUT_RADIUS_host(index(j)); });
+    auto MAX_OVERLAPArray = MakeArray<vtkDoubleArray>("MAX_OVERLAP", 1, count, [&](index_t j, int) { return OUT_MAX_OVERLAP_host(index(j)); });
+    auto fixArray = MakeArray<vtkIntArray>("FIX", 1, count, [&](index_t j, int) { return OUT_FIX_host(index(j)); });
+    auto coordNRArray = MakeArray<vtkIntArray>("COORDINATION_NUMBER", 1, count, [&](index_t j, int) { return OUT_COORDINATION_host(index(j)); });
+
+    // --- Bonds (Lines/Cells), already in output indices ---
+    auto cells = vtkSmartPointer<vtkCellArray>::New();
+    cells->AllocateExact(bonds_count, 2 * bonds_count);
+    for (index_t b = 0; b < bonds_count; ++b)
+    {
+        cells->InsertNextCell(2);
+        cells->InsertCellPoint(bonds[2 * b]);
+        cells->InsertCellPoint(bonds[2 * b + 1]);
+    }
 
-    // --- 6. Final VTK Setup and Write ---
     polyData->SetLines(cells);
     polyData->SetPoints(points);
 
@@ -191,19 +548,70 @@ if(data->simConstants.maxOverlap>data->simConstants.overlap_limit)return;
     polyData->GetPointData()->AddArray(fixArray);
     polyData->GetPointData()->AddArray(MAX_OVERLAPArray);
     polyData->GetPointData()->AddArray(coordNRArray);
-    
+    // Periodic runs flag the image each particle was wrapped from.
+    if (periodic)
+        polyData->GetPointData()->AddArray(MakeArray<vtkIntArray>("IMAGE", 3, count, [&](index_t j, int c) { return OUT_IMAGE_host(index(j), c); }));
+    if (ghostArray)
+    {
+        auto ghosts = vtkSmartPointer<vtkUnsignedCharArray>::New();
+        ghosts->SetName(vtkDataSetAttributes::GhostArrayName());
+        ghosts->SetNumberOfTuples(count);
+        for (index_t j = 0; j < count; ++j)
+            ghosts->SetValue(j, j < owned ? 0 : vtkDataSetAttributes::DUPLICATEPOINT);
+        polyData->GetPointData()->AddArray(ghosts);
+    }
+    return polyData;
+}
 
-    // Write to file
-    std::stringstream stepParticles;
-    stepParticles << "data/PARTICLES_" 
-                  << std::setfill('0') << std::setw(10) << this->data->cstep << ".vtp";
-    
+void Writer::WritePolyData(vtkPolyData *polyData, const std::string &filename) const
+{
     auto writerParticles = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
-    writerParticles->SetFileName(stepParticles.str().c_str());
+    writerParticles->SetFileName(filename.c_str());
     writerParticles->SetInputData(polyData);
-    // Use try/catch or status check for robust file writing in production code
-    writerParticles->Write(); 
+    // Raw appended data skips the base64 encoding of the default mode.
+    if (binary)
+    {
+        writerParticles->SetDataModeToAppended();
+        writerParticles->EncodeAppendedDataOff();
     }
+    if (compression == "none")
+        writerParticles->SetCompressorTypeToNone();
+    else if (compression == "lz4")
+        writerParticles->SetCompressorTypeToLZ4();
+    else if (compression == "zlib")
+        writerParticles->SetCompressorTypeToZLib();
+    else if (compression == "lzma")
+        writerParticles->SetCompressorTypeToLZMA();
+    if (compression_level >= 0)
+        writerParticles->SetCompressionLevel(compression_level);
+    writerParticles->SetHeaderTypeToUInt64();
+    if (writerParticles->Write() == 0)
+        std::cerr << "Writer: failed to write " << filename << "\n";
+}
 
-
-}
\ No newline at end of file
+// ParaView reads the pieces of one frame through this index; the array
+// list must match what BuildPolyData writes for the pieces.
+void Writer::WriteIndex(const std::string &base, int totalPieces) const
+{
+    const std::string real = float32 ? "Float32" : "Float64";
+    std::ofstream out(base + ".pvtp");
+    out << "<?xml version=\"1.0\"?>\n"
+        << "<VTKFile type=\"PPolyData\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n"
+        << "  <PPolyData GhostLevel=\"0\">\n"
+        << "    <PPointData Scalars=\"RADIUS\">\n"
+        << "      <PDataArray type=\"" << real << "\" Name=\"RADIUS\"/>\n"
+        << "      <PDataArray type=\"Int32\" Name=\"FIX\"/>\n"
+        << "      <PDataArray type=\"Float64\" Name=\"MAX_OVERLAP\"/>\n"
+        << "      <PDataArray type=\"Int32\" Name=\"COORDINATION_NUMBER\"/>\n";
+    if (data->PERIODIC.any())
+        out << "      <PDataArray type=\"Int32\" Name=\"IMAGE\" NumberOfComponents=\"3\"/>\n";
+    out << "      <PDataArray type=\"UInt8\" Name=\"" << vtkDataSetAttributes::GhostArrayName() << "\"/>\n"
+        << "    </PPointData>\n"
+        << "    <PPoints>\n"
+        << "      <PDataArray type=\"" << real << "\" Name=\"Points\" NumberOfComponents=\"3\"/>\n"
+        << "    </PPoints>\n";
+    for (int p = 0; p < totalPieces; ++p)
+        out << "    <Piece Source=\"" << std::filesystem::path(PieceName(base, p)).filename().string() << "\"/>\n";
+    out << "  </PPolyData>\n"
+        << "</VTKFile>\n";
+}
@@ -1,5 +1,12 @@
 #pragma once
 #include "AModule.h"
+#include "TimeSeries.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <vtkSmartPointer.h>
+
+class vtkPolyData;
 
 class Writer : public AModule
 {
@@ -10,4 +17,45 @@ public:
 
 protected:
   virtual void Processing();
-};
\ No newline at end of file
+  index_t ExtractParticles(index_t first, index_t N, double maxOverlap);
+  void ExtractSeriesFrame(index_t first, index_t N);
+  void WriteParticles(index_t first, index_t N, double maxOverlap, const std::string &filename);
+  void WritePieces(index_t first, index_t N, double maxOverlap, const std::string &base, int pieceOffset);
+  vtkSmartPointer<vtkPolyData> BuildPolyData(const index_t *ids, index_t count, index_t owned, const index_t *bonds, index_t bonds_count, bool ghostArray) const;
+  void WritePolyData(vtkPolyData *polyData, const std::string &filename) const;
+  void WriteIndex(const std::string &base, int totalPieces) const;
+  static std::string PieceName(const std::string &base, int index);
+  void AppendSeries(size_t system, index_t first, index_t N, const std::string &filename);
+
+  // config.yaml "output" section.
+  bool binary = false;          // appended raw binary instead of base64
+  std::string compression;      // none, lz4, zlib, lzma; empty keeps the VTK default
+  int compression_level = -1;
+  bool float32 = false;         // Float32 positions and radii
+  int pieces = 1;               // pieces per rank written in parallel
+  bool series = false;          // one PARTICLES.dpts per system instead of a file per frame
+  bool series_delta = false;
+  int keyframe_interval = 10;
+  std::vector<std::unique_ptr<TimeSeries::SeriesWriter>> seriesFiles;
+
+  // Device work arrays, indexed relative to `first`.
+  Kokkos::View<int *> COORDINATION;
+  Kokkos::View<index_t *> NEW_INDEX;
+  Kokkos::View<index_t *> BOND_OFFSET;
+
+  // Compact output (kept particles and bond end points) and its host copies.
+  Kokkos::View<Vec3 *> OUT_POSITION;
+  Kokkos::View<double *> OUT_RADIUS;
+  Kokkos::View<int *> OUT_FIX;
+  Kokkos::View<double *> OUT_MAX_OVERLAP;
+  Kokkos::View<int *> OUT_COORDINATION;
+  Kokkos::View<int *[3]> OUT_IMAGE;
+  Kokkos::View<index_t *> BONDS;
+  Kokkos::View<Vec3 *>::HostMirror OUT_POSITION_host;
+  Kokkos::View<double *>::HostMirror OUT_RADIUS_host;
+  Kokkos::View<int *>::HostMirror OUT_FIX_host;
+  Kokkos::View<double *>::HostMirror OUT_MAX_OVERLAP_host;
+  Kokkos::View<int *>::HostMirror OUT_COORDINATION_host;
+  Kokkos::View<int *[3]>::HostMirror OUT_IMAGE_host;
+  Kokkos::View<index_t *>::HostMirror BONDS_host;
+};
\ No newline at end of file
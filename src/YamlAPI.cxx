@@ -2,6 +2,15 @@
 #include <iostream>
 #include <vector>
 #include <stdexcept>
+#include <fstream>
+
+YAML::Node YamlAPI::LoadConfig(const std::string &filename)
+{
+    std::ifstream probe(filename);
+    if (!probe.good())
+        return YAML::Node();
+    return YAML::LoadFile(filename);
+}
 
 double YamlAPI::ReadDouble(std::string group, std::string key)
 {
@@ -9,5 +9,8 @@ public:
     int ReadInt(std::string group, std::string key);
     bool ReadBool(std::string group, std::string key);
     std::vector<double> ReadDoubleArray(std::string group, std::string key);
-    YAML::Node config = YAML::LoadFile("config.yaml");
+    // Returns an empty node when the file is missing so that tools which do
+    // not need a config (e.g. the benchmark) can still construct Data.
+    static YAML::Node LoadConfig(const std::string &filename);
+    YAML::Node config;
 };
\ No newline at end of file
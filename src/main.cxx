@@ -1,55 +1,59 @@
 #include <Kokkos_Core.hpp>
-#include "Data.h"
+#include "Simulation.h"
 #include <iomanip> // for std::setw, std::left, etc.
-#include "ContactSearch.h"
-#include "Forces.h"
-#include "Reader.h"
-#include "Time.h"
-#include "Writer.h"
 #include <sstream>
 #include <fstream>
 #include <iostream>
-#include "Integrator.h"
-#include "RadiusScaler.h"
+#include "TimersLog.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "Placement.h"
+#include "Counters.h"
 
 int main(int argc, char *argv[])
 {
+  Parallel::Initialize(&argc, &argv);
   Kokkos::initialize();
+  int status = 0;
   {
+    const bool root = Parallel::IsRoot();
 
     // Print backend information
-    std::cout << "\n[Kokkos] Running on: ";
+    if (root)
+    {
+      std::cout << "\n[Kokkos] Running on: ";
 #ifdef KOKKOS_ENABLE_CUDA
-    std::cout << "NVIDIA GPU (CUDA)\n";
+      std::cout << "NVIDIA GPU (CUDA)\n";
 #elif defined(KOKKOS_ENABLE_HIP)
-    std::cout << "AMD GPU (HIP)\n";
+      std::cout << "AMD GPU (HIP)\n";
 #elif defined(KOKKOS_ENABLE_OPENMP)
-    std::cout << "CPU (OpenMP)\n";
+      std::cout << "CPU (OpenMP)\n";
 #elif defined(KOKKOS_ENABLE_SERIAL)
-    std::cout << "CPU (Serial)\n";
+      std::cout << "CPU (Serial)\n";
 #else
-    std::cout << "Unknown backend\n";
+      std::cout << "Unknown backend\n";
 #endif
+      if (Parallel::Size() > 1)
+        std::cout << "[MPI] " << Parallel::Size() << " ranks\n";
+    }
 
-    Data data;
-    data.initialize();
-    Reader reader(&data);
-    reader.Initialization();
-
-    std::vector<AModule *> modules;
-    modules.push_back(new RadiusScaler(&data));
-    modules.push_back(new ContactSearch(&data));
-    modules.push_back(new Forces(&data));
-    modules.push_back(new Integrator(&data));
-    modules.push_back(new Time(&data));
-//    modules.push_back(new Logs(&data));
-
-
-    modules.push_back(new Writer(&data));
+    Simulation simulation(YamlAPI::LoadConfig("config.yaml"));
+    Data &data = simulation.data;
+    // memory.dry_run only prints the memory estimate.
+    if (Memory::DryRunRequested(data))
+    {
+      data.initialize();
+      status = Memory::DryRun(data);
+      data.COMPUTE = false;
+    }
+    else if (!simulation.Setup())
+      status = 1;
+    std::vector<AModule *> &modules = simulation.modules;
 
-    for (int i = 0; i < modules.size(); ++i)
+    if (root && data.COMPUTE)
     {
-      modules[i]->Initialization();
+      Memory::Report(std::cout);
+      Placement::Report(std::cout, data);
     }
 
     // Determine column widths once (you can adjust these as needed)
@@ -59,47 +63,37 @@ int main(int argc, char *argv[])
     const int totalWidth = 16;
 
     // Print header to console with nice columns
-    std::cout << std::left << std::setw(timeWidth) << "OVERLAP"
-          << std::setw(timeWidth) << "R_SCALE_DELTA"
-          << std::setw(timeWidth) << "RELAX_COEFF"
-          << std::setw(stepWidth) << "STEP";
-    for (int i = 0; i < modules.size(); ++i)
+    if (root && data.COMPUTE)
     {
-      std::cout << std::setw(moduleWidth) << modules[i]->getModuleName();
-    }
-    std::cout << std::setw(totalWidth) << "Total" << "\n";
-
-    // Write CSV header as before
-    std::stringstream csvHeader;
-    csvHeader << "STEP;OVERLAP;RADIUS_SCALE_DELTA;RELAXATION_COEFFICIENT";
-    for (int i = 0; i < modules.size(); ++i)
-    {
-      csvHeader << ";" << modules[i]->getModuleName();
+      std::cout << std::left << std::setw(timeWidth) << "OVERLAP"
+                << std::setw(timeWidth) << "R_SCALE_DELTA"
+                << std::setw(timeWidth) << "RELAX_COEFF"
+                << std::setw(stepWidth) << "STEP";
+      for (int i = 0; i < modules.size(); ++i)
+      {
+        std::cout << std::setw(moduleWidth) << modules[i]->getModuleName();
+      }
+      std::cout << std::setw(totalWidth) << "Total" << "\n";
     }
-    csvHeader << ";Total\n";
 
-    std::ofstream file("timers.csv");
-    file << csvHeader.str();
-    file.close();
+    // Module timers are written by rank 0 only.
+    TimersLog timersLog(root ? "timers.csv" : "", modules);
 
 
     while (data.COMPUTE)
     {
-      for (int i = 0; i < modules.size(); ++i)
-      {
-        modules[i]->RunProcessing();
-      }
+      simulation.Step();
 
       if (data.PRINT_TIMES)
       {
-        // Prepare timing data
-        double total = 0.0;
-        std::vector<double> times(modules.size());
-        for (int i = 0; i < modules.size(); ++i)
-        {
-          times[i] = modules[i]->getModuleWorkTime();
-          total += times[i];
-        }
+        // Prepare timing data (also appended to timers.csv)
+        std::vector<double> times = timersLog.Record(data);
+        Counters::Record(data);
+        double total = times.back();
+        times.pop_back();
+
+        if (!root)
+          continue;
 
         // Console output: nicely formatted columns
         std::cout << std::fixed << std::setprecision(6);
@@ -120,22 +114,16 @@ int main(int argc, char *argv[])
         }
         std::cout << std::setw(totalWidth) << total << "\n";
         std::cout.flush();
-
-        // CSV output: unchanged (semicolon-separated)
-        std::stringstream csvLine;
-        csvLine << data.cstep << ";" << data.simConstants.maxOverlap << ";" << data.simConstants.radius_scale_delta_current << ";" << data.simConstants.relaxation_coefficient;
-        for (double t : times)
-        {
-          csvLine << ";" << t;
-        }
-        csvLine << ";" << total << "\n";
-
-        std::ofstream file("timers.csv", std::ios_base::app);
-        file << csvLine.str();
-        file.close();
       }
     }
+
+    const double peak = Parallel::AllreduceMax((double)Memory::Peak());
+    if (root && !modules.empty())
+      std::cout << "Peak device memory per rank: " << peak / (1024.0 * 1024.0) << " MB\n";
+    if (root)
+      Counters::Report(std::cout, data);
   }
   Kokkos::finalize();
-  return 0;
+  Parallel::Finalize();
+  return status;
 }
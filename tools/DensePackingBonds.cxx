@@ -0,0 +1,315 @@
+// Contact network (bond) generator for finished packings.
+//
+// Reads a packing the same way as the simulation input (.vtp/.vtk or
+// .dpraw), finds every pair with R_i + R_j - |x_i - x_j| >= -tolerance on
+// the ContactSearch hash grid and writes the bonds either as the lines of a
+// .vtp (points with RADIUS, FIX, COORDINATION_NUMBER and MATERIAL) or as a
+// binary edge list. Replaces scripts/GenBonds.py.
+//
+// Usage:
+//   DensePackingBonds <input> [--out bonds.vtp] [--tolerance 0]
+//                     [--format vtp|edges]
+//
+// The format defaults to vtp for a .vtp output name and to edges otherwise.
+// Edge list layout (little endian, no padding):
+//   char   magic[8] = "DPEDGE01"
+//   uint64 particles
+//   uint64 bonds
+//   int64  pairs[2 * bonds]   (i, j) with i < j, in input order
+#include <Kokkos_Core.hpp>
+#include "Data.h"
+#include "ContactSearch.h"
+#include "Reader.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// VTK Includes
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkCellArray.h>
+#include <vtkPointData.h>
+#include <vtkXMLPolyDataWriter.h>
+
+struct BondSettings
+{
+  std::string input;
+  std::string out = "bonds.vtp";
+  std::string format;
+  double tolerance = 0.0;
+};
+
+constexpr char EDGE_MAGIC[8] = {'D', 'P', 'E', 'D', 'G', 'E', '0', '1'};
+
+static bool EndsWith(const std::string &text, const std::string &suffix)
+{
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static BondSettings ParseArgs(int argc, char *argv[])
+{
+  BondSettings s;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg.rfind("--kokkos", 0) == 0)
+      continue;
+    if (arg.rfind("--", 0) != 0)
+    {
+      s.input = arg;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      std::cerr << "DensePackingBonds: missing value for " << arg << "\n";
+      exit(1);
+    }
+    std::string value = argv[++i];
+    if (arg == "--out")
+      s.out = value;
+    else if (arg == "--tolerance")
+      s.tolerance = std::stod(value);
+    else if (arg == "--format")
+      s.format = value;
+    else
+    {
+      std::cerr << "DensePackingBonds: unknown option " << arg << "\n";
+      exit(1);
+    }
+  }
+  if (s.input.empty())
+  {
+    std::cerr << "Usage: DensePackingBonds <input> [--out bonds.vtp] [--tolerance 0] [--format vtp|edges]\n";
+    exit(1);
+  }
+  if (s.format.empty())
+    s.format = EndsWith(s.out, ".vtp") ? "vtp" : "edges";
+  if (s.format != "vtp" && s.format != "edges")
+  {
+    std::cerr << "DensePackingBonds: --format must be vtp or edges\n";
+    exit(1);
+  }
+  if (s.tolerance < 0)
+  {
+    std::cerr << "DensePackingBonds: --tolerance must not be negative\n";
+    exit(1);
+  }
+  return s;
+}
+
+static bool WriteEdges(const std::string &filename, index_t N, const Kokkos::View<index_t *[2]>::HostMirror &bonds)
+{
+  std::ofstream out(filename, std::ios::binary);
+  const uint64_t header[2] = {(uint64_t)N, (uint64_t)bonds.extent(0)};
+  out.write(EDGE_MAGIC, sizeof(EDGE_MAGIC));
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  // Written in blocks so that an int64 copy of the whole list is never needed.
+  std::vector<int64_t> block;
+  const size_t BLOCK = 1 << 20;
+  for (size_t first = 0; first < bonds.extent(0); first += BLOCK)
+  {
+    const size_t count = std::min(BLOCK, bonds.extent(0) - first);
+    block.resize(2 * count);
+    for (size_t b = 0; b < count; ++b)
+    {
+      block[2 * b] = bonds(first + b, 0);
+      block[2 * b + 1] = bonds(first + b, 1);
+    }
+    out.write(reinterpret_cast<const char *>(block.data()), block.size() * sizeof(int64_t));
+  }
+  return (bool)out;
+}
+
+static bool WriteVtp(const std::string &filename, Data &data, const Kokkos::View<int *> &coordination,
+                     const Kokkos::View<index_t *[2]>::HostMirror &bonds)
+{
+  const index_t N = data.PARTICLE_COUNT;
+  auto POSITION = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), data.POSITION);
+  auto RADIUS = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), data.OLD_RADIUS);
+  auto FIX = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), data.FIX);
+  auto COORDINATION = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), coordination);
+
+  auto points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToDouble();
+  points->SetNumberOfPoints(N);
+  auto radius = vtkSmartPointer<vtkDoubleArray>::New();
+  radius->SetName("RADIUS");
+  radius->SetNumberOfTuples(N);
+  auto fix = vtkSmartPointer<vtkIntArray>::New();
+  fix->SetName("FIX");
+  fix->SetNumberOfTuples(N);
+  auto coordNR = vtkSmartPointer<vtkIntArray>::New();
+  coordNR->SetName("COORDINATION_NUMBER");
+  coordNR->SetNumberOfTuples(N);
+  auto material = vtkSmartPointer<vtkIntArray>::New();
+  material->SetName("MATERIAL");
+  material->SetNumberOfTuples(N);
+  for (index_t j = 0; j < N; ++j)
+  {
+    points->SetPoint(j, POSITION(j).x, POSITION(j).y, POSITION(j).z);
+    radius->SetValue(j, RADIUS(j));
+    fix->SetValue(j, FIX(j));
+    coordNR->SetValue(j, COORDINATION(j));
+    material->SetValue(j, 0);
+  }
+
+  auto cells = vtkSmartPointer<vtkCellArray>::New();
+  cells->AllocateExact(bonds.extent(0), 2 * bonds.extent(0));
+  for (size_t b = 0; b < bonds.extent(0); ++b)
+  {
+    cells->InsertNextCell(2);
+    cells->InsertCellPoint(bonds(b, 0));
+    cells->InsertCellPoint(bonds(b, 1));
+  }
+
+  auto polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points);
+  polyData->SetLines(cells);
+  polyData->GetPointData()->SetScalars(radius);
+  polyData->GetPointData()->AddArray(fix);
+  polyData->GetPointData()->AddArray(coordNR);
+  polyData->GetPointData()->AddArray(material);
+
+  auto writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetFileName(filename.c_str());
+  writer->SetInputData(polyData);
+  writer->SetDataModeToAppended();
+  writer->EncodeAppendedDataOff();
+  writer->SetCompressorTypeToLZ4();
+  writer->SetHeaderTypeToUInt64();
+  return writer->Write() != 0;
+}
+
+static int Run(const BondSettings &s)
+{
+  Data data;
+  data.yaml.config["simulation"]["input"] = s.input;
+  Reader reader(&data);
+  reader.Initialization();
+  if (!data.COMPUTE)
+    return 1;
+
+  const index_t N = data.PARTICLE_COUNT;
+  const double TOLERANCE = s.tolerance;
+  auto &RADIUS = data.RADIUS;
+  // The search runs on radii grown by half the tolerance, so that every pair
+  // within the tolerance is inside the ContactSearch skin; the bond test
+  // below uses the radii from the file (OLD_RADIUS).
+#ifdef DENSEPACKING_LAZY_RADIUS
+  // RADIUS is data.OLD_RADIUS in this build: the file radii are kept aside
+  // and put back after the search.
+  Kokkos::View<double *> OLD_RADIUS("BONDS_FILE_RADIUS", N);
+  Kokkos::deep_copy(OLD_RADIUS, data.OLD_RADIUS);
+#else
+  auto &OLD_RADIUS = data.OLD_RADIUS;
+#endif
+  if (TOLERANCE > 0)
+  {
+    const double GROW = 0.5 * TOLERANCE;
+    Kokkos::parallel_for("BONDS_GROW_RADIUS", N, KOKKOS_LAMBDA(const index_t idx) { RADIUS(idx) = OLD_RADIUS(idx) + GROW; });
+    double max_radius = 0;
+    Kokkos::parallel_reduce("BONDS_MAX_RADIUS", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+      if (RADIUS(idx) > local)
+        local = RADIUS(idx); }, Kokkos::Max<double>(max_radius));
+    data.allocateNeighbours(data.min_radius + GROW, max_radius);
+    if (!data.COMPUTE)
+      return 1;
+  }
+
+  ContactSearch search(&data);
+  search.Initialization();
+  if (!data.COMPUTE)
+    return 1;
+  search.RunKernels();
+#ifdef DENSEPACKING_LAZY_RADIUS
+  Kokkos::deep_copy(data.OLD_RADIUS, OLD_RADIUS);
+#endif
+
+  auto &POSITION = data.POSITION;
+  auto &NN_COUNT = data.NN_COUNT;
+  const NeighbourList NEIGHBOURS = data.Neighbours();
+  Kokkos::View<int *> COORDINATION("BONDS_COORDINATION", N);
+  Kokkos::View<index_t *> BOND_OFFSET("BOND_OFFSET", N + 1);
+
+  // The neighbour lists hold both directions of every pair: a particle
+  // counts all of its bonds and owns the ones to higher indices.
+  Kokkos::parallel_for("BONDS_COUNT", N, KOKKOS_LAMBDA(const index_t idx) {
+    const Vec3 P1 = POSITION(idx);
+    const double R1 = OLD_RADIUS(idx);
+    int all = 0, own = 0;
+    for (int k = 0; k < NN_COUNT(idx); ++k)
+    {
+      const index_t pid = NEIGHBOURS(idx, k);
+      if (R1 + OLD_RADIUS(pid) - (POSITION(pid) - P1).length() >= -TOLERANCE)
+      {
+        all++;
+        if (pid > idx)
+          own++;
+      }
+    }
+    COORDINATION(idx) = all;
+    BOND_OFFSET(idx) = own; });
+
+  index_t count = 0;
+  Kokkos::parallel_scan("BONDS_OFFSET", N + 1, KOKKOS_LAMBDA(const index_t i, index_t &offset, const bool final) {
+    const index_t own = i < N ? BOND_OFFSET(i) : 0;
+    if (final)
+      BOND_OFFSET(i) = offset;
+    offset += own; }, count);
+
+  Kokkos::View<index_t *[2]> BONDS("BONDS", count);
+  Kokkos::parallel_for("BONDS_FILL", N, KOKKOS_LAMBDA(const index_t idx) {
+    const Vec3 P1 = POSITION(idx);
+    const double R1 = OLD_RADIUS(idx);
+    index_t b = BOND_OFFSET(idx);
+    for (int k = 0; k < NN_COUNT(idx); ++k)
+    {
+      const index_t pid = NEIGHBOURS(idx, k);
+      if (pid > idx && R1 + OLD_RADIUS(pid) - (POSITION(pid) - P1).length() >= -TOLERANCE)
+      {
+        BONDS(b, 0) = idx;
+        BONDS(b, 1) = pid;
+        b++;
+      }
+    }
+  });
+  auto BONDS_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), BONDS);
+  std::cout << "Particles: " << N << ", bonds: " << count << " (tolerance " << TOLERANCE << ")\n";
+
+  const bool ok = s.format == "vtp" ? WriteVtp(s.out, data, COORDINATION, BONDS_host) : WriteEdges(s.out, N, BONDS_host);
+  if (!ok)
+  {
+    std::cerr << "DensePackingBonds: failed to write " << s.out << "\n";
+    return 1;
+  }
+  std::cout << "Wrote " << s.out << "\n";
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  Parallel::Initialize(&argc, &argv);
+  Kokkos::initialize(argc, argv);
+  int status = 0;
+  {
+    BondSettings s = ParseArgs(argc, argv);
+    if (Parallel::Size() > 1)
+    {
+      if (Parallel::IsRoot())
+        std::cerr << "DensePackingBonds runs on a single rank.\n";
+      status = 1;
+    }
+    else
+      status = Run(s);
+  }
+  Kokkos::finalize();
+  Parallel::Finalize();
+  return status;
+}
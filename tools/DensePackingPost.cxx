@@ -0,0 +1,772 @@
+// Multi-frame post-processor for DensePacking output.
+//
+// Streams a frame series (data/PARTICLES.dpts, or a directory of
+// PARTICLES_*.vtp / .pvtp frames) through a chain of filters and writes the
+// reduced results. Frames are loaded ahead on host threads while the
+// current frame runs through the filters as Kokkos kernels, and filtered
+// frames are written in the background.
+//
+// Usage:
+//   DensePackingPost [post.yaml]
+//
+// post.yaml:
+//   input: data/PARTICLES.dpts   # or a directory with PARTICLES_*.vtp/.pvtp
+//   every: 1                     # process every n-th frame
+//   prefetch: 2                  # frames loaded ahead
+//   output: post                 # directory for the results
+//   write_frames: false          # also write every filtered frame as .vtp
+//   filters:                     # applied in this order
+//     - cylinder: {radius: 10, center: [0, 0], zmin: -150, zmax: 150, fully_inside: true}
+//     - box: {min: [-10, -10, -150], max: [10, 10, 150], fully_inside: false}
+//     - rattlers: {min_contacts: 4, tolerance: 1e-6}
+//     - coordination: {tolerance: 1e-6}
+//
+// Region filters keep the particles whose centre (or, with fully_inside,
+// whole sphere) lies inside. rattlers repeatedly drops free particles with
+// fewer than min_contacts contacts among the kept particles. coordination
+// records the contact number of the kept free particles.
+//
+// Results: <output>/STATISTICS.csv (one row per frame), COORDINATION.csv
+// (histogram per frame, with a coordination filter) and FRAME_<step>.vtp.
+#include <Kokkos_Core.hpp>
+#include "Data.h"
+#include "ContactSearch.h"
+#include "Parallel.h"
+#include "TimeSeries.h"
+#include "YamlAPI.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// VTK Includes
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkPoints.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkPointData.h>
+#include <vtkDataSetAttributes.h>
+#include <vtkXMLPolyDataReader.h>
+#include <vtkXMLPolyDataWriter.h>
+
+namespace fs = std::filesystem;
+
+struct Region
+{
+  enum Kind
+  {
+    CYLINDER,
+    BOX
+  };
+  int kind = BOX;
+  double lo[3] = {-1E300, -1E300, -1E300};
+  double hi[3] = {1E300, 1E300, 1E300};
+  double cx = 0, cy = 0, radius = 0; // cylinder along z, bounded by lo[2]/hi[2]
+  bool fully_inside = false;
+
+  KOKKOS_INLINE_FUNCTION
+  bool Contains(const Vec3 &p, double r) const
+  {
+    const double m = fully_inside ? r : 0.0;
+    if (p.z - m < lo[2] || p.z + m > hi[2])
+      return false;
+    if (kind == CYLINDER)
+    {
+      const double dx = p.x - cx, dy = p.y - cy;
+      return radius - m > 0 && dx * dx + dy * dy <= (radius - m) * (radius - m);
+    }
+    return p.x - m >= lo[0] && p.x + m <= hi[0] && p.y - m >= lo[1] && p.y + m <= hi[1];
+  }
+
+  // Infinite when the region is unbounded along some axis.
+  double Volume() const
+  {
+    const double height = hi[2] - lo[2];
+    if (kind == CYLINDER)
+      return height > 1E299 ? INFINITY : M_PI * radius * radius * height;
+    double volume = 1;
+    for (int axis = 0; axis < 3; ++axis)
+      volume *= hi[axis] - lo[axis] > 1E299 ? INFINITY : hi[axis] - lo[axis];
+    return volume;
+  }
+};
+
+struct Filter
+{
+  enum Kind
+  {
+    REGION,
+    RATTLERS,
+    COORDINATION
+  };
+  Kind kind = REGION;
+  Region region;
+  int min_contacts = 4;
+  double tolerance = 0;
+};
+
+struct PostSettings
+{
+  std::string input;
+  std::string output = "post";
+  int every = 1;
+  int prefetch = 2;
+  bool write_frames = false;
+  std::vector<Filter> filters;
+};
+
+// One frame on the host, as loaded from the series or a .vtp/.pvtp file.
+struct HostFrame
+{
+  uint64_t step = 0;
+  std::vector<Vec3> position;
+  std::vector<double> radius;
+  std::vector<int> fix;
+};
+
+// The kept particles of a processed frame, handed to the background writer.
+struct ReducedFrame
+{
+  uint64_t step = 0;
+  std::vector<Vec3> position;
+  std::vector<double> radius;
+  std::vector<int> fix;
+  std::vector<int> coordination; // empty without a coordination filter
+};
+
+static bool ParseSettings(const std::string &filename, PostSettings &s)
+{
+  YAML::Node config = YamlAPI::LoadConfig(filename);
+  if (!config || !config["input"])
+  {
+    std::cerr << "DensePackingPost: " << filename << " must set input.\n";
+    return false;
+  }
+  s.input = config["input"].as<std::string>();
+  if (config["output"])
+    s.output = config["output"].as<std::string>();
+  if (config["every"])
+    s.every = std::max(1, config["every"].as<int>());
+  if (config["prefetch"])
+    s.prefetch = std::max(0, config["prefetch"].as<int>());
+  s.write_frames = config["write_frames"] && config["write_frames"].as<bool>();
+
+  for (const auto &entry : config["filters"])
+  {
+    if (!entry.IsMap() || entry.size() != 1)
+    {
+      std::cerr << "DensePackingPost: every filters entry must be a single-key map.\n";
+      return false;
+    }
+    const std::string name = entry.begin()->first.as<std::string>();
+    const YAML::Node node = entry.begin()->second;
+    Filter f;
+    if (name == "cylinder" || name == "box")
+    {
+      f.kind = Filter::REGION;
+      f.region.fully_inside = node["fully_inside"] && node["fully_inside"].as<bool>();
+      if (name == "cylinder")
+      {
+        if (!node["radius"])
+        {
+          std::cerr << "DensePackingPost: cylinder needs a radius.\n";
+          return false;
+        }
+        f.region.kind = Region::CYLINDER;
+        f.region.radius = node["radius"].as<double>();
+        if (node["center"])
+        {
+          auto center = node["center"].as<std::vector<double>>();
+          f.region.cx = center.at(0);
+          f.region.cy = center.at(1);
+        }
+        if (node["zmin"])
+          f.region.lo[2] = node["zmin"].as<double>();
+        if (node["zmax"])
+          f.region.hi[2] = node["zmax"].as<double>();
+      }
+      else
+      {
+        f.region.kind = Region::BOX;
+        if (!node["min"] || !node["max"])
+        {
+          std::cerr << "DensePackingPost: box needs min and max.\n";
+          return false;
+        }
+        auto lo = node["min"].as<std::vector<double>>();
+        auto hi = node["max"].as<std::vector<double>>();
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          f.region.lo[axis] = lo.at(axis);
+          f.region.hi[axis] = hi.at(axis);
+        }
+      }
+    }
+    else if (name == "rattlers")
+    {
+      f.kind = Filter::RATTLERS;
+      if (node["min_contacts"])
+        f.min_contacts = node["min_contacts"].as<int>();
+      if (node["tolerance"])
+        f.tolerance = node["tolerance"].as<double>();
+    }
+    else if (name == "coordination")
+    {
+      f.kind = Filter::COORDINATION;
+      if (node["tolerance"])
+        f.tolerance = node["tolerance"].as<double>();
+    }
+    else
+    {
+      std::cerr << "DensePackingPost: unknown filter " << name << "\n";
+      return false;
+    }
+    if (f.tolerance < 0)
+    {
+      std::cerr << "DensePackingPost: " << name << ".tolerance must not be negative.\n";
+      return false;
+    }
+    s.filters.push_back(f);
+  }
+  return true;
+}
+
+// Step number from the digits that end a PARTICLES_<step> file name.
+static uint64_t StepFromName(const fs::path &path)
+{
+  const std::string stem = path.stem().string();
+  size_t first = stem.size();
+  while (first > 0 && std::isdigit((unsigned char)stem[first - 1]))
+    first--;
+  return first < stem.size() ? std::stoull(stem.substr(first)) : 0;
+}
+
+// Frames of a directory: the .pvtp indices of partitioned output if there
+// are any, else the single-file .vtp frames, ordered by step.
+static std::vector<fs::path> ListFrames(const fs::path &directory)
+{
+  std::vector<fs::path> vtp, pvtp;
+  for (const auto &entry : fs::directory_iterator(directory))
+  {
+    const std::string name = entry.path().filename().string();
+    if (name.rfind("PARTICLES_", 0) != 0)
+      continue;
+    if (entry.path().extension() == ".pvtp")
+      pvtp.push_back(entry.path());
+    else if (entry.path().extension() == ".vtp")
+      vtp.push_back(entry.path());
+  }
+  auto &frames = pvtp.empty() ? vtp : pvtp;
+  std::sort(frames.begin(), frames.end(), [](const fs::path &a, const fs::path &b) { return StepFromName(a) < StepFromName(b); });
+  return frames;
+}
+
+// Appends the points of one .vtp file, skipping duplicate-point ghosts.
+static bool AppendPolyData(const fs::path &filename, HostFrame &frame)
+{
+  auto reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+  reader->SetFileName(filename.string().c_str());
+  reader->Update();
+  vtkPolyData *polyData = reader->GetOutput();
+  vtkDataArray *radius = polyData ? polyData->GetPointData()->GetArray("RADIUS") : nullptr;
+  if (!radius || !polyData->GetPoints())
+  {
+    std::cerr << "DensePackingPost: cannot read particles from " << filename << "\n";
+    return false;
+  }
+  vtkDataArray *fix = polyData->GetPointData()->GetArray("FIX");
+  vtkDataArray *ghosts = polyData->GetPointData()->GetArray(vtkDataSetAttributes::GhostArrayName());
+  const vtkIdType count = polyData->GetNumberOfPoints();
+  vtkDataArray *points = polyData->GetPoints()->GetData();
+  for (vtkIdType j = 0; j < count; ++j)
+  {
+    if (ghosts && ghosts->GetComponent(j, 0) != 0)
+      continue;
+    frame.position.push_back(Vec3(points->GetComponent(j, 0), points->GetComponent(j, 1), points->GetComponent(j, 2)));
+    frame.radius.push_back(radius->GetComponent(j, 0));
+    frame.fix.push_back(fix ? (int)fix->GetComponent(j, 0) : 0);
+  }
+  return true;
+}
+
+// The pieces of a .pvtp written by Writer::WriteIndex, relative to it.
+static std::vector<fs::path> PieceSources(const fs::path &index)
+{
+  std::vector<fs::path> pieces;
+  std::ifstream in(index);
+  std::string line;
+  const std::string key = "Source=\"";
+  while (std::getline(in, line))
+  {
+    const size_t at = line.find(key);
+    if (at == std::string::npos)
+      continue;
+    const size_t end = line.find('"', at + key.size());
+    pieces.push_back(index.parent_path() / line.substr(at + key.size(), end - at - key.size()));
+  }
+  return pieces;
+}
+
+static bool LoadFile(const fs::path &filename, HostFrame &frame)
+{
+  frame.step = StepFromName(filename);
+  if (filename.extension() != ".pvtp")
+    return AppendPolyData(filename, frame);
+  const auto pieces = PieceSources(filename);
+  if (pieces.empty())
+  {
+    std::cerr << "DensePackingPost: no pieces listed in " << filename << "\n";
+    return false;
+  }
+  for (const auto &piece : pieces)
+    if (!AppendPolyData(piece, frame))
+      return false;
+  return true;
+}
+
+// Filter chain on the device. The particle Views of `data` hold the frame;
+// KEEP marks the particles that survived the filters so far.
+class FramePipeline
+{
+public:
+  explicit FramePipeline(const PostSettings &s) : settings(s)
+  {
+    for (const auto &f : settings.filters)
+    {
+      if (f.kind != Filter::REGION)
+        contact_tolerance = std::max(contact_tolerance, f.tolerance);
+      if (f.kind == Filter::REGION)
+        region_volume = f.region.Volume();
+    }
+  }
+
+  bool Open()
+  {
+    std::error_code error;
+    fs::create_directories(settings.output, error);
+    statistics.open(fs::path(settings.output) / "STATISTICS.csv");
+    if (!statistics)
+    {
+      std::cerr << "DensePackingPost: cannot write to " << settings.output << "\n";
+      return false;
+    }
+    statistics << "STEP;PARTICLES;KEPT;RATTLERS;MEAN_COORDINATION;SOLID_FRACTION\n";
+    for (const auto &f : settings.filters)
+      if (f.kind == Filter::COORDINATION && !coordination_csv.is_open())
+      {
+        coordination_csv.open(fs::path(settings.output) / "COORDINATION.csv");
+        coordination_csv << "STEP;Z;COUNT\n";
+      }
+    return true;
+  }
+
+  bool Process(const HostFrame &frame, ReducedFrame &reduced)
+  {
+    const index_t N = frame.position.size();
+    if (N != data.PARTICLE_COUNT || (index_t)data.POSITION.extent(0) != N)
+      data.allocateParticles(N);
+    Upload(frame);
+    Kokkos::realloc(KEEP, N);
+    Kokkos::deep_copy(KEEP, 1);
+    contacts_built = false;
+    rattlers = 0;
+    double mean_coordination = NAN;
+    Kokkos::View<int *> Z;
+
+    for (const auto &f : settings.filters)
+    {
+      if (f.kind == Filter::REGION)
+        ApplyRegion(f.region);
+      else
+      {
+        if (!contacts_built && !BuildContacts())
+          return false;
+        if (f.kind == Filter::RATTLERS)
+          rattlers += RemoveRattlers(f);
+        else
+          mean_coordination = Coordination(f, frame.step, Z);
+      }
+    }
+
+    auto &KEEP = this->KEEP;
+    auto &OLD_RADIUS = data.OLD_RADIUS;
+    index_t kept = 0;
+    double solid = 0;
+    Kokkos::parallel_reduce("POST_KEPT", N, KOKKOS_LAMBDA(const index_t idx, index_t &sum) { sum += KEEP(idx); }, kept);
+    Kokkos::parallel_reduce("POST_SOLID", N, KOKKOS_LAMBDA(const index_t idx, double &sum) {
+      const double r = OLD_RADIUS(idx);
+      if (KEEP(idx))
+        sum += 4.0 / 3.0 * M_PI * r * r * r; }, solid);
+
+    statistics << frame.step << ";" << N << ";" << kept << ";" << rattlers << ";" << mean_coordination << ";"
+               << (std::isfinite(region_volume) ? solid / region_volume : NAN) << "\n";
+    if (settings.write_frames)
+      Reduce(frame, Z, reduced);
+    return true;
+  }
+
+private:
+  void Upload(const HostFrame &frame)
+  {
+    typedef Kokkos::View<const Vec3 *, Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged>> HostPositions;
+    typedef Kokkos::View<const double *, Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged>> HostDoubles;
+    typedef Kokkos::View<const int *, Kokkos::HostSpace, Kokkos::MemoryTraits<Kokkos::Unmanaged>> HostInts;
+    const size_t N = frame.position.size();
+    Kokkos::deep_copy(data.POSITION, HostPositions(frame.position.data(), N));
+    Kokkos::deep_copy(data.RADIUS, HostDoubles(frame.radius.data(), N));
+    Kokkos::deep_copy(data.OLD_RADIUS, data.RADIUS);
+    Kokkos::deep_copy(data.FIX, HostInts(frame.fix.data(), N));
+  }
+
+  void ApplyRegion(const Region &region)
+  {
+    auto &KEEP = this->KEEP;
+    auto &POSITION = data.POSITION;
+    auto &RADIUS = data.OLD_RADIUS;
+    Kokkos::parallel_for("POST_REGION", data.PARTICLE_COUNT, KOKKOS_LAMBDA(const index_t idx) {
+      if (KEEP(idx) && !region.Contains(POSITION(idx), RADIUS(idx)))
+        KEEP(idx) = 0; });
+  }
+
+  // Neighbour lists of the whole frame, searched with radii grown by half
+  // the largest contact tolerance (as DensePackingBonds does).
+  bool BuildContacts()
+  {
+    const index_t N = data.PARTICLE_COUNT;
+    const double GROW = 0.5 * contact_tolerance;
+    auto &RADIUS = data.RADIUS;
+#ifdef DENSEPACKING_LAZY_RADIUS
+    // RADIUS is OLD_RADIUS in this build: the file radii are kept aside and
+    // put back after the search.
+    Kokkos::View<double *> OLD_RADIUS("POST_FILE_RADIUS", N);
+    Kokkos::deep_copy(OLD_RADIUS, data.OLD_RADIUS);
+#else
+    auto &OLD_RADIUS = data.OLD_RADIUS;
+#endif
+    Kokkos::parallel_for("POST_GROW_RADIUS", N, KOKKOS_LAMBDA(const index_t idx) { RADIUS(idx) = OLD_RADIUS(idx) + GROW; });
+    double min_radius = 0, max_radius = 0;
+    Kokkos::parallel_reduce("POST_MIN_RADIUS", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+      if (RADIUS(idx) < local)
+        local = RADIUS(idx); }, Kokkos::Min<double>(min_radius));
+    Kokkos::parallel_reduce("POST_MAX_RADIUS", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+      if (RADIUS(idx) > local)
+        local = RADIUS(idx); }, Kokkos::Max<double>(max_radius));
+    // The lists are only reallocated when the frame needs more room.
+    if (Data::neighbourCapacity(min_radius, max_radius) > data.simConstants.NN_MAX ||
+        data.NN_IDS.extent(0) < (size_t)N * data.simConstants.NN_MAX)
+      data.allocateNeighbours(min_radius, max_radius);
+    if (!data.COMPUTE)
+      return false;
+    ContactSearch search(&data);
+    search.Initialization();
+    if (!data.COMPUTE)
+      return false;
+    search.RunKernels();
+#ifdef DENSEPACKING_LAZY_RADIUS
+    Kokkos::deep_copy(data.OLD_RADIUS, OLD_RADIUS);
+#endif
+    contacts_built = true;
+    return true;
+  }
+
+  // Drops free particles with fewer than min_contacts contacts among the
+  // kept particles until none is left; returns how many were dropped.
+  index_t RemoveRattlers(const Filter &f)
+  {
+    const index_t N = data.PARTICLE_COUNT;
+    const int MIN_CONTACTS = f.min_contacts;
+    const double TOLERANCE = f.tolerance;
+    auto &KEEP = this->KEEP;
+    auto &POSITION = data.POSITION;
+    auto &RADIUS = data.OLD_RADIUS;
+    auto &FIX = data.FIX;
+    auto &NN_COUNT = data.NN_COUNT;
+    const NeighbourList NEIGHBOURS = data.Neighbours();
+    Kokkos::View<int *> DROP("POST_DROP", N);
+    index_t total = 0;
+    for (;;)
+    {
+      index_t dropped = 0;
+      Kokkos::parallel_reduce("POST_RATTLERS", N, KOKKOS_LAMBDA(const index_t idx, index_t &sum) {
+        DROP(idx) = 0;
+        if (!KEEP(idx) || FIX(idx) != 0)
+          return;
+        const Vec3 P1 = POSITION(idx);
+        const double R1 = RADIUS(idx);
+        int z = 0;
+        for (int k = 0; k < NN_COUNT(idx); ++k)
+        {
+          const index_t pid = NEIGHBOURS(idx, k);
+          if (KEEP(pid) && R1 + RADIUS(pid) - (POSITION(pid) - P1).length() >= -TOLERANCE)
+            z++;
+        }
+        if (z < MIN_CONTACTS)
+        {
+          DROP(idx) = 1;
+          sum++;
+        } }, dropped);
+      if (dropped == 0)
+        return total;
+      total += dropped;
+      Kokkos::parallel_for("POST_DROP_RATTLERS", N, KOKKOS_LAMBDA(const index_t idx) {
+        if (DROP(idx))
+          KEEP(idx) = 0; });
+    }
+  }
+
+  // Contact numbers of the kept free particles; appends their histogram to
+  // COORDINATION.csv and returns the mean.
+  double Coordination(const Filter &f, uint64_t step, Kokkos::View<int *> &Z)
+  {
+    const index_t N = data.PARTICLE_COUNT;
+    const int NN_MAX = data.simConstants.NN_MAX;
+    const double TOLERANCE = f.tolerance;
+    auto &KEEP = this->KEEP;
+    auto &POSITION = data.POSITION;
+    auto &RADIUS = data.OLD_RADIUS;
+    auto &FIX = data.FIX;
+    auto &NN_COUNT = data.NN_COUNT;
+    const NeighbourList NEIGHBOURS = data.Neighbours();
+    Z = Kokkos::View<int *>("POST_COORDINATION", N);
+    Kokkos::View<double *> HIST("POST_COORDINATION_HIST", NN_MAX + 1);
+    double sum = 0;
+    index_t counted = 0;
+    Kokkos::parallel_reduce("POST_COORDINATION", N, KOKKOS_LAMBDA(const index_t idx, double &local) {
+      if (!KEEP(idx))
+        return;
+      const Vec3 P1 = POSITION(idx);
+      const double R1 = RADIUS(idx);
+      int z = 0;
+      for (int k = 0; k < NN_COUNT(idx); ++k)
+      {
+        const index_t pid = NEIGHBOURS(idx, k);
+        if (KEEP(pid) && R1 + RADIUS(pid) - (POSITION(pid) - P1).length() >= -TOLERANCE)
+          z++;
+      }
+      Z(idx) = z;
+      if (FIX(idx) != 0)
+        return;
+      local += z;
+      Kokkos::atomic_add(&HIST(z), 1.0); }, sum);
+    Kokkos::parallel_reduce("POST_COORDINATION_COUNT", N, KOKKOS_LAMBDA(const index_t idx, index_t &local) {
+      local += KEEP(idx) && FIX(idx) == 0; }, counted);
+
+    auto host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), HIST);
+    for (int z = 0; z <= NN_MAX; ++z)
+      if (host(z) > 0)
+        coordination_csv << step << ";" << z << ";" << (long)host(z) << "\n";
+    return counted > 0 ? sum / counted : NAN;
+  }
+
+  void Reduce(const HostFrame &frame, const Kokkos::View<int *> &Z, ReducedFrame &reduced)
+  {
+    auto keep = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), KEEP);
+    auto z = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), Z);
+    reduced = ReducedFrame();
+    reduced.step = frame.step;
+    for (size_t j = 0; j < frame.position.size(); ++j)
+    {
+      if (!keep(j))
+        continue;
+      reduced.position.push_back(frame.position[j]);
+      reduced.radius.push_back(frame.radius[j]);
+      reduced.fix.push_back(frame.fix[j]);
+      if (z.extent(0) > 0)
+        reduced.coordination.push_back(z(j));
+    }
+  }
+
+  const PostSettings &settings;
+  Data data;
+  Kokkos::View<int *> KEEP;
+  double contact_tolerance = 0;
+  double region_volume = INFINITY; // of the last region filter
+  bool contacts_built = false;
+  index_t rattlers = 0;
+  std::ofstream statistics;
+  std::ofstream coordination_csv;
+};
+
+static void WriteFrame(const std::string &directory, const ReducedFrame &frame)
+{
+  const vtkIdType count = frame.position.size();
+  auto points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToDouble();
+  points->SetNumberOfPoints(count);
+  auto radius = vtkSmartPointer<vtkDoubleArray>::New();
+  radius->SetName("RADIUS");
+  radius->SetNumberOfTuples(count);
+  auto fix = vtkSmartPointer<vtkIntArray>::New();
+  fix->SetName("FIX");
+  fix->SetNumberOfTuples(count);
+  for (vtkIdType j = 0; j < count; ++j)
+  {
+    points->SetPoint(j, frame.position[j].x, frame.position[j].y, frame.position[j].z);
+    radius->SetValue(j, frame.radius[j]);
+    fix->SetValue(j, frame.fix[j]);
+  }
+  auto polyData = vtkSmartPointer<vtkPolyData>::New();
+  polyData->SetPoints(points);
+  polyData->GetPointData()->SetScalars(radius);
+  polyData->GetPointData()->AddArray(fix);
+  if (!frame.coordination.empty())
+  {
+    auto coordNR = vtkSmartPointer<vtkIntArray>::New();
+    coordNR->SetName("COORDINATION_NUMBER");
+    coordNR->SetNumberOfTuples(count);
+    for (vtkIdType j = 0; j < count; ++j)
+      coordNR->SetValue(j, frame.coordination[j]);
+    polyData->GetPointData()->AddArray(coordNR);
+  }
+
+  std::stringstream filename;
+  filename << directory << "/FRAME_" << std::setfill('0') << std::setw(10) << frame.step << ".vtp";
+  auto writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+  writer->SetFileName(filename.str().c_str());
+  writer->SetInputData(polyData);
+  writer->SetDataModeToAppended();
+  writer->EncodeAppendedDataOff();
+  writer->SetCompressorTypeToLZ4();
+  writer->SetHeaderTypeToUInt64();
+  if (writer->Write() == 0)
+    std::cerr << "DensePackingPost: failed to write " << filename.str() << "\n";
+}
+
+static int Run(const PostSettings &s)
+{
+  // Frame sources: the frames of a series file or the files of a directory.
+  TimeSeries::SeriesReader series;
+  std::mutex series_lock;
+  std::vector<fs::path> files;
+  size_t frames = 0;
+  const bool is_series = fs::path(s.input).extension() == TimeSeries::EXTENSION;
+  if (is_series)
+  {
+    if (!series.Open(s.input))
+    {
+      std::cerr << "DensePackingPost: cannot open series " << s.input << "\n";
+      return 1;
+    }
+    frames = series.Frames();
+  }
+  else
+  {
+    std::error_code error;
+    if (!fs::is_directory(s.input, error))
+    {
+      std::cerr << "DensePackingPost: input must be a " << TimeSeries::EXTENSION << " file or a directory of frames.\n";
+      return 1;
+    }
+    files = ListFrames(s.input);
+    frames = files.size();
+  }
+  std::cout << "DensePackingPost: " << (frames + s.every - 1) / s.every << " of " << frames << " frames from " << s.input << "\n";
+
+  auto load = [&](size_t k) {
+    HostFrame frame;
+    bool ok;
+    if (is_series)
+    {
+      TimeSeries::Frame f;
+      {
+        // The reader keeps one file position, so series reads take turns.
+        std::lock_guard<std::mutex> guard(series_lock);
+        ok = series.Read(k, f);
+      }
+      frame.step = f.step;
+      frame.position = std::move(f.position);
+      frame.radius = std::move(f.radius);
+      frame.fix = series.Fix();
+    }
+    else
+      ok = LoadFile(files[k], frame);
+    if (!ok)
+      frame.position.clear();
+    return frame;
+  };
+
+  FramePipeline pipeline(s);
+  if (!pipeline.Open())
+    return 1;
+
+  std::deque<std::future<HostFrame>> pending;
+  size_t next = 0;
+  auto prefetch = [&]() {
+    while (pending.size() <= (size_t)s.prefetch && next < frames)
+    {
+      pending.push_back(std::async(std::launch::async, load, next));
+      next += s.every;
+    }
+  };
+  std::future<void> writing;
+  int status = 0;
+  prefetch();
+  while (!pending.empty())
+  {
+    HostFrame frame = pending.front().get();
+    pending.pop_front();
+    prefetch();
+    if (frame.position.empty())
+    {
+      status = 1;
+      continue;
+    }
+    ReducedFrame reduced;
+    if (!pipeline.Process(frame, reduced))
+    {
+      status = 1;
+      break;
+    }
+    if (s.write_frames)
+    {
+      if (writing.valid())
+        writing.get();
+      writing = std::async(std::launch::async, [directory = s.output, r = std::move(reduced)]() { WriteFrame(directory, r); });
+    }
+  }
+  for (auto &f : pending)
+    f.wait();
+  if (writing.valid())
+    writing.get();
+  std::cout << "DensePackingPost: results in " << s.output << "\n";
+  return status;
+}
+
+int main(int argc, char *argv[])
+{
+  Parallel::Initialize(&argc, &argv);
+  Kokkos::initialize(argc, argv);
+  int status = 0;
+  {
+    std::string config = "post.yaml";
+    for (int i = 1; i < argc; ++i)
+      if (std::string(argv[i]).rfind("--kokkos", 0) != 0)
+        config = argv[i];
+    PostSettings s;
+    if (Parallel::Size() > 1)
+    {
+      if (Parallel::IsRoot())
+        std::cerr << "DensePackingPost runs on a single rank.\n";
+      status = 1;
+    }
+    else if (!ParseSettings(config, s))
+      status = 1;
+    else
+      status = Run(s);
+  }
+  Kokkos::finalize();
+  Parallel::Finalize();
+  return status;
+}